@@ -32,6 +32,11 @@
 #include "Noise/2d/PerlinNoise2D.h"
 #include "Noise/2d/BlueNoise2D.h"
 #include "Utils/ImageLoader.h"
+#include "Utils/TaskScheduler.h"
+#include "Utils/NoiseCache.h"
+#include "Utils/NoiseBakeQueue.h"
+#include "Utils/CloudLightTexture.h"
+#include "Utils/CloudReprojector.h"
 
 #include <random> 
 #include <functional> 
@@ -63,6 +68,10 @@ struct UniformBlock
 	mat4 mToWorldMat;
 	mat4 mModelViewProj;
 	mat4 mInvModelViewProj;
+	// temporal reprojection of the clouds: mModelViewProj of the previous frame, and xy the pixel of the 4x4 blocks
+	// marched this frame, zw the image size
+	mat4 mPrevModelViewProj;
+	vec4 mReprojectionParams;
 
 	// Point Light Information
 	vec3 mCameraPos;
@@ -97,6 +106,22 @@ Sampler*       pSamplerCloud = NULL;
 //Texture*       pCloudShapeTexture;
 //Texture*       pWeatherTexture;
 //Texture*       pBlueNoiseTexture;
+// sparse cloud shape, sampled when the cloud shader is built with SPARSE_CLOUD_SHAPE
+//Texture*       pCloudBrickIndex;
+//Texture*       pCloudBrickPool;
+//Texture*       pCloudDetailTexture;
+// occupancy grid, sampled when the cloud shader is built with CLOUD_OCCUPANCY
+//Texture*       pCloudOccupancyTexture;
+// optical depth toward the sun, read when the cloud shader is built with LIGHT_VOLUME
+//Texture*       pCloudLightTexture;
+//CloudLightVolume gCloudLightVolume(32, 16, 32);
+// two textures behind pCloudLightTexture, the new volume is uploaded while the frames in flight sample the other one
+//CloudLightTexture gCloudLightTexture;
+// quarter resolution targets of the cloud pass built with TEMPORAL_REPROJECTION (color, cloud distance) and the
+// full resolution history cloudResolve.frag reads and writes, two of each swapped every frame
+//RenderTarget*  pCloudSamples[2] = { NULL };
+//RenderTarget*  pCloudHistory[2] = { NULL };
+//RenderTarget*  pCloudHistoryDepth[2] = { NULL };
 
 DescriptorSet* pDescriptorSetTexture = { NULL };
 DescriptorSet* pDescriptorSetUniforms = { NULL };
@@ -105,6 +130,8 @@ DescriptorSet* pDescriptorSetUniforms = { NULL };
 Buffer* pProjViewUniformBuffer[gImageCount] = { NULL };
 
 uint32_t gFrameIndex = 0;
+// frames since Init, picks the pixel of every 4x4 block marched this frame
+uint32_t gCloudFrameIndex = 0;
 ProfileToken gGpuProfileToken = PROFILE_INVALID_TOKEN;
 
 UniformBlock     gUniformData;
@@ -211,41 +238,59 @@ public:
 
 		initResourceLoaderInterface(pRenderer);
 
+		// Worker pool used to bake the noise textures
+		TaskScheduler::init();
+		// baked noise textures are reused across launches
+		NoiseCache::init("NoiseCache");
+		// the noise textures are baked in the background, frames use placeholders until they are resident
+		NoiseBakeQueue::init();
+
 		// Load quad Textures
 		//WorleyNoise2D worleyGenerator = WorleyNoise2D(IVector2(128, 128), 8);
-		//std::vector<float> worleyData = worleyGenerator.generateTexture();
-		//std::string worleyFileName = std::string("G:\\Projects\\Velene\\worley.png");
-		//ImageLoader::saveOneChannel(worleyFileName, worleyData, 128, 128);
+		//ImageExportSink worleySink("G:\\Projects\\Velene\\worley.png", NoiseExportFormat::Png, 128, 128);
+		//worleyGenerator.generate(worleySink);
 		//
 		//PerlinNoise2D perlinGenerator = PerlinNoise2D(IVector2(128, 128), IVector2(64, 64), 3, 3.0f);
-		//std::vector<float> perlinData = perlinGenerator.generateTexture();
-		//std::string perlinFileName = std::string("G:\\Projects\\Velene\\perlinx3.png");
-		//ImageLoader::saveOneChannel(perlinFileName, perlinData, 128, 128);
+		//ImageExportSink perlinSink("G:\\Projects\\Velene\\perlinx3.png", NoiseExportFormat::Png, 128, 128);
+		//perlinGenerator.generate(perlinSink);
 		//
 		//ValueNoise2D valueGenerator = ValueNoise2D(IVector2(128, 128), IVector2(64, 64), 3, 3.0f);
-		//std::vector<float> valueData = valueGenerator.generateTexture();
-		//std::string valueFileName = std::string("G:\\Projects\\Velene\\valuex3.png");
-		//ImageLoader::saveOneChannel(valueFileName, valueData, 128, 128);
+		//ImageExportSink valueSink("G:\\Projects\\Velene\\valuex3.png", NoiseExportFormat::Png, 128, 128);
+		//valueGenerator.generate(valueSink);
 
 		//WorleyNoise3D worleyGenerator3D = WorleyNoise3D(IVector3(48, 48, 48), 4);
-		//std::vector<float> valueData = worleyGenerator3D.generateTexture();
-		//std::string valueFileName = std::string("G:\\Projects\\Velene\\worley3d.png");
-		//ImageLoader::saveOneChannel(valueFileName, valueData, 48, 2304);
+		//ImageExportSink valueSink("G:\\Projects\\Velene\\worley3d.png", NoiseExportFormat::Png, 48, 48, 48);
+		//worleyGenerator3D.generate(valueSink);
 
 		//PerlinNoise3D perlinGenerator3D = PerlinNoise3D(IVector3(48, 48, 48), 64, 3, 1.0f);
-		//std::vector<float> valueData = perlinGenerator3D.generateTexture();
-		//std::string valueFileName = std::string("G:\\Projects\\Velene\\perlin3d.png");
-		//ImageLoader::saveOneChannel(valueFileName, valueData, 48, 2304);
-
-		//std::vector<float> data;
-		//ImageLoader::genTestTexture(256, 256, data);
-		////std::string valueFileName = std::string("G:\\Projects\\Velene\\perlin3d.png");
-		//std::string valueFileName = std::string("C:\\Users\\thibault\\Documents\\velene\\perlin.png");
-		//ImageLoader::saveOneChannel(valueFileName, data, 256, 256);
-
-		//ImageLoader::genWeatherTexture(512, 512, &pWeatherTexture, pViewParams.weatherScale, pViewParams.randomSeed);
-		//ImageLoader::genBlueNoiseTexture(128, 128, &pBlueNoiseTexture);
-		//ImageLoader::genCloudShapeTexture(256, 256, 64, &pCloudShapeTexture, pViewParams.randomSeed);
+		//ImageExportSink valueSink("G:\\Projects\\Velene\\perlin3d.png", NoiseExportFormat::Png, 48, 48, 48);
+		//perlinGenerator3D.generate(valueSink);
+
+		////ImageExportSink valueSink("G:\\Projects\\Velene\\perlin3d.png", NoiseExportFormat::Png, 256, 256, 1, 3);
+		//ImageExportSink valueSink("C:\\Users\\thibault\\Documents\\velene\\perlin.png", NoiseExportFormat::Png, 256, 256, 1, 3);
+		//ImageLoader::genTestTexture(256, 256, valueSink);
+
+		//NoiseBakeQueue::request(&pWeatherTexture, false, NoiseChannelLayout::R8, 0.0f, [](Texture** ppTexture, SyncToken* pSyncToken)
+		//{
+		//	ImageLoader::genWeatherTexture(512, 512, ppTexture, pViewParams.weatherScale, pViewParams.randomSeed, NoiseChannelLayout::R8, true, pSyncToken);
+		//});
+		//NoiseBakeQueue::request(&pBlueNoiseTexture, false, NoiseChannelLayout::R8, 0.5f, [](Texture** ppTexture, SyncToken* pSyncToken)
+		//{
+		//	ImageLoader::genBlueNoiseTexture(128, 128, ppTexture, NoiseChannelLayout::R8, pSyncToken);
+		//});
+		//NoiseBakeQueue::request(&pCloudShapeTexture, true, NoiseChannelLayout::RGBA8, 0.0f, [](Texture** ppTexture, SyncToken* pSyncToken)
+		//{
+		//	ImageLoader::genCloudShapeTexture(256, 256, 64, ppTexture, pViewParams.randomSeed, NoiseChannelLayout::RGBA8, true, pSyncToken);
+		//});
+		//ImageLoader::genCloudShapeBricks(256, 256, 64, pViewParams.randomSeed, 512, 512, pViewParams.weatherScale, pViewParams.randomSeed,
+		//	&pCloudBrickIndex, &pCloudBrickPool, &pCloudDetailTexture);
+		// the grid is built from the CPU mip chains of the cloud shape and weather above (see CloudReferenceRender)
+		//CloudOccupancyGrid occupancy(64, 32, 64);
+		//occupancy.build(cloudShapeMips, weatherMips, cloudParams);
+		//ImageLoader::genCloudOccupancyTexture(occupancy, &pCloudOccupancyTexture);
+		// the light volume integrates the same cloud toward the sun of cloudParams, Update() follows the sun
+		//gCloudLightVolume.build(CloudMarcher(cloudParams, cloudTextures));
+		//gCloudLightTexture.init(gCloudLightVolume, &pCloudLightTexture);
 
 		SamplerDesc quadSamplerDesc = { FILTER_LINEAR,
 									FILTER_LINEAR,
@@ -406,6 +451,7 @@ public:
 		setGlobalInputAction(&globalInputActionDesc);
 
 		gFrameIndex = 0; 
+		gCloudFrameIndex = 0;
 
 		return true;
 	}
@@ -447,6 +493,14 @@ public:
 		}
 		removeSemaphore(pRenderer, pImageAcquiredSemaphore);
 
+		NoiseBakeQueue::exit();
+		//gCloudLightTexture.exit();
+		//removeResource(pWeatherTexture);
+		//removeResource(pBlueNoiseTexture);
+		//removeResource(pCloudShapeTexture);
+		NoiseCache::exit();
+		TaskScheduler::exit();
+
 		exitResourceLoaderInterface(pRenderer);
 		exitScreenshotInterface();
 
@@ -546,10 +600,16 @@ public:
 		mat4 mvp = projMat.getPrimaryMatrix() * viewMat;
 		gUniformData.mProjectView = projMat * viewMat;
 		gUniformData.mToWorldMat = mat4::identity(); // mat4::scale(scaleFactor);
+		gUniformData.mPrevModelViewProj = gUniformData.mModelViewProj;
 		gUniformData.mModelViewProj = mvp;
 		gUniformData.mInvModelViewProj = inverse(mvp);
 		// point light parameters
 		gUniformData.mCameraPos = pCameraController->getViewPosition();
+		// one pixel of every 4x4 block is marched per frame, in Bayer order
+		uint32_t blockOffsetX, blockOffsetY;
+		CloudReprojector::getBlockOffset(gCloudFrameIndex++, blockOffsetX, blockOffsetY);
+		gUniformData.mReprojectionParams =
+			vec4((float)blockOffsetX, (float)blockOffsetY, (float)mSettings.mWidth, (float)mSettings.mHeight);
 
 		//Spherical coordinate
 		//float yaw = pViewParams.sunYawPitch.x;
@@ -557,6 +617,9 @@ public:
 		//Vector3 lightDir = Vector3(cos(yaw) * sin(pitch), cos(pitch), sin(yaw) * sin(pitch));
 		//gUniformData.mSunDirection = -1.0f * lightDir;
 		//
+		// the light volume follows the sun a few slices per frame, CloudLightVolume::beginUpdate when it moves
+		//if (gCloudLightVolume.update(2))
+		//	gCloudLightTexture.upload(gCloudLightVolume);
 	}
 
 	void Draw()
@@ -580,6 +643,17 @@ public:
 		if (fenceStatus == FENCE_STATUS_INCOMPLETE)
 			waitForFences(pRenderer, 1, &pRenderCompleteFence);
 
+		// Switch to the noise textures baked in the background and to the light volume once uploaded, the queue is idle
+		// before the textures they replace are released or uploaded to again
+		bool texturesSwitched = NoiseBakeQueue::update();
+		//texturesSwitched = gCloudLightTexture.update() || texturesSwitched;
+		if (texturesSwitched)
+		{
+			waitQueueIdle(pGraphicsQueue);
+			prepareDescriptorSets();
+			NoiseBakeQueue::releasePlaceholders();
+		}
+
 		if (pRenderer->pActiveGpuSettings->mGpuBreadcrumbs)
 		{
 			// Check breadcrumb markers
@@ -0,0 +1,353 @@
+/*
+* Headless CPU render of the clouds of the sample (Utils/CloudMarcher), for the golden images and the profiling of the
+* ray march on the machines without a GPU. Links the same sources as NoiseBakerTool plus NoiseSampler, CloudMarcher,
+* CloudOccupancyGrid, CloudLightVolume, CloudReprojector and NoiseBrickVolume.
+*
+* usage: CloudReferenceRender [--out <file.png>] [--size <width>x<height>] [--threads <count>] [--frames <count>]
+*                             [--grid <width>x<height>x<depth>] [--light <width>x<height>x<depth>]
+*
+* The textures are baked like the ImageLoader ones (cloud shape 256x256x64 RGBA8, weather 512x512 R8, both with mips,
+* blue noise 128x128 R8), then the view is rendered frames times with the fixed step march, the reference, and frames
+* times with each optimisation of the GPU pass:
+* - occupancy: the empty cells of the occupancy grid (64x32x64 cells by default) skipped
+* - light volume: the light march replaced by a lookup in the light volume (32x16x32 cells by default)
+* - sparse shape: the base and extrusion of the shape read from 8^3 bricks, the ones the coverage empties dropped, and
+*   every texture read at level 0 like the SPARSE_CLOUD_SHAPE path. It is also compared to the dense shape read at level 0,
+*   which it must match: a brick dropped while it holds density shows there
+* - adaptive step: the default CloudStepPolicy, coarse steps through empty space and fine steps stretched with the
+*   distance and the opacity
+* - temporal: the CloudReprojector, one pixel of each 4x4 block marched per frame and the others reprojected, over a
+*   camera pan of 32 frames that ends on the view
+* The reference is written to the output as an 8 bit RGBA PNG, each variant next to it with its name appended
+* (clouds_occupancy.png, ...).
+* Prints the best time per frame, the steps and density fetches per pixel of each, and the difference of the variant
+* images to the reference: the figures the GPU optimisations are compared against. The images don't depend on the
+* thread count.
+*/
+
+#include "../Utils/TaskScheduler.h"
+#include "../Utils/NoiseBaker.h"
+#include "../Utils/NoiseSinks.h"
+#include "../Utils/NoiseMipChain.h"
+#include "../Utils/NoiseSampler.h"
+#include "../Utils/CloudMarcher.h"
+#include "../Utils/CloudOccupancyGrid.h"
+#include "../Utils/CloudLightVolume.h"
+#include "../Utils/CloudReprojector.h"
+#include "../Utils/NoiseBrickVolume.h"
+
+#include "../../../../../Common_3/Utilities/Interfaces/ILog.h"
+#include "../../../../../Common_3/Utilities/Interfaces/IMemory.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+static const int kRandomSeed = 42;
+static const float kWeatherScale = 0.1f;
+// camera pan of the temporal variant, along x, in world units per frame
+static const uint32_t kPanFrameCount = 32;
+static const float kPanSpeed = 0.5f;
+
+static double now()
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/// The view, moved by panOffset along x
+static CloudMarchCamera getCamera(float panOffset)
+{
+	// below the layer, looking up at it across the box
+	CloudMarchCamera camera = { vec3(panOffset, -140.0f, -420.0f), vec3(panOffset, 0.0f, 0.0f), PI / 2.0f };
+	return camera;
+}
+
+/// Render the view frameCount times into image, bestSeconds gets the fastest frame
+static CloudMarchStats renderFrames(const CloudMarcher& marcher, uint32_t width, uint32_t height, uint32_t frameCount,
+	FloatBufferSink& image, double& bestSeconds)
+{
+	CloudMarchCamera camera = getCamera(0.0f);
+	CloudMarchStats stats;
+	for (uint32_t frame = 0; frame < frameCount; ++frame)
+	{
+		double begin = now();
+		stats = marcher.render(camera, width, height, image);
+		double elapsed = now() - begin;
+		if (frame == 0 || elapsed < bestSeconds)
+			bestSeconds = elapsed;
+	}
+	return stats;
+}
+
+/// Pan toward the view with the reprojector, image gets the last frame, the view. reprojectedRatio gets the pixels of the
+/// last frame read from the history, rejectedRatio the ones upsampled after a disocclusion
+static CloudMarchStats renderPan(const CloudMarcher& marcher, uint32_t width, uint32_t height, FloatBufferSink& image,
+	double& bestSeconds, double& reprojectedRatio, double& rejectedRatio)
+{
+	CloudReprojector reprojector(width, height);
+	CloudMarchStats stats;
+	for (uint32_t frame = 0; frame < kPanFrameCount; ++frame)
+	{
+		double begin = now();
+		stats = reprojector.render(marcher, getCamera(float(int(frame) - int(kPanFrameCount - 1)) * kPanSpeed), image);
+		double elapsed = now() - begin;
+		if (frame == 0 || elapsed < bestSeconds)
+			bestSeconds = elapsed;
+	}
+	double pixelCount = double(width) * double(height);
+	reprojectedRatio = double(reprojector.getReprojectedCount()) / pixelCount;
+	rejectedRatio = double(reprojector.getRejectedCount()) / pixelCount;
+	return stats;
+}
+
+static void printStats(const char* pName, const CloudMarchStats& stats, double seconds)
+{
+	printf("%s: %.3f ms per frame, %.2f ray steps, %.2f light steps, %.2f density fetches per pixel\n", pName, seconds * 1e3,
+		stats.getRayStepsPerPixel(), stats.getLightStepsPerPixel(), stats.getDensityFetchesPerPixel());
+}
+
+/// Fetches saved and largest / RMS difference of a variant to the reference, in 8 bit steps
+static void printComparison(const CloudMarchStats& reference, const FloatBufferSink& referenceImage, const CloudMarchStats& stats,
+	const FloatBufferSink& image)
+{
+	const std::vector<float>& referenceTexels = referenceImage.getData();
+	const std::vector<float>& texels = image.getData();
+	double maxError = 0.0;
+	double squaredErrors = 0.0;
+	for (size_t i = 0; i < referenceTexels.size(); ++i)
+	{
+		double error = std::fabs(double(referenceTexels[i]) - double(texels[i]));
+		maxError = std::max(maxError, error);
+		squaredErrors += error * error;
+	}
+	double rmsError = referenceTexels.empty() ? 0.0 : std::sqrt(squaredErrors / double(referenceTexels.size()));
+	double fetchReduction = reference.densityFetches > 0 ?
+		100.0 * (1.0 - double(stats.densityFetches) / double(reference.densityFetches)) : 0.0;
+	printf("    %.1f%% fewer density fetches, largest difference %.2f, rms %.3f (8 bit)\n", fetchReduction, maxError * 255.0,
+		rmsError * 255.0);
+}
+
+/// The RGBA image as an 8 bit PNG
+static bool exportImage(const char* pPath, const FloatBufferSink& image, uint32_t width, uint32_t height)
+{
+	const std::vector<float>& texels = image.getData();
+	ImageExportSink sink(pPath, NoiseExportFormat::Png, width, height, 1, 4);
+	std::vector<float> planes[4];
+	for (std::vector<float>& plane : planes)
+		plane.resize(width);
+	const float* channels[4] = { planes[0].data(), planes[1].data(), planes[2].data(), planes[3].data() };
+	for (uint32_t y = 0; y < height; ++y)
+	{
+		for (uint32_t x = 0; x < width; ++x)
+			for (uint32_t c = 0; c < 4; ++c)
+				planes[c][x] = texels[(size_t(y) * width + x) * 4 + c];
+		sink.writeChannels(y, 0, 0, width, channels, 4);
+	}
+	bool written = sink.isComplete();
+	if (!written)
+		fprintf(stderr, "can't write '%s'\n", pPath);
+	return written;
+}
+
+/// clouds.png + "occupancy" -> clouds_occupancy.png
+static std::string getVariantPath(const char* pOutput, const char* pSuffix)
+{
+	std::string path = pOutput;
+	size_t extension = path.find_last_of('.');
+	size_t separator = path.find_last_of("/\\");
+	if (extension == std::string::npos || (separator != std::string::npos && extension < separator))
+		extension = path.size();
+	return path.substr(0, extension) + "_" + pSuffix + path.substr(extension);
+}
+
+int main(int argc, char** argv)
+{
+	const char* pUsage = "usage: CloudReferenceRender [--out <file.png>] [--size <width>x<height>] [--threads <count>] [--frames <count>]\n"
+		"                            [--grid <width>x<height>x<depth>] [--light <width>x<height>x<depth>]\n";
+	const char* pOutput = "clouds.png";
+	uint32_t width = 640;
+	uint32_t height = 360;
+	uint32_t threadCount = 0;
+	uint32_t frameCount = 1;
+	uint32_t gridSize[3] = { 64, 32, 64 };
+	uint32_t lightSize[3] = { 32, 16, 32 };
+	bool validArguments = argc % 2 == 1;
+	for (int i = 1; i + 1 < argc; i += 2)
+	{
+		if (!strcmp(argv[i], "--out"))
+			pOutput = argv[i + 1];
+		else if (!strcmp(argv[i], "--size"))
+			validArguments = validArguments && sscanf(argv[i + 1], "%ux%u", &width, &height) == 2 && width > 0 && height > 0;
+		else if (!strcmp(argv[i], "--threads"))
+			threadCount = uint32_t(atoi(argv[i + 1]));
+		else if (!strcmp(argv[i], "--frames") && atoi(argv[i + 1]) > 0)
+			frameCount = uint32_t(atoi(argv[i + 1]));
+		else if (!strcmp(argv[i], "--grid"))
+			validArguments = validArguments && sscanf(argv[i + 1], "%ux%ux%u", &gridSize[0], &gridSize[1], &gridSize[2]) == 3;
+		else if (!strcmp(argv[i], "--light"))
+			validArguments = validArguments && sscanf(argv[i + 1], "%ux%ux%u", &lightSize[0], &lightSize[1], &lightSize[2]) == 3;
+		else
+			validArguments = false;
+	}
+	// the grid cells must be powers of 2
+	for (uint32_t size : gridSize)
+		validArguments = validArguments && size > 0 && (size & (size - 1)) == 0;
+	for (uint32_t size : lightSize)
+		validArguments = validArguments && size > 0;
+	if (!validArguments)
+	{
+		fprintf(stderr, "%s", pUsage);
+		return 1;
+	}
+
+	initMemAlloc("CloudReferenceRender");
+	initLog("CloudReferenceRender", LogLevel::eINFO);
+	TaskScheduler::init(threadCount);
+
+	double start = now();
+	NoiseMipChain cloudShape(NoiseChannelLayout::RGBA8, 256, 256, 64);
+	PackedRowSink cloudShapeSink = cloudShape.getSink();
+	NoiseBaker::bakeCloudShape(256, 256, 64, kRandomSeed, cloudShapeSink);
+	cloudShape.build();
+	NoiseMipChain weather(NoiseChannelLayout::R8, 512, 512, 1);
+	PackedRowSink weatherSink = weather.getSink();
+	NoiseBaker::bakeWeather(512, 512, kWeatherScale, kRandomSeed, weatherSink);
+	weather.build();
+	NoiseMipChain blueNoise(NoiseChannelLayout::R8, 128, 128, 1, 1);
+	PackedRowSink blueNoiseSink = blueNoise.getSink();
+	NoiseBaker::bakeBlueNoise(128, 128, blueNoiseSink);
+	printf("textures baked in %.3f ms\n", (now() - start) * 1e3);
+
+	NoiseSampler cloudShapeSampler(cloudShape);
+	NoiseSampler weatherSampler(weather);
+	NoiseSampler blueNoiseSampler(blueNoise);
+	CloudMarchTextures textures = { &cloudShapeSampler, &weatherSampler, &blueNoiseSampler };
+	CloudMarchParams params;
+	params.sunDir = normalize(vec3(0.4f, -1.0f, 0.3f));
+	CloudMarcher marcher(params, textures);
+
+	start = now();
+	CloudOccupancyGrid occupancy(gridSize[0], gridSize[1], gridSize[2]);
+	occupancy.build(cloudShape, weather, params);
+	printf("occupancy grid %ux%ux%u (%u levels) built in %.3f ms, %.1f%% of the cells empty\n", gridSize[0], gridSize[1],
+		gridSize[2], occupancy.getLevelCount(), (now() - start) * 1e3, 100.0 * occupancy.getEmptyRatio());
+	CloudMarchTextures occupancyTextures = textures;
+	occupancyTextures.pOccupancy = &occupancy;
+	CloudMarcher occupancyMarcher(params, occupancyTextures);
+
+	start = now();
+	CloudLightVolume lightVolume(lightSize[0], lightSize[1], lightSize[2]);
+	lightVolume.build(marcher);
+	printf("light volume %ux%ux%u built in %.3f ms, %llu density fetches\n", lightSize[0], lightSize[1], lightSize[2],
+		(now() - start) * 1e3, (unsigned long long)lightVolume.getDensityFetches());
+	CloudMarchTextures lightTextures = textures;
+	lightTextures.pLightVolume = &lightVolume;
+	CloudMarcher lightMarcher(params, lightTextures);
+
+	// split like ImageLoader::genCloudShapeBricks, from level 0 of the shape and of the weather
+	start = now();
+	uint32_t shapeWidth = cloudShape.getWidth(0), shapeHeight = cloudShape.getHeight(0), shapeDepth = cloudShape.getDepth(0);
+	size_t shapeTexelCount = size_t(shapeWidth) * shapeHeight * shapeDepth;
+	std::vector<uint8_t> shapeBase(shapeTexelCount * 2);
+	for (size_t i = 0; i < shapeTexelCount; ++i)
+	{
+		shapeBase[i * 2 + 0] = cloudShape.getData(0)[i * 4 + 0];
+		shapeBase[i * 2 + 1] = cloudShape.getData(0)[i * 4 + 1];
+	}
+	NoiseBrickVolume shapeBricks(NoiseChannelLayout::RG8, shapeWidth, shapeHeight, shapeDepth);
+	shapeBricks.buildCloudShape(shapeBase.data(), size_t(shapeWidth) * 2, size_t(shapeWidth) * 2 * shapeHeight, weather.getData(0),
+		weather.getWidth(0), weather.getHeight(0));
+	printf("shape bricks built in %.3f ms, %u / %u kept\n", (now() - start) * 1e3, shapeBricks.getBrickCount(),
+		shapeBricks.getGridWidth() * shapeBricks.getGridHeight() * shapeBricks.getGridDepth());
+	CloudMarchTextures sparseTextures = textures;
+	sparseTextures.pShapeBricks = &shapeBricks;
+	CloudMarcher sparseMarcher(params, sparseTextures);
+
+	// the dense shape and weather without their mips, what the sparse shape must reproduce
+	NoiseMipChain cloudShapeLevel0(NoiseChannelLayout::RGBA8, shapeWidth, shapeHeight, shapeDepth, 1);
+	memcpy(cloudShapeLevel0.getData(0), cloudShape.getData(0), cloudShape.getSliceStride(0) * shapeDepth);
+	NoiseMipChain weatherLevel0(NoiseChannelLayout::R8, weather.getWidth(0), weather.getHeight(0), 1, 1);
+	memcpy(weatherLevel0.getData(0), weather.getData(0), weather.getSliceStride(0));
+	NoiseSampler cloudShapeLevel0Sampler(cloudShapeLevel0);
+	NoiseSampler weatherLevel0Sampler(weatherLevel0);
+	CloudMarchTextures level0Textures = { &cloudShapeLevel0Sampler, &weatherLevel0Sampler, &blueNoiseSampler };
+	CloudMarcher level0Marcher(params, level0Textures);
+
+	CloudMarchParams adaptiveParams = params;
+	adaptiveParams.stepPolicy.enabled = true;
+	CloudMarcher adaptiveMarcher(adaptiveParams, textures);
+
+	struct Variant
+	{
+		const char* pName;
+		const CloudMarcher* pMarcher;
+	};
+	const Variant variants[] = {
+		{ "occupancy", &occupancyMarcher },
+		{ "light volume", &lightMarcher },
+		{ "sparse shape", &sparseMarcher },
+		{ "adaptive step", &adaptiveMarcher },
+	};
+	const uint32_t variantCount = sizeof(variants) / sizeof(variants[0]);
+
+	double referenceSeconds = 0.0;
+	FloatBufferSink referenceImage(width, height, 1, 4);
+	CloudMarchStats referenceStats = renderFrames(marcher, width, height, frameCount, referenceImage, referenceSeconds);
+	std::vector<FloatBufferSink> images(variantCount, FloatBufferSink(width, height, 1, 4));
+	CloudMarchStats stats[variantCount];
+	double seconds[variantCount];
+	for (uint32_t i = 0; i < variantCount; ++i)
+		stats[i] = renderFrames(*variants[i].pMarcher, width, height, frameCount, images[i], seconds[i]);
+	double level0Seconds = 0.0;
+	FloatBufferSink level0Image(width, height, 1, 4);
+	CloudMarchStats level0Stats = renderFrames(level0Marcher, width, height, 1, level0Image, level0Seconds);
+	double temporalSeconds = 0.0, reprojectedRatio = 0.0, rejectedRatio = 0.0;
+	FloatBufferSink temporalImage(width, height, 1, 4);
+	CloudMarchStats temporalStats = renderPan(marcher, width, height, temporalImage, temporalSeconds, reprojectedRatio,
+		rejectedRatio);
+	threadCount = TaskScheduler::getThreadCount();
+	TaskScheduler::exit();
+
+	printf("%ux%u, best of %u frames, %u threads, %.1f%% of the pixels cross the box\n", width, height, frameCount, threadCount,
+		referenceStats.pixelCount > 0 ? 100.0 * double(referenceStats.hitCount) / double(referenceStats.pixelCount) : 0.0);
+	printStats("fixed step", referenceStats, referenceSeconds);
+	// a skipped sample lands on a slightly different distance than the accumulated steps, the occupancy image differs by
+	// rounding only. The light volume integrates the light at lod 1 with much finer steps than the 8 samples per box length
+	// of the light march, most of its difference is the error of the reference: against a light march of 128 samples it is
+	// 10 times smaller than the one of the reference. The adaptive step samples other points than the fixed one, at 64
+	// samples per box length the detail is undersampled and both differ from the converged march by a few 8 bit steps
+	for (uint32_t i = 0; i < variantCount; ++i)
+	{
+		printStats(variants[i].pName, stats[i], seconds[i]);
+		printComparison(referenceStats, referenceImage, stats[i], images[i]);
+		if (variants[i].pMarcher == &sparseMarcher)
+		{
+			printf("    against the dense shape at level 0:\n");
+			printComparison(level0Stats, level0Image, stats[i], images[i]);
+		}
+	}
+	// the undersampled detail makes the march view dependent: the reference itself changes by a few 8 bit steps when the
+	// camera moves by a fraction of the pan, the history of the temporal variant holds the frames marched along it
+	printStats("temporal", temporalStats, temporalSeconds);
+	printf("    %u frames panning %.2f per frame, last frame %.1f%% reprojected, %.1f%% rejected\n", kPanFrameCount, kPanSpeed,
+		100.0 * reprojectedRatio, 100.0 * rejectedRatio);
+	printComparison(referenceStats, referenceImage, temporalStats, temporalImage);
+
+	bool written = exportImage(pOutput, referenceImage, width, height);
+	for (uint32_t i = 0; i < variantCount; ++i)
+	{
+		std::string suffix = variants[i].pName;
+		std::replace(suffix.begin(), suffix.end(), ' ', '_');
+		written = exportImage(getVariantPath(pOutput, suffix.c_str()).c_str(), images[i], width, height) && written;
+	}
+	written = exportImage(getVariantPath(pOutput, "temporal").c_str(), temporalImage, width, height) && written;
+
+	exitLog();
+	exitMemAlloc();
+	return written ? 0 : 1;
+}
@@ -0,0 +1,449 @@
+/*
+* Headless baker of the noise textures, for the asset pipeline and the CPU-only build machines.
+* Links Noise/, the CPU side of the texture baking (Utils/TaskScheduler, NoiseBaker, NoiseGraph, NoiseSinks, NoiseMipChain,
+* NoiseBlockCompressor, NoiseSlabWriter) and the The-Forge OS utilities only, no renderer.
+*
+* usage: NoiseBakerTool <spec> [--out <directory>] [--format nbk|raw|pnm|png] [--threads <count>] [--budget <MB>]
+*
+* The spec lists one asset per line: "<name> <kind> <width>x<height>[x<depth>] [key=value...]" (see clouds.bakespec).
+* Every asset is baked in parallel, each bake also spreading over the TaskScheduler workers, and written to
+* <directory>/<name>.<format>. The output doesn't depend on the thread count.
+*   nbk: NoiseBakedHeader followed by every level, from the largest, tightly packed (rows of blocks for BC4 / BC5)
+*   raw: the levels of the nbk file without its header
+*   pnm: 8 bit binary PGM (PPM for the cloud shape) of level 0, volumes as their slices stacked vertically
+*   png: 8 bit PNG of level 0, one file per slice of a volume (<name>_000.png...) compressed in parallel
+* With --budget, the nbk / raw volumes without mips are written slab by slab by NoiseSlabWriter, each asset keeping
+* about <MB> resident instead of the whole volume. Same files as without it.
+*/
+
+#include "../Utils/TaskScheduler.h"
+#include "../Utils/NoiseBaker.h"
+#include "../Utils/NoiseGraph.h"
+#include "../Utils/NoiseSinks.h"
+#include "../Utils/NoiseMipChain.h"
+#include "../Utils/NoiseBlockCompressor.h"
+#include "../Utils/NoiseSlabWriter.h"
+
+#include "../../../../../Common_3/Utilities/Interfaces/ILog.h"
+#include "../../../../../Common_3/Utilities/Interfaces/IMemory.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// the layout is stored as its NoiseChannelLayout value, bump the version when the enum or the level packing changes
+struct NoiseBakedHeader
+{
+	char magic[4];
+	uint32_t version;
+	uint32_t layout;
+	uint32_t width;
+	uint32_t height;
+	uint32_t depth;
+	uint32_t levelCount;
+};
+
+static const uint32_t kBakedVersion = 1;
+
+enum class AssetKind
+{
+	BlueNoise,
+	PerlinFBM,
+	WorleyFBM,
+	Weather,
+	CloudShape,
+	Noise3D,
+};
+
+enum class OutputFormat
+{
+	Nbk,
+	Raw,
+	Pnm,
+	Png,
+};
+
+struct AssetSpec
+{
+	std::string name;
+	AssetKind kind;
+	uint32_t width;
+	uint32_t height;
+	uint32_t depth;
+	int randomSeed;
+	float scale;
+	NoiseChannelLayout layout;
+	bool generateMips;
+};
+
+struct AssetResult
+{
+	bool written;
+	double seconds;
+	size_t bytes;
+	NoiseCompressionStats stats;
+};
+
+static double now()
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/* --------------------------------- Spec --------------------------------- */
+
+// the worley cells of a bake need at least one texel per subdivision, minSize is the finest subdivision
+static const struct { const char* pName; AssetKind kind; bool volume; uint32_t minSize; } kKinds[] = {
+	{ "blueNoise", AssetKind::BlueNoise, false, 1 },
+	{ "perlinFBM", AssetKind::PerlinFBM, false, 1 },
+	{ "worleyFBM", AssetKind::WorleyFBM, false, 12 },
+	{ "weather", AssetKind::Weather, false, 1 },
+	{ "cloudShape", AssetKind::CloudShape, true, 64 },
+	{ "3DNoise", AssetKind::Noise3D, true, 12 },
+};
+
+static const struct { const char* pName; NoiseChannelLayout layout; } kLayouts[] = {
+	{ "R8", NoiseChannelLayout::R8 },
+	{ "R16_UNORM", NoiseChannelLayout::R16_UNORM },
+	{ "R16F", NoiseChannelLayout::R16F },
+	{ "RG8", NoiseChannelLayout::RG8 },
+	{ "RGBA8", NoiseChannelLayout::RGBA8 },
+	{ "BC4", NoiseChannelLayout::BC4 },
+	{ "BC5", NoiseChannelLayout::BC5 },
+};
+
+
+/// Parse one non empty spec line, the error is reported with the line number
+static bool parseAsset(const std::string& line, const char* pSpecPath, uint32_t lineNumber, AssetSpec& asset)
+{
+	std::istringstream tokens(line);
+	std::string kind, size;
+	if (!(tokens >> asset.name >> kind >> size))
+	{
+		fprintf(stderr, "%s:%u: expected <name> <kind> <size>\n", pSpecPath, lineNumber);
+		return false;
+	}
+
+	bool found = false;
+	bool volume = false;
+	uint32_t minSize = 1;
+	for (const auto& entry : kKinds)
+	{
+		if (kind == entry.pName)
+		{
+			asset.kind = entry.kind;
+			volume = entry.volume;
+			minSize = entry.minSize;
+			found = true;
+		}
+	}
+	if (!found)
+	{
+		fprintf(stderr, "%s:%u: unknown kind '%s'\n", pSpecPath, lineNumber, kind.c_str());
+		return false;
+	}
+
+	asset.depth = 1;
+	int sizeCount = sscanf(size.c_str(), "%ux%ux%u", &asset.width, &asset.height, &asset.depth);
+	if (sizeCount != (volume ? 3 : 2))
+	{
+		fprintf(stderr, "%s:%u: size '%s' should be %s\n", pSpecPath, lineNumber, size.c_str(),
+			volume ? "<width>x<height>x<depth>" : "<width>x<height>");
+		return false;
+	}
+	if (asset.width < minSize || asset.height < minSize || (volume && asset.depth < minSize))
+	{
+		fprintf(stderr, "%s:%u: %s needs at least %u texels per dimension\n", pSpecPath, lineNumber, kind.c_str(), minSize);
+		return false;
+	}
+
+	asset.randomSeed = 42;
+	asset.scale = 0.1f;
+	asset.layout = asset.kind == AssetKind::CloudShape ? NoiseChannelLayout::RGBA8 : NoiseChannelLayout::R8;
+	asset.generateMips = false;
+
+	std::string option;
+	while (tokens >> option)
+	{
+		size_t separator = option.find('=');
+		std::string key = option.substr(0, separator);
+		std::string value = separator == std::string::npos ? std::string() : option.substr(separator + 1);
+		if (key == "seed" && !value.empty())
+		{
+			asset.randomSeed = atoi(value.c_str());
+		}
+		else if (key == "scale" && !value.empty())
+		{
+			asset.scale = float(atof(value.c_str()));
+		}
+		else if (key == "mips" && !value.empty())
+		{
+			asset.generateMips = atoi(value.c_str()) != 0;
+		}
+		else if (key == "layout")
+		{
+			found = false;
+			for (const auto& entry : kLayouts)
+			{
+				if (value == entry.pName)
+				{
+					asset.layout = entry.layout;
+					found = true;
+				}
+			}
+			if (!found)
+			{
+				fprintf(stderr, "%s:%u: unknown layout '%s'\n", pSpecPath, lineNumber, value.c_str());
+				return false;
+			}
+		}
+		else
+		{
+			fprintf(stderr, "%s:%u: unknown option '%s'\n", pSpecPath, lineNumber, option.c_str());
+			return false;
+		}
+	}
+	return true;
+}
+
+/// Every asset of the spec, '#' starts a comment. False on the first invalid line
+static bool loadSpec(const char* pSpecPath, std::vector<AssetSpec>& assets)
+{
+	FILE* pFile = fopen(pSpecPath, "r");
+	if (!pFile)
+	{
+		fprintf(stderr, "can't open the spec '%s'\n", pSpecPath);
+		return false;
+	}
+
+	bool valid = true;
+	char buffer[1024];
+	uint32_t lineNumber = 0;
+	while (valid && fgets(buffer, sizeof(buffer), pFile))
+	{
+		lineNumber++;
+		std::string line = buffer;
+		line = line.substr(0, line.find('#'));
+		if (line.find_first_not_of(" \t\r\n") == std::string::npos)
+			continue;
+
+		AssetSpec asset;
+		valid = parseAsset(line, pSpecPath, lineNumber, asset);
+		for (const AssetSpec& other : assets)
+		{
+			if (valid && other.name == asset.name)
+			{
+				fprintf(stderr, "%s:%u: asset '%s' already declared\n", pSpecPath, lineNumber, asset.name.c_str());
+				valid = false;
+			}
+		}
+		if (valid)
+			assets.push_back(asset);
+	}
+
+	fclose(pFile);
+	return valid;
+}
+
+/* --------------------------------- Baking --------------------------------- */
+
+/// Same compositions as the ImageLoader textures
+static void bakeAsset(const AssetSpec& asset, NoiseSink& sink)
+{
+	switch (asset.kind)
+	{
+	case AssetKind::BlueNoise:
+		NoiseBaker::bakeBlueNoise(asset.width, asset.height, sink);
+		break;
+	case AssetKind::PerlinFBM:
+		NoiseBaker::bakePerlinFBM(asset.width, asset.height, sink);
+		break;
+	case AssetKind::WorleyFBM:
+		NoiseBaker::bakeWorleyFBM(asset.width, asset.height, sink);
+		break;
+	case AssetKind::Weather:
+		NoiseBaker::bakeWeather(asset.width, asset.height, asset.scale, asset.randomSeed, sink);
+		break;
+	case AssetKind::CloudShape:
+		NoiseBaker::bakeCloudShape(asset.width, asset.height, asset.depth, asset.randomSeed, sink);
+		break;
+	case AssetKind::Noise3D:
+		NoiseBaker::bake3DNoise(asset.width, asset.height, asset.depth, asset.randomSeed, sink);
+		break;
+	}
+}
+
+/// Bake level 0, filter the mip chain and write every level, block compressed layouts encoded
+static AssetResult writeLevels(const AssetSpec& asset, OutputFormat format, const std::string& path)
+{
+	AssetResult result = {};
+	FILE* pFile = fopen(path.c_str(), "wb");
+	if (!pFile)
+		return result;
+
+	NoiseChannelLayout sourceLayout = NoiseBlockCompressor::getSourceLayout(asset.layout);
+	NoiseMipChain mipChain(sourceLayout, asset.width, asset.height, asset.depth, asset.generateMips ? 0 : 1);
+	PackedRowSink sink = mipChain.getSink();
+	bakeAsset(asset, sink);
+	mipChain.build();
+
+	result.written = true;
+	if (format == OutputFormat::Nbk)
+	{
+		NoiseBakedHeader header = { { 'N', 'B', 'K', '1' }, kBakedVersion, uint32_t(asset.layout), asset.width, asset.height,
+			asset.depth, mipChain.getLevelCount() };
+		result.written = fwrite(&header, sizeof(header), 1, pFile) == 1;
+		result.bytes += sizeof(header);
+	}
+
+	std::vector<uint8_t> blocks;
+	for (uint32_t level = 0; level < mipChain.getLevelCount() && result.written; ++level)
+	{
+		const uint8_t* pData = mipChain.getData(level);
+		size_t size = mipChain.getSliceStride(level) * mipChain.getDepth(level);
+		if (NoiseBlockCompressor::isBlockCompressed(asset.layout))
+		{
+			size_t rowStride = size_t(NoiseBlockCompressor::getBlockCount(mipChain.getWidth(level))) *
+				NoiseBlockCompressor::getBlockBytes(asset.layout);
+			size_t sliceStride = rowStride * NoiseBlockCompressor::getBlockCount(mipChain.getHeight(level));
+			size = sliceStride * mipChain.getDepth(level);
+			blocks.resize(size);
+			result.stats.merge(NoiseBlockCompressor::encode(asset.layout, pData, mipChain.getRowStride(level), mipChain.getSliceStride(level),
+				mipChain.getWidth(level), mipChain.getHeight(level), mipChain.getDepth(level), blocks.data(), rowStride, sliceStride));
+			pData = blocks.data();
+		}
+		result.written = fwrite(pData, 1, size, pFile) == size;
+		result.bytes += size;
+	}
+
+	result.written = fclose(pFile) == 0 && result.written;
+	return result;
+}
+
+/// Level 0 of a volume written out of core, the levels of writeLevels otherwise
+static AssetResult writeSlabs(const AssetSpec& asset, OutputFormat format, size_t memoryBudget, const std::string& path)
+{
+	NoiseGraph graph(asset.width, asset.height, asset.depth);
+	if (asset.kind == AssetKind::CloudShape)
+		NoiseBaker::buildCloudShape(graph, asset.randomSeed);
+	else
+		NoiseBaker::build3DNoise(graph, asset.randomSeed);
+
+	NoiseBakedHeader header = { { 'N', 'B', 'K', '1' }, kBakedVersion, uint32_t(asset.layout), asset.width, asset.height,
+		asset.depth, 1 };
+	size_t headerSize = format == OutputFormat::Nbk ? sizeof(header) : 0;
+	AssetResult result = {};
+	result.written = NoiseSlabWriter::write(graph, asset.layout, memoryBudget, path.c_str(), &header, headerSize, &result.stats);
+	result.bytes = headerSize + NoiseSlabWriter::getSliceSize(asset.width, asset.height, asset.layout) * asset.depth;
+	return result;
+}
+
+static AssetResult writeAsset(const AssetSpec& asset, OutputFormat format, size_t memoryBudget, const std::string& directory)
+{
+	static const char* extensions[] = { ".nbk", ".raw", "", ".png" };
+	std::string path = directory + "/" + asset.name + extensions[uint32_t(format)];
+
+	double start = now();
+	AssetResult result = {};
+	uint32_t channelCount = asset.kind == AssetKind::CloudShape ? 3 : 1;
+	if (format == OutputFormat::Pnm)
+	{
+		path += channelCount == 1 ? ".pgm" : ".ppm";
+		FileStreamSink sink(path.c_str(), asset.width, asset.height, asset.depth, channelCount);
+		if (sink.isOpen())
+			bakeAsset(asset, sink);
+		result.written = sink.isComplete();
+		result.bytes = size_t(asset.width) * asset.height * asset.depth * channelCount;
+	}
+	else if (format == OutputFormat::Png)
+	{
+		ImageExportSink sink(path.c_str(), NoiseExportFormat::Png, asset.width, asset.height, asset.depth, channelCount);
+		bakeAsset(asset, sink);
+		result.written = sink.isComplete();
+		// uncompressed size, the PNG files are smaller
+		result.bytes = size_t(asset.width) * asset.height * asset.depth * channelCount;
+	}
+	else if (memoryBudget > 0 && asset.depth > 1 && !asset.generateMips)
+	{
+		result = writeSlabs(asset, format, memoryBudget, path);
+	}
+	else
+	{
+		result = writeLevels(asset, format, path);
+	}
+	result.seconds = now() - start;
+
+	if (!result.written)
+		fprintf(stderr, "can't write '%s'\n", path.c_str());
+	return result;
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 2)
+	{
+		fprintf(stderr, "usage: NoiseBakerTool <spec> [--out <directory>] [--format nbk|raw|pnm|png] [--threads <count>] [--budget <MB>]\n");
+		return 1;
+	}
+
+	initMemAlloc("NoiseBakerTool");
+	initLog("NoiseBakerTool", LogLevel::eINFO);
+
+	const char* pSpecPath = argv[1];
+	std::string directory = ".";
+	OutputFormat format = OutputFormat::Nbk;
+	uint32_t threadCount = 0;
+	size_t memoryBudget = 0;
+	bool validArguments = true;
+	for (int i = 2; i + 1 < argc; i += 2)
+	{
+		if (!strcmp(argv[i], "--out"))
+			directory = argv[i + 1];
+		else if (!strcmp(argv[i], "--threads"))
+			threadCount = uint32_t(atoi(argv[i + 1]));
+		else if (!strcmp(argv[i], "--budget") && atoi(argv[i + 1]) > 0)
+			memoryBudget = size_t(atoi(argv[i + 1])) << 20;
+		else if (!strcmp(argv[i], "--format") && !strcmp(argv[i + 1], "nbk"))
+			format = OutputFormat::Nbk;
+		else if (!strcmp(argv[i], "--format") && !strcmp(argv[i + 1], "raw"))
+			format = OutputFormat::Raw;
+		else if (!strcmp(argv[i], "--format") && !strcmp(argv[i + 1], "pnm"))
+			format = OutputFormat::Pnm;
+		else if (!strcmp(argv[i], "--format") && !strcmp(argv[i + 1], "png"))
+			format = OutputFormat::Png;
+		else
+			validArguments = false;
+	}
+	if (!validArguments || argc % 2 != 0)
+		fprintf(stderr, "usage: NoiseBakerTool <spec> [--out <directory>] [--format nbk|raw|pnm|png] [--threads <count>] [--budget <MB>]\n");
+
+	std::vector<AssetSpec> assets;
+	bool succeeded = validArguments && argc % 2 == 0 && loadSpec(pSpecPath, assets);
+	if (succeeded)
+	{
+		TaskScheduler::init(threadCount);
+		double start = now();
+		std::vector<AssetResult> results(assets.size());
+		TaskScheduler::parallelFor(uint32_t(assets.size()), [&](uint32_t i) { results[i] = writeAsset(assets[i], format, memoryBudget, directory); });
+		double seconds = now() - start;
+		TaskScheduler::exit();
+
+		for (size_t i = 0; i < assets.size(); ++i)
+		{
+			const AssetResult& result = results[i];
+			succeeded = succeeded && result.written;
+			printf("%-24s %10zu bytes %10.3f ms", assets[i].name.c_str(), result.bytes, result.seconds * 1e3);
+			if (result.stats.sampleCount > 0)
+				printf("  rmse %.3f, psnr %.2f dB, max error %u", result.stats.getRmse(), result.stats.getPsnr(), result.stats.maxError);
+			printf("\n");
+		}
+		printf("%zu assets baked in %.3f ms\n", assets.size(), seconds * 1e3);
+	}
+
+	exitLog();
+	exitMemAlloc();
+	return succeeded ? 0 : 1;
+}
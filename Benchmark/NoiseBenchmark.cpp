@@ -0,0 +1,621 @@
+/*
+* Standalone micro-benchmark of the noise generators and of the NoiseBaker compositions.
+* Links Noise/, Utils/TaskScheduler, Utils/NoiseBaker, the CPU cloud march (Utils/NoiseSampler, CloudMarcher,
+* CloudOccupancyGrid, CloudLightVolume) and the The-Forge OS utilities only, no renderer.
+*
+* usage: NoiseBenchmark [--filter <substring>] [--threads 1,2,4] [--min-time <seconds>] [--out <file.json>]
+*        NoiseBenchmark --check
+*
+* Every case is run for every thread count, repeated until min-time is spent, and the fastest repetition is kept.
+* The results are written as JSON (stdout by default) so two runs can be diffed.
+* --check runs no benchmark: it compares the region bakes of the generators with their full bakes instead and
+* exits with a non zero code on any mismatch.
+*/
+
+#include "../Noise/2d/WorleyNoise2D.h"
+#include "../Noise/2d/PerlinNoise2D.h"
+#include "../Noise/2d/ValueNoise2D.h"
+#include "../Noise/2d/BlueNoise2D.h"
+#include "../Noise/3d/WorleyNoise3D.h"
+#include "../Noise/3d/PerlinNoise3D.h"
+#include "../Noise/test.h"
+#include "../Utils/TaskScheduler.h"
+#include "../Utils/NoiseBaker.h"
+#include "../Utils/NoiseSinks.h"
+#include "../Utils/NoiseBlockCompressor.h"
+#include "../Utils/NoiseMipChain.h"
+#include "../Utils/NoiseSampler.h"
+#include "../Utils/CloudMarcher.h"
+#include "../Utils/CloudOccupancyGrid.h"
+#include "../Utils/CloudLightVolume.h"
+#include "../Utils/CloudReprojector.h"
+
+#include "../../../../../Common_3/Utilities/Interfaces/ILog.h"
+#include "../../../../../Common_3/Utilities/Interfaces/IMemory.h"
+#include "../../../../../Common_3/Utilities/Interfaces/IThread.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+struct BenchmarkCase
+{
+	std::string name;
+	uint32_t width;
+	uint32_t height;
+	uint32_t depth;
+	// builds the generators, not timed
+	std::function<void()> setup;
+	// produces width * height * depth samples
+	std::function<void()> run;
+	std::function<void()> teardown;
+	// optional figures of the last run, written as extra JSON fields (eg: "\"raySteps\": 12.5")
+	std::function<std::string()> counters = nullptr;
+};
+
+struct BenchmarkResult
+{
+	const BenchmarkCase* pCase;
+	uint32_t threads;
+	uint32_t iterations;
+	double bestSeconds;
+	std::string counters;
+};
+
+static double now()
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/* --------------------------------- Cases --------------------------------- */
+
+static void addGeneratorCases(std::vector<BenchmarkCase>& cases)
+{
+	static const uint32_t sizes[] = { 64, 128, 256, 512 };
+	for (uint32_t size : sizes)
+	{
+		std::string suffix = "/" + std::to_string(size);
+		IVector2 dim(size, size);
+
+		// per pixel entry points, kept to measure the gain of the row paths
+		{
+			auto generator = std::make_shared<std::unique_ptr<WorleyNoise2D>>();
+			cases.push_back({ "WorleyNoise2D.evaluate" + suffix, size, size, 1,
+				[=]() { generator->reset(new WorleyNoise2D(dim, 8)); },
+				[=]() {
+					TaskScheduler::parallelFor(size, [&](uint32_t y) {
+						std::vector<float> row(size);
+						for (uint32_t x = 0; x < size; ++x)
+							row[x] = (*generator)->evaluate(x, y);
+					});
+				},
+				[=]() { generator->reset(); } });
+			cases.push_back({ "WorleyNoise2D.evaluateSpan" + suffix, size, size, 1,
+				[=]() { generator->reset(new WorleyNoise2D(dim, 8)); },
+				[=]() {
+					TaskScheduler::parallelFor(size, [&](uint32_t y) {
+						std::vector<float> row(size);
+						(*generator)->evaluateSpan(y, 0, size, row.data());
+					});
+				},
+				[=]() { generator->reset(); } });
+		}
+		{
+			auto generator = std::make_shared<std::unique_ptr<PerlinNoise2D>>();
+			cases.push_back({ "PerlinNoise2D.evaluate" + suffix, size, size, 1,
+				[=]() { generator->reset(new PerlinNoise2D(dim, IVector2(64, 64), 5, 0.1f, 42)); },
+				[=]() {
+					TaskScheduler::parallelFor(size, [&](uint32_t y) {
+						std::vector<float> row(size);
+						for (uint32_t x = 0; x < size; ++x)
+							row[x] = (*generator)->evaluate(x, y);
+					});
+				},
+				[=]() { generator->reset(); } });
+			// 5 octaves over a 64 kernel dispatches to the specialised kernel, 4 octaves stays generic
+			for (uint32_t octaves : { 4u, 5u })
+			{
+				cases.push_back({ "PerlinNoise2D.evaluateRow.octaves" + std::to_string(octaves) + suffix, size, size, 1,
+					[=]() { generator->reset(new PerlinNoise2D(dim, IVector2(64, 64), octaves, 0.1f, 42)); },
+					[=]() {
+						TaskScheduler::parallelFor(size, [&](uint32_t y) {
+							std::vector<float> row(size);
+							(*generator)->evaluateRow(y, 0, size, row.data());
+						});
+					},
+					[=]() { generator->reset(); } });
+			}
+			cases.push_back({ "PerlinNoise2D.evaluateRow.integerHash" + suffix, size, size, 1,
+				[=]() { generator->reset(new PerlinNoise2D(dim, IVector2(64, 64), 5, 0.1f, 42, GradientHash::Integer)); },
+				[=]() {
+					TaskScheduler::parallelFor(size, [&](uint32_t y) {
+						std::vector<float> row(size);
+						(*generator)->evaluateRow(y, 0, size, row.data());
+					});
+				},
+				[=]() { generator->reset(); } });
+		}
+		{
+			auto generator = std::make_shared<std::unique_ptr<ValueNoise2D>>();
+			cases.push_back({ "ValueNoise2D.evaluate" + suffix, size, size, 1,
+				[=]() { generator->reset(new ValueNoise2D(dim, IVector2(64, 64), 5, 1.0f)); },
+				[=]() {
+					TaskScheduler::parallelFor(size, [&](uint32_t y) {
+						std::vector<float> row(size);
+						for (uint32_t x = 0; x < size; ++x)
+							row[x] = (*generator)->evaluate(x, y);
+					});
+				},
+				[=]() { generator->reset(); } });
+		}
+		{
+			auto generator = std::make_shared<std::unique_ptr<SimplexNoise2D>>();
+			cases.push_back({ "SimplexNoise2D.evaluate" + suffix, size, size, 1,
+				[=]() { generator->reset(new SimplexNoise2D(dim, 0.05f)); },
+				[=]() {
+					TaskScheduler::parallelFor(size, [&](uint32_t y) {
+						std::vector<float> row(size);
+						for (uint32_t x = 0; x < size; ++x)
+							row[x] = (*generator)->evaluate(x, y);
+					});
+				},
+				[=]() { generator->reset(); } });
+		}
+		// the whole dither array is built by the constructor
+		cases.push_back({ "BlueNoise2D.construct" + suffix, size, size, 1,
+			[]() {},
+			[=]() { BlueNoise2D generator(dim); },
+			[]() {} });
+	}
+
+	static const uint32_t volumes[][3] = { { 32, 32, 32 }, { 64, 64, 64 }, { 128, 128, 64 } };
+	for (const uint32_t* volume : volumes)
+	{
+		uint32_t width = volume[0], height = volume[1], depth = volume[2];
+		std::string suffix = "/" + std::to_string(width) + "x" + std::to_string(height) + "x" + std::to_string(depth);
+		IVector3 dim(width, height, depth);
+		{
+			auto generator = std::make_shared<std::unique_ptr<WorleyNoise3D>>();
+			cases.push_back({ "WorleyNoise3D.evaluateSpan" + suffix, width, height, depth,
+				[=]() { generator->reset(new WorleyNoise3D(dim, 8, 42)); },
+				[=]() {
+					TaskScheduler::parallelFor(depth, [&](uint32_t z) {
+						std::vector<float> row(width);
+						for (uint32_t y = 0; y < height; ++y)
+							(*generator)->evaluateSpan(y, z, 0, width, row.data());
+					});
+				},
+				[=]() { generator->reset(); } });
+			cases.push_back({ "WorleyNoise3D.evaluateBlock" + suffix, width, height, depth,
+				[=]() { generator->reset(new WorleyNoise3D(dim, 8, 42)); },
+				[=]() {
+					TaskScheduler::parallelFor(depth, [&](uint32_t z) {
+						std::vector<float> slice(width * height);
+						(*generator)->evaluateBlock(IVector3(0, 0, z), IVector3(width, height, 1), slice.data());
+					});
+				},
+				[=]() { generator->reset(); } });
+		}
+		{
+			auto generator = std::make_shared<std::unique_ptr<PerlinNoise3D>>();
+			cases.push_back({ "PerlinNoise3D.evaluateRow" + suffix, width, height, depth,
+				[=]() { generator->reset(new PerlinNoise3D(dim, 64, 3, 1.0f, 42)); },
+				[=]() {
+					TaskScheduler::parallelFor(depth, [&](uint32_t z) {
+						std::vector<float> row(width);
+						for (uint32_t y = 0; y < height; ++y)
+							(*generator)->evaluateRow(y, z, 0, width, row.data());
+					});
+				},
+				[=]() { generator->reset(); } });
+		}
+	}
+}
+
+static void addCompositionCases(std::vector<BenchmarkCase>& cases)
+{
+	// same layouts as the textures of the ImageLoader: grey noises in R8, the cloud shape in RGBA8
+	const NoiseChannelLayout grey = NoiseChannelLayout::R8;
+	const NoiseChannelLayout rgba = NoiseChannelLayout::RGBA8;
+
+	auto buffer = std::make_shared<std::vector<uint8_t>>();
+	static const uint32_t sizes[] = { 64, 128, 256, 512 };
+	for (uint32_t size : sizes)
+	{
+		std::string suffix = "/" + std::to_string(size);
+		size_t rowStride = size_t(size) * PackedRowSink::getBytesPerTexel(grey);
+		auto allocate = [=]() { buffer->resize(rowStride * size); };
+		auto release = [=]() { std::vector<uint8_t>().swap(*buffer); };
+		cases.push_back({ "NoiseBaker.bakePerlinFBM" + suffix, size, size, 1, allocate,
+			[=]() { PackedRowSink sink(grey, buffer->data(), rowStride); NoiseBaker::bakePerlinFBM(size, size, sink); }, release });
+		cases.push_back({ "NoiseBaker.bakeWorleyFBM" + suffix, size, size, 1, allocate,
+			[=]() { PackedRowSink sink(grey, buffer->data(), rowStride); NoiseBaker::bakeWorleyFBM(size, size, sink); }, release });
+		cases.push_back({ "NoiseBaker.bakeWeather" + suffix, size, size, 1, allocate,
+			[=]() { PackedRowSink sink(grey, buffer->data(), rowStride); NoiseBaker::bakeWeather(size, size, 0.1f, 42, sink); }, release });
+		cases.push_back({ "NoiseBaker.bakeBlueNoise" + suffix, size, size, 1, allocate,
+			[=]() { PackedRowSink sink(grey, buffer->data(), rowStride); NoiseBaker::bakeBlueNoise(size, size, sink); }, release });
+
+		// encode of the baked weather, the setup bakes the R8 source
+		auto blocks = std::make_shared<std::vector<uint8_t>>();
+		size_t blockRowStride = size_t(NoiseBlockCompressor::getBlockCount(size)) * NoiseBlockCompressor::getBlockBytes(NoiseChannelLayout::BC4);
+		cases.push_back({ "NoiseBlockCompressor.encodeBC4" + suffix, size, size, 1,
+			[=]() {
+				allocate();
+				blocks->resize(blockRowStride * NoiseBlockCompressor::getBlockCount(size));
+				PackedRowSink sink(grey, buffer->data(), rowStride);
+				NoiseBaker::bakeWeather(size, size, 0.1f, 42, sink);
+			},
+			[=]() {
+				NoiseBlockCompressor::encode(NoiseChannelLayout::BC4, buffer->data(), rowStride, 0, size, size, 1,
+					blocks->data(), blockRowStride, 0);
+			},
+			[=]() { release(); std::vector<uint8_t>().swap(*blocks); } });
+	}
+
+	static const uint32_t volumes[][3] = { { 64, 64, 64 }, { 128, 128, 64 }, { 256, 256, 64 } };
+	for (const uint32_t* volume : volumes)
+	{
+		uint32_t width = volume[0], height = volume[1], depth = volume[2];
+		std::string suffix = "/" + std::to_string(width) + "x" + std::to_string(height) + "x" + std::to_string(depth);
+		// the buffer is sized for the widest layout
+		size_t rowStride = size_t(width) * PackedRowSink::getBytesPerTexel(rgba);
+		size_t sliceStride = rowStride * height;
+		size_t greyRowStride = size_t(width) * PackedRowSink::getBytesPerTexel(grey);
+		size_t greySliceStride = greyRowStride * height;
+		auto allocate = [=]() { buffer->resize(sliceStride * depth); };
+		auto release = [=]() { std::vector<uint8_t>().swap(*buffer); };
+		cases.push_back({ "NoiseBaker.bakeCloudShape" + suffix, width, height, depth, allocate,
+			[=]() { PackedRowSink sink(rgba, buffer->data(), rowStride, sliceStride); NoiseBaker::bakeCloudShape(width, height, depth, 42, sink); }, release });
+		cases.push_back({ "NoiseBaker.bake3DNoise" + suffix, width, height, depth, allocate,
+			[=]() { PackedRowSink sink(grey, buffer->data(), greyRowStride, greySliceStride); NoiseBaker::bake3DNoise(width, height, depth, 42, sink); }, release });
+	}
+}
+
+/// Textures of the cloud march, baked by the setup of its cases
+struct CloudMarchData
+{
+	std::unique_ptr<NoiseMipChain> pCloudShape;
+	std::unique_ptr<NoiseMipChain> pWeather;
+	std::unique_ptr<NoiseMipChain> pBlueNoise;
+	std::unique_ptr<NoiseSampler> pSamplers[3];
+	std::unique_ptr<CloudOccupancyGrid> pOccupancy;
+	std::unique_ptr<CloudLightVolume> pLightVolume;
+	/// fixed step, skipping the empty cells of the occupancy grid, reading the light from the light volume, adaptive step
+	std::unique_ptr<CloudMarcher> pMarchers[4];
+	CloudMarchStats stats;
+};
+
+static void addCloudMarchCases(std::vector<BenchmarkCase>& cases)
+{
+	// same textures, view and parameters as CloudReferenceRender, the baseline of the optimisations of the cloud pass
+	auto data = std::make_shared<CloudMarchData>();
+	auto setup = [=]() {
+		data->pCloudShape.reset(new NoiseMipChain(NoiseChannelLayout::RGBA8, 256, 256, 64));
+		PackedRowSink cloudShapeSink = data->pCloudShape->getSink();
+		NoiseBaker::bakeCloudShape(256, 256, 64, 42, cloudShapeSink);
+		data->pCloudShape->build();
+		data->pWeather.reset(new NoiseMipChain(NoiseChannelLayout::R8, 512, 512, 1));
+		PackedRowSink weatherSink = data->pWeather->getSink();
+		NoiseBaker::bakeWeather(512, 512, 0.1f, 42, weatherSink);
+		data->pWeather->build();
+		data->pBlueNoise.reset(new NoiseMipChain(NoiseChannelLayout::R8, 128, 128, 1, 1));
+		PackedRowSink blueNoiseSink = data->pBlueNoise->getSink();
+		NoiseBaker::bakeBlueNoise(128, 128, blueNoiseSink);
+
+		data->pSamplers[0].reset(new NoiseSampler(*data->pCloudShape));
+		data->pSamplers[1].reset(new NoiseSampler(*data->pWeather));
+		data->pSamplers[2].reset(new NoiseSampler(*data->pBlueNoise));
+		CloudMarchTextures textures = { data->pSamplers[0].get(), data->pSamplers[1].get(), data->pSamplers[2].get() };
+		CloudMarchParams params;
+		params.sunDir = normalize(vec3(0.4f, -1.0f, 0.3f));
+		data->pMarchers[0].reset(new CloudMarcher(params, textures));
+		data->pOccupancy.reset(new CloudOccupancyGrid(64, 32, 64));
+		data->pOccupancy->build(*data->pCloudShape, *data->pWeather, params);
+		CloudMarchTextures occupancyTextures = textures;
+		occupancyTextures.pOccupancy = data->pOccupancy.get();
+		data->pMarchers[1].reset(new CloudMarcher(params, occupancyTextures));
+		data->pLightVolume.reset(new CloudLightVolume(32, 16, 32));
+		data->pLightVolume->build(*data->pMarchers[0]);
+		CloudMarchTextures lightTextures = textures;
+		lightTextures.pLightVolume = data->pLightVolume.get();
+		data->pMarchers[2].reset(new CloudMarcher(params, lightTextures));
+		CloudMarchParams adaptiveParams = params;
+		adaptiveParams.stepPolicy.enabled = true;
+		data->pMarchers[3].reset(new CloudMarcher(adaptiveParams, textures));
+	};
+	auto teardown = [=]() { *data = CloudMarchData(); };
+	auto counters = [=]() {
+		char buffer[192];
+		snprintf(buffer, sizeof(buffer), "\"rayStepsPerPixel\": %.3f, \"lightStepsPerPixel\": %.3f, \"densityFetchesPerPixel\": %.3f",
+			data->stats.getRayStepsPerPixel(), data->stats.getLightStepsPerPixel(), data->stats.getDensityFetchesPerPixel());
+		return std::string(buffer);
+	};
+
+	static const uint32_t sizes[][2] = { { 160, 90 }, { 320, 180 } };
+	static const char* names[] = { "CloudMarcher.render/", "CloudMarcher.render/occupancy/", "CloudMarcher.render/lightvolume/",
+		"CloudMarcher.render/adaptive/" };
+	for (uint32_t marcher = 0; marcher < 4; ++marcher)
+	{
+		for (const uint32_t* size : sizes)
+		{
+			uint32_t width = size[0], height = size[1];
+			auto image = std::make_shared<std::unique_ptr<FloatBufferSink>>();
+			cases.push_back({ names[marcher] + std::to_string(width) + "x" + std::to_string(height), width, height, 1,
+				[=]() { setup(); image->reset(new FloatBufferSink(width, height, 1, 4)); },
+				[=]() {
+					CloudMarchCamera camera = { vec3(0.0f, -140.0f, -420.0f), vec3(0.0f, 0.0f, 0.0f), PI / 2.0f };
+					data->stats = data->pMarchers[marcher]->render(camera, width, height, **image);
+				},
+				[=]() { teardown(); image->reset(); },
+				counters });
+		}
+	}
+
+	// a frame of the temporal pass, one pixel of each 4x4 block marched and the others reprojected from the previous run
+	{
+		auto reprojector = std::make_shared<std::unique_ptr<CloudReprojector>>();
+		auto image = std::make_shared<std::unique_ptr<FloatBufferSink>>();
+		cases.push_back({ "CloudReprojector.render/320x180", 320, 180, 1,
+			[=]() { setup(); reprojector->reset(new CloudReprojector(320, 180)); image->reset(new FloatBufferSink(320, 180, 1, 4)); },
+			[=]() {
+				CloudMarchCamera camera = { vec3(0.0f, -140.0f, -420.0f), vec3(0.0f, 0.0f, 0.0f), PI / 2.0f };
+				data->stats = (*reprojector)->render(*data->pMarchers[0], camera, **image);
+			},
+			[=]() { teardown(); reprojector->reset(); image->reset(); },
+			counters });
+	}
+
+	// the whole update of the light volume, spread over a few frames by the sample when the sun moves
+	cases.push_back({ "CloudLightVolume.build/32x16x32", 32, 16, 32, setup,
+		[=]() { data->pLightVolume->build(*data->pMarchers[0]); },
+		teardown,
+		[=]() {
+			char buffer[64];
+			snprintf(buffer, sizeof(buffer), "\"densityFetches\": %llu", (unsigned long long)data->pLightVolume->getDensityFetches());
+			return std::string(buffer);
+		} });
+}
+
+/* --------------------------------- Region checks --------------------------------- */
+
+struct RegionCheck
+{
+	int32_t offset[3];
+	uint32_t extent[3];
+};
+
+// every texel of the region must be bit identical to the texel of the full bake its coordinates wrap to
+static uint32_t compareRegion(const std::string& name, const uint32_t size[3], const RegionCheck& check,
+	const std::vector<float>& full, const std::vector<float>& region)
+{
+	uint32_t mismatches = 0;
+	for (uint32_t z = 0; z < check.extent[2]; ++z)
+	{
+		for (uint32_t y = 0; y < check.extent[1]; ++y)
+		{
+			for (uint32_t x = 0; x < check.extent[0]; ++x)
+			{
+				uint32_t coords[3] = { x, y, z };
+				uint32_t src[3];
+				for (uint32_t axis = 0; axis < 3; ++axis)
+				{
+					int64_t wrapped = (int64_t(check.offset[axis]) + coords[axis]) % int64_t(size[axis]);
+					src[axis] = uint32_t(wrapped < 0 ? wrapped + size[axis] : wrapped);
+				}
+				float expected = full[(size_t(src[2]) * size[1] + src[1]) * size[0] + src[0]];
+				float value = region[(size_t(z) * check.extent[1] + y) * check.extent[0] + x];
+				if (memcmp(&expected, &value, sizeof(float)) != 0 && mismatches++ == 0)
+				{
+					fprintf(stderr, "%s: region (%d %d %d) + (%u %u %u), texel (%u %u %u) is %g instead of %g\n", name.c_str(),
+						check.offset[0], check.offset[1], check.offset[2], check.extent[0], check.extent[1], check.extent[2], x, y, z,
+						value, expected);
+				}
+			}
+		}
+	}
+	return mismatches;
+}
+
+// whole texture, inside, negative offsets, crossing the edges, larger than the texture (wrapping more than once)
+static uint32_t checkRegions(const std::string& name, uint32_t width, uint32_t height, uint32_t depth,
+	const std::function<void(NoiseSink&)>& generate, const std::function<void(const RegionCheck&, NoiseSink&)>& generateRegion)
+{
+	const uint32_t size[3] = { width, height, depth };
+	const int32_t w = int32_t(width), h = int32_t(height), d = int32_t(depth);
+	bool volume = depth > 1;
+	const RegionCheck checks[] = {
+		{ { 0, 0, 0 }, { width, height, depth } },
+		{ { 3, 5, volume ? 1 : 0 }, { width / 2, height / 3, volume ? depth / 2 : 1 } },
+		{ { -7, -h - 3, volume ? -2 : 0 }, { width / 3, height / 2, depth } },
+		{ { w - 2, h - 1, volume ? d - 1 : 0 }, { 5, 4, volume ? 3u : 1u } },
+		{ { -3 * w + 1, 2 * h + 5, volume ? -d : 0 }, { 2 * width + 3, height + 7, volume ? 2 * depth + 1 : 1 } },
+	};
+
+	FloatBufferSink full(width, height, depth);
+	generate(full);
+	uint32_t mismatches = 0;
+	for (const RegionCheck& check : checks)
+	{
+		FloatBufferSink region(check.extent[0], check.extent[1], check.extent[2]);
+		generateRegion(check, region);
+		mismatches += compareRegion(name, size, check, full.getData(), region.getData());
+	}
+	fprintf(stderr, "%-48s %s\n", name.c_str(), mismatches ? "FAILED" : "ok");
+	return mismatches;
+}
+
+static bool runRegionChecks()
+{
+	// sizes that are not multiples of the kernels, the lattice wraps mid cell
+	IVector2 dim2(96, 72);
+	IVector3 dim3(40, 36, 24);
+	PerlinNoise2D perlin2D(dim2, IVector2(64, 64), 5, 0.1f, 42);
+	PerlinNoise2D perlin2DInteger(dim2, IVector2(16, 16), 3, 0.5f, 42, GradientHash::Integer);
+	ValueNoise2D value2D(dim2, IVector2(32, 32), 3, 1.0f);
+	WorleyNoise2D worley2D(dim2, 6);
+	PerlinNoise3D perlin3D(dim3, 64, 3, 1.0f, 42);
+	WorleyNoise3D worley3D(dim3, 7, 7);
+
+	auto offset2D = [](const RegionCheck& check) { return IVector2(check.offset[0], check.offset[1]); };
+	auto extent2D = [](const RegionCheck& check) { return IVector2(int(check.extent[0]), int(check.extent[1])); };
+	auto offset3D = [](const RegionCheck& check) { return IVector3(check.offset[0], check.offset[1], check.offset[2]); };
+	auto extent3D = [](const RegionCheck& check) {
+		return IVector3(int(check.extent[0]), int(check.extent[1]), int(check.extent[2]));
+	};
+
+	uint32_t mismatches = 0;
+	mismatches += checkRegions("PerlinNoise2D.generateRegion", 96, 72, 1, [&](NoiseSink& sink) { perlin2D.generate(sink); },
+		[&](const RegionCheck& check, NoiseSink& sink) { perlin2D.generateRegion(offset2D(check), extent2D(check), sink); });
+	mismatches += checkRegions("PerlinNoise2D.generateRegion.integerHash", 96, 72, 1,
+		[&](NoiseSink& sink) { perlin2DInteger.generate(sink); },
+		[&](const RegionCheck& check, NoiseSink& sink) { perlin2DInteger.generateRegion(offset2D(check), extent2D(check), sink); });
+	mismatches += checkRegions("ValueNoise2D.generateRegion", 96, 72, 1, [&](NoiseSink& sink) { value2D.generate(sink); },
+		[&](const RegionCheck& check, NoiseSink& sink) { value2D.generateRegion(offset2D(check), extent2D(check), sink); });
+	mismatches += checkRegions("WorleyNoise2D.generateRegion", 96, 72, 1, [&](NoiseSink& sink) { worley2D.generate(sink); },
+		[&](const RegionCheck& check, NoiseSink& sink) { worley2D.generateRegion(offset2D(check), extent2D(check), sink); });
+	mismatches += checkRegions("PerlinNoise3D.generateRegion", 40, 36, 24, [&](NoiseSink& sink) { perlin3D.generate(sink); },
+		[&](const RegionCheck& check, NoiseSink& sink) { perlin3D.generateRegion(offset3D(check), extent3D(check), sink); });
+	mismatches += checkRegions("WorleyNoise3D.generateRegion", 40, 36, 24, [&](NoiseSink& sink) { worley3D.generate(sink); },
+		[&](const RegionCheck& check, NoiseSink& sink) { worley3D.generateRegion(offset3D(check), extent3D(check), sink); });
+	return mismatches == 0;
+}
+
+/* --------------------------------- Runner --------------------------------- */
+
+static BenchmarkResult runCase(const BenchmarkCase& benchmarkCase, uint32_t threads, double minTime)
+{
+	BenchmarkResult result = { &benchmarkCase, threads, 0, 0.0, std::string() };
+	benchmarkCase.setup();
+
+	// one untimed warm up run, then at least 3 timed ones
+	benchmarkCase.run();
+	double start = now();
+	while (result.iterations < 3 || now() - start < minTime)
+	{
+		double begin = now();
+		benchmarkCase.run();
+		double elapsed = now() - begin;
+		if (result.iterations == 0 || elapsed < result.bestSeconds)
+			result.bestSeconds = elapsed;
+		result.iterations++;
+	}
+
+	if (benchmarkCase.counters)
+		result.counters = benchmarkCase.counters();
+	benchmarkCase.teardown();
+	return result;
+}
+
+static void writeJson(FILE* pFile, const std::vector<BenchmarkResult>& results)
+{
+	fprintf(pFile, "{\n  \"hardwareThreads\": %u,\n  \"results\": [\n", getNumCPUCores());
+	for (size_t i = 0; i < results.size(); ++i)
+	{
+		const BenchmarkResult& result = results[i];
+		const BenchmarkCase& benchmarkCase = *result.pCase;
+		double samples = double(benchmarkCase.width) * benchmarkCase.height * benchmarkCase.depth;
+		fprintf(pFile,
+			"    { \"name\": \"%s\", \"width\": %u, \"height\": %u, \"depth\": %u, \"threads\": %u, \"iterations\": %u, "
+			"\"seconds\": %.9f, \"nsPerSample\": %.3f, \"samplesPerSecond\": %.1f%s%s }%s\n",
+			benchmarkCase.name.c_str(), benchmarkCase.width, benchmarkCase.height, benchmarkCase.depth, result.threads,
+			result.iterations, result.bestSeconds, result.bestSeconds * 1e9 / samples, samples / result.bestSeconds,
+			result.counters.empty() ? "" : ", ", result.counters.c_str(), i + 1 < results.size() ? "," : "");
+	}
+	fprintf(pFile, "  ]\n}\n");
+}
+
+static std::vector<uint32_t> parseThreadCounts(const char* pList)
+{
+	std::vector<uint32_t> threadCounts;
+	std::string list = pList;
+	size_t begin = 0;
+	while (begin < list.size())
+	{
+		size_t end = list.find(',', begin);
+		if (end == std::string::npos)
+			end = list.size();
+		uint32_t count = uint32_t(atoi(list.substr(begin, end - begin).c_str()));
+		if (count > 0)
+			threadCounts.push_back(count);
+		begin = end + 1;
+	}
+	return threadCounts;
+}
+
+int main(int argc, char** argv)
+{
+	initMemAlloc("NoiseBenchmark");
+	initLog("NoiseBenchmark", LogLevel::eINFO);
+
+	if (argc > 1 && !strcmp(argv[1], "--check"))
+	{
+		TaskScheduler::init(getNumCPUCores());
+		bool passed = runRegionChecks();
+		TaskScheduler::exit();
+		exitLog();
+		exitMemAlloc();
+		return passed ? 0 : 1;
+	}
+
+	const char* pFilter = "";
+	const char* pOutput = NULL;
+	double minTime = 0.2;
+	std::vector<uint32_t> threadCounts;
+	for (int i = 1; i + 1 < argc; i += 2)
+	{
+		if (!strcmp(argv[i], "--filter"))
+			pFilter = argv[i + 1];
+		else if (!strcmp(argv[i], "--threads"))
+			threadCounts = parseThreadCounts(argv[i + 1]);
+		else if (!strcmp(argv[i], "--min-time"))
+			minTime = atof(argv[i + 1]);
+		else if (!strcmp(argv[i], "--out"))
+			pOutput = argv[i + 1];
+	}
+
+	// default sweep: 1, 2, 4... up to the core count
+	if (threadCounts.empty())
+	{
+		uint32_t cores = getNumCPUCores();
+		for (uint32_t count = 1; count < cores; count *= 2)
+			threadCounts.push_back(count);
+		threadCounts.push_back(cores < 1 ? 1 : cores);
+	}
+
+	std::vector<BenchmarkCase> cases;
+	addGeneratorCases(cases);
+	addCompositionCases(cases);
+	addCloudMarchCases(cases);
+
+	std::vector<BenchmarkResult> results;
+	for (uint32_t threads : threadCounts)
+	{
+		TaskScheduler::init(threads);
+		for (const BenchmarkCase& benchmarkCase : cases)
+		{
+			if (!strstr(benchmarkCase.name.c_str(), pFilter))
+				continue;
+			results.push_back(runCase(benchmarkCase, threads, minTime));
+			const BenchmarkResult& result = results.back();
+			fprintf(stderr, "%-48s threads %2u  %10.3f ms\n", benchmarkCase.name.c_str(), threads, result.bestSeconds * 1e3);
+		}
+	}
+	TaskScheduler::exit();
+
+	FILE* pFile = pOutput ? fopen(pOutput, "w") : stdout;
+	if (pFile)
+	{
+		writeJson(pFile, results);
+		if (pOutput)
+			fclose(pFile);
+	}
+
+	exitLog();
+	exitMemAlloc();
+	return pFile ? 0 : 1;
+}
@@ -1,19 +1,29 @@
 #include "BlueNoise2D.h"
 
-#include <cmath> 
-#include <cstdio> 
-#include <random> 
-#include <functional> 
+#include "../NoiseParallel.h"
 
-#define PI 3.14159265358979323846f
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <random>
 
-BlueNoise2D::BlueNoise2D(const IVector2& textureDim) :
+// size of the tiles caching the extremums of the energy field
+static const uint32_t kTileSize = 8;
+// fraction of the pixels set in the initial binary pattern
+static const float kInitialDensity = 0.1f;
+
+BlueNoise2D::BlueNoise2D(const IVector2& textureDim, int randomSeed, float sigma) :
     m_textureDim(textureDim),
-    m_randomSeed(42)
+    m_randomSeed(randomSeed),
+    m_sigma(sigma)
 {
-    std::mt19937 generator(m_randomSeed);
-    std::uniform_real_distribution<float> distribution;
-    m_dice = std::function<float()>(std::bind(distribution, generator));
+    m_tileCountX = (uint32_t(m_textureDim.getX()) + kTileSize - 1) / kTileSize;
+    m_tileCountY = (uint32_t(m_textureDim.getY()) + kTileSize - 1) / kTileSize;
+
+    computeEnergyLut();
+    Field prototype;
+    computeInitialPattern(prototype);
+    rankPixels(prototype);
 }
 
 BlueNoise2D::~BlueNoise2D()
@@ -23,24 +33,281 @@ BlueNoise2D::~BlueNoise2D()
 
 /* --------------------------------- Public methods --------------------------------- */
 
-std::vector<float> BlueNoise2D::generateTexture()
+void BlueNoise2D::generate(NoiseSink& sink) const
+{
+    uint32_t width = m_textureDim.getX();
+    uint32_t height = m_textureDim.getY();
+
+    // the values are already resident, rows are handed over without a copy
+    for (uint32_t y = 0; y < height; ++y) {
+        sink.writeRow(y, 0, 0, width, &m_values[y * width]);
+    }
+}
+
+float BlueNoise2D::evaluate(uint32_t x, uint32_t y) const
+{
+    return m_values[y * m_textureDim.getX() + x];
+}
+
+/* --------------------------------- Private methods --------------------------------- */
+
+void BlueNoise2D::computeEnergyLut()
+{
+    // past 4 sigma the weights are negligible, the window must also fit the texture to stay toroidal
+    int width = m_textureDim.getX();
+    int height = m_textureDim.getY();
+    m_lutRadius = int(std::ceil(4.0f * m_sigma));
+    m_lutRadius = std::min(m_lutRadius, (std::min(width, height) - 1) / 2);
+
+    int lutSize = 2 * m_lutRadius + 1;
+    m_energyLut.resize(lutSize * lutSize);
+    float invTwoSigma2 = 1.0f / (2.0f * m_sigma * m_sigma);
+    for (int dy = -m_lutRadius; dy <= m_lutRadius; ++dy) {
+        for (int dx = -m_lutRadius; dx <= m_lutRadius; ++dx) {
+            m_energyLut[(dy + m_lutRadius) * lutSize + dx + m_lutRadius] = std::exp(-float(dx * dx + dy * dy) * invTwoSigma2);
+        }
+    }
+}
+
+void BlueNoise2D::computeInitialPattern(Field& field) const
+{
+    uint32_t pixelCount = m_textureDim.getX() * m_textureDim.getY();
+
+    // random white noise pattern with a few minority pixels
+    std::vector<uint32_t> order(pixelCount);
+    for (uint32_t i = 0; i < pixelCount; ++i) {
+        order[i] = i;
+    }
+    std::mt19937 generator(m_randomSeed);
+    std::shuffle(order.begin(), order.end(), generator);
+
+    uint32_t onesCount = std::max(1u, uint32_t(float(pixelCount) * kInitialDensity));
+    field.pattern.assign(pixelCount, 0);
+    for (uint32_t i = 0; i < onesCount; ++i) {
+        field.pattern[order[i]] = 1;
+    }
+    computeEnergy(field);
+
+    // move the tightest cluster into the largest void until it lands back where it was
+    for (uint32_t iteration = 0; iteration < pixelCount; ++iteration) {
+        int32_t cluster = findTightestCluster(field);
+        togglePixel(field, cluster);
+        int32_t largestVoid = findLargestVoid(field);
+        togglePixel(field, largestVoid);
+        if (largestVoid == cluster) {
+            break;
+        }
+    }
+}
+
+void BlueNoise2D::rankPixels(const Field& prototype)
+{
+    uint32_t pixelCount = m_textureDim.getX() * m_textureDim.getY();
+    uint32_t prototypeOnes = 0;
+    for (uint32_t i = 0; i < pixelCount; ++i) {
+        prototypeOnes += prototype.pattern[i];
+    }
+
+    // both passes start from the prototype and rank disjoint pixels, so they run side by side
+    std::vector<uint32_t> ranks(pixelCount);
+    NoiseParallel::parallelFor(2, [&](uint32_t phase) {
+        Field field = prototype;
+        uint32_t onesCount = prototypeOnes;
+        if (phase == 0) {
+            // phase 1: remove the tightest clusters of the prototype, they get the lower ranks
+            while (onesCount > 0) {
+                int32_t cluster = findTightestCluster(field);
+                togglePixel(field, cluster);
+                ranks[cluster] = --onesCount;
+            }
+        }
+        else {
+            // phase 2 and 3: fill the largest voids until the pattern is full.
+            // On a torus the energy of the zeros is the complement of the energy of the ones,
+            // so the tightest cluster of zeros of phase 3 is also the largest void of the ones
+            while (onesCount < pixelCount) {
+                int32_t largestVoid = findLargestVoid(field);
+                togglePixel(field, largestVoid);
+                ranks[largestVoid] = onesCount++;
+            }
+        }
+    });
+
+    m_values.resize(pixelCount);
+    for (uint32_t i = 0; i < pixelCount; ++i) {
+        m_values[i] = (float(ranks[i]) + 0.5f) / float(pixelCount);
+    }
+}
+
+void BlueNoise2D::computeEnergy(Field& field) const
 {
-    std::vector<float> result;
     int width = m_textureDim.getX();
     int height = m_textureDim.getY();
+    int lutSize = 2 * m_lutRadius + 1;
+    field.energy.resize(width * height);
 
-    result.resize(width * height);
-    for (int y = 0; y < height; y++) {
-        for (int x = 0; x < width; x++) {
-            float val = evaluate(x, y);
-            result[y * width + x] = val;
+    // full gather, only done once for the initial pattern
+    NoiseParallel::parallelFor(uint32_t(height), [&](uint32_t y) {
+        for (int x = 0; x < width; ++x) {
+            float energy = 0.0f;
+            for (int dy = -m_lutRadius; dy <= m_lutRadius; ++dy) {
+                int row = (int(y) + dy + height) % height;
+                const float* lut = &m_energyLut[(dy + m_lutRadius) * lutSize + m_lutRadius];
+                for (int dx = -m_lutRadius; dx <= m_lutRadius; ++dx) {
+                    int col = (x + dx + width) % width;
+                    if (field.pattern[row * width + col]) {
+                        energy += lut[dx];
+                    }
+                }
+            }
+            field.energy[y * width + x] = energy;
+        }
+    });
+
+    invalidate(field);
+}
+
+void BlueNoise2D::togglePixel(Field& field, uint32_t index) const
+{
+    int width = m_textureDim.getX();
+    int height = m_textureDim.getY();
+    int lutSize = 2 * m_lutRadius + 1;
+    int px = int(index) % width;
+    int py = int(index) / width;
+
+    float sign = field.pattern[index] ? -1.0f : 1.0f;
+    field.pattern[index] ^= 1;
+
+    // splat the window, the filter is symmetric so it is its own transpose
+    for (int dy = -m_lutRadius; dy <= m_lutRadius; ++dy) {
+        int row = (py + dy + height) % height;
+        const float* lut = &m_energyLut[(dy + m_lutRadius) * lutSize + m_lutRadius];
+        float* energy = &field.energy[row * width];
+        if (px >= m_lutRadius && px + m_lutRadius < width) {
+            // the window does not wrap horizontally
+            for (int dx = -m_lutRadius; dx <= m_lutRadius; ++dx) {
+                energy[px + dx] += sign * lut[dx];
+            }
+        }
+        else {
+            for (int dx = -m_lutRadius; dx <= m_lutRadius; ++dx) {
+                int col = (px + dx + width) % width;
+                energy[col] += sign * lut[dx];
+            }
+        }
+    }
+
+    // only the tiles overlapped by the window lose their cached extremums,
+    // visit the first row / column of the window and the ones starting a new tile
+    for (int dy = -m_lutRadius; dy <= m_lutRadius; ++dy) {
+        int row = (py + dy + height) % height;
+        if (dy != -m_lutRadius && row % kTileSize != 0) {
+            continue;
+        }
+        uint32_t tileRow = row / kTileSize;
+        field.tileRows[tileRow].dirty = true;
+        for (int dx = -m_lutRadius; dx <= m_lutRadius; ++dx) {
+            int col = (px + dx + width) % width;
+            if (dx != -m_lutRadius && col % kTileSize != 0) {
+                continue;
+            }
+            field.tiles[tileRow * m_tileCountX + col / kTileSize].dirty = true;
+        }
+    }
+}
+
+void BlueNoise2D::invalidate(Field& field) const
+{
+    field.tiles.resize(m_tileCountX * m_tileCountY);
+    field.tileRows.resize(m_tileCountY);
+    for (Extremums& tile : field.tiles) {
+        tile.dirty = true;
+    }
+    for (Extremums& tileRow : field.tileRows) {
+        tileRow.dirty = true;
+    }
+}
+
+void BlueNoise2D::updateTile(Field& field, uint32_t tileIndex) const
+{
+    uint32_t width = m_textureDim.getX();
+    uint32_t height = m_textureDim.getY();
+    uint32_t x0 = (tileIndex % m_tileCountX) * kTileSize;
+    uint32_t y0 = (tileIndex / m_tileCountX) * kTileSize;
+    uint32_t x1 = std::min(x0 + kTileSize, width);
+    uint32_t y1 = std::min(y0 + kTileSize, height);
+
+    Extremums& tile = field.tiles[tileIndex];
+    tile.tightestCluster = -1;
+    tile.largestVoid = -1;
+    float maxEnergy = 0.0f;
+    float minEnergy = 0.0f;
+    for (uint32_t y = y0; y < y1; ++y) {
+        for (uint32_t x = x0; x < x1; ++x) {
+            uint32_t index = y * width + x;
+            float energy = field.energy[index];
+            if (field.pattern[index]) {
+                if (tile.tightestCluster < 0 || energy > maxEnergy) {
+                    tile.tightestCluster = int32_t(index);
+                    maxEnergy = energy;
+                }
+            }
+            else if (tile.largestVoid < 0 || energy < minEnergy) {
+                tile.largestVoid = int32_t(index);
+                minEnergy = energy;
+            }
+        }
+    }
+    tile.dirty = false;
+}
+
+void BlueNoise2D::updateTileRow(Field& field, uint32_t tileRow) const
+{
+    Extremums& row = field.tileRows[tileRow];
+    row.tightestCluster = -1;
+    row.largestVoid = -1;
+    for (uint32_t i = tileRow * m_tileCountX; i < (tileRow + 1) * m_tileCountX; ++i) {
+        if (field.tiles[i].dirty) {
+            updateTile(field, i);
+        }
+        int32_t cluster = field.tiles[i].tightestCluster;
+        if (cluster >= 0 && (row.tightestCluster < 0 || field.energy[cluster] > field.energy[row.tightestCluster])) {
+            row.tightestCluster = cluster;
+        }
+        int32_t largestVoid = field.tiles[i].largestVoid;
+        if (largestVoid >= 0 && (row.largestVoid < 0 || field.energy[largestVoid] < field.energy[row.largestVoid])) {
+            row.largestVoid = largestVoid;
         }
     }
+    row.dirty = false;
+}
 
-    return result;
+int32_t BlueNoise2D::findTightestCluster(Field& field) const
+{
+    int32_t best = -1;
+    for (uint32_t i = 0; i < m_tileCountY; ++i) {
+        if (field.tileRows[i].dirty) {
+            updateTileRow(field, i);
+        }
+        int32_t candidate = field.tileRows[i].tightestCluster;
+        if (candidate >= 0 && (best < 0 || field.energy[candidate] > field.energy[best])) {
+            best = candidate;
+        }
+    }
+    return best;
 }
 
-float BlueNoise2D::evaluate(uint32_t x, uint32_t y)
+int32_t BlueNoise2D::findLargestVoid(Field& field) const
 {
-    return m_dice();
+    int32_t best = -1;
+    for (uint32_t i = 0; i < m_tileCountY; ++i) {
+        if (field.tileRows[i].dirty) {
+            updateTileRow(field, i);
+        }
+        int32_t candidate = field.tileRows[i].largestVoid;
+        if (candidate >= 0 && (best < 0 || field.energy[candidate] < field.energy[best])) {
+            best = candidate;
+        }
+    }
+    return best;
 }
@@ -1,24 +1,67 @@
 #pragma once
 
 #include <vector>
-#include <functional>
+#include <cstdint>
 
 //Math
 #include "../../../../../../Common_3/Utilities/Math/MathTypes.h"
 
+#include "../NoiseSink.h"
+
+/// Blue noise dither array built with the void and cluster algorithm (Ulichney 93).
+/// The energy field is a toroidal gaussian filter of the binary pattern, it is updated incrementally
+/// from a precomputed window each time a pixel is toggled instead of being recomputed in full.
 class BlueNoise2D
 {
 public:
-    BlueNoise2D(const IVector2& textureDim);
+    BlueNoise2D(const IVector2& textureDim, int randomSeed = 42, float sigma = 1.5f);
     ~BlueNoise2D();
 
 public:
-    std::vector<float> generateTexture();
-    float evaluate(uint32_t x, uint32_t y);
+    /// Stream every row of the texture to sink
+    void generate(NoiseSink& sink) const;
+    /// Rank of the pixel in the dither array remapped to ]0, 1[, every value appears once
+    float evaluate(uint32_t x, uint32_t y) const;
+
+private:
+    /// Cached extremums of a tile (or of a row of tiles), -1 when there is no such pixel
+    struct Extremums
+    {
+        int32_t tightestCluster;
+        int32_t largestVoid;
+        bool dirty;
+    };
+
+    /// Binary pattern and its energy, the extremums are cached per tile and per row of tiles
+    struct Field
+    {
+        std::vector<uint8_t> pattern;
+        std::vector<float> energy;
+        std::vector<Extremums> tiles;
+        std::vector<Extremums> tileRows;
+    };
+
+    void computeEnergyLut();
+    void computeInitialPattern(Field& field) const;
+    void rankPixels(const Field& prototype);
+    void computeEnergy(Field& field) const;
+    void togglePixel(Field& field, uint32_t index) const;
+    void invalidate(Field& field) const;
+    void updateTile(Field& field, uint32_t tileIndex) const;
+    void updateTileRow(Field& field, uint32_t tileRow) const;
+    int32_t findTightestCluster(Field& field) const;
+    int32_t findLargestVoid(Field& field) const;
 
 private:
     IVector2 m_textureDim;
     int m_randomSeed;
-    std::function<float()> m_dice;
-};
+    float m_sigma;
+    uint32_t m_tileCountX;
+    uint32_t m_tileCountY;
 
+    // gaussian weights of the (2 * radius + 1)^2 window around a pixel
+    int m_lutRadius;
+    std::vector<float> m_energyLut;
+
+    std::vector<float> m_values;
+};
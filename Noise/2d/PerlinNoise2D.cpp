@@ -1,5 +1,9 @@
 #include "PerlinNoise2D.h"
 
+#include "../NoiseOctaves.h"
+#include "../NoiseRegion.h"
+#include "../NoiseParallel.h"
+
 #include <cmath> 
 #include <cstdio> 
 #include <random> 
@@ -7,16 +11,19 @@
 
 #define PI 3.14159265358979323846f
 
-PerlinNoise2D::PerlinNoise2D(const IVector2& textureDim, const IVector2& kernelSize, size_t nbLayers, float scaleFactor, int randomSeed) :
+PerlinNoise2D::PerlinNoise2D(const IVector2& textureDim, const IVector2& kernelSize, size_t nbLayers, float scaleFactor, int randomSeed,
+    GradientHash gradientHash) :
     m_textureDim(textureDim),
     m_kernelSize(kernelSize),
     m_nbLayers(nbLayers),
     m_randomSeed(randomSeed),
     m_scaleFactor(scaleFactor),
     m_baseFrequency(0.05f),
-    m_rateOffChanged(2.0f)
+    m_rateOffChanged(2.0f),
+    m_gradientHash(gradientHash)
 {
     computeKernelDirection();
+    computeOctaves();
 }
 
 PerlinNoise2D::~PerlinNoise2D()
@@ -26,86 +33,194 @@ PerlinNoise2D::~PerlinNoise2D()
 
 /* --------------------------------- Public methods --------------------------------- */
 
-std::vector<float> PerlinNoise2D::generateTexture()
+void PerlinNoise2D::generate(NoiseSink& sink) const
 {
-    std::vector<float> result;
-    int width = m_textureDim.getX();
-    int height = m_textureDim.getY();
-
-    result.resize(width * height);
-    for (int y = 0; y < height; y++) {
-        for (int x = 0; x < width; x++) {
-            float val = evaluate(x, y);
-            result[y * width + x] = val;
-        }
-    }
+    generateRegion(IVector2(0, 0), m_textureDim, sink);
+}
 
-    return result;
+void PerlinNoise2D::generateRegion(const IVector2& offset, const IVector2& extent, NoiseSink& sink) const
+{
+    uint32_t width = extent.getX();
+    std::vector<NoiseRegionSpan> spans = splitRegionAxis(offset.getX(), width, m_textureDim.getX());
+
+    NoiseParallel::parallelFor(extent.getY(), [&](uint32_t y) {
+        std::vector<float> row(width);
+        uint32_t textureY = wrapRegionCoord(int64_t(offset.getY()) + y, m_textureDim.getY());
+        for (const NoiseRegionSpan& span : spans) {
+            evaluateRow(textureY, span.src, span.count, &row[span.dst]);
+        }
+        sink.writeRow(y, 0, 0, width, row.data());
+    });
 }
 
-float PerlinNoise2D::evaluate(uint32_t x, uint32_t y)
+float PerlinNoise2D::evaluate(uint32_t x, uint32_t y) const
 {
     return sample(float(x), float(y));
 }
 
-float PerlinNoise2D::sample(float x, float y)
+void PerlinNoise2D::evaluateRow(uint32_t y, uint32_t x0, uint32_t count, float* out) const
 {
-    float brownianNoise = 0.0;
-    float noiseMax = 0.0;
+    int kernelWidth = m_kernelSize.getX();
+    int kernelHeight = m_kernelSize.getY();
 
-    for (size_t i = 0; i < m_nbLayers; ++i)
+    // specialised kernels of the configurations baked by ImageLoader
+    if (m_gradientHash == GradientHash::Permutation && m_rateOffChanged == 2.0f && kernelWidth == 64 && kernelHeight == 64)
     {
-        float amplitude = float(pow(m_rateOffChanged, i));
-        float frequency = m_baseFrequency * amplitude * m_scaleFactor;
-        brownianNoise += computeNoiseValue(x * frequency, y * frequency) / amplitude;
-        noiseMax += 1.0f / amplitude;
+        switch (m_nbLayers)
+        {
+        case 3: evaluateRowFixed<3, 64>(y, x0, count, out); return;
+        case 5: evaluateRowFixed<5, 64>(y, x0, count, out); return;
+        default: break;
+        }
     }
-    brownianNoise = brownianNoise / noiseMax;
-    return brownianNoise;
-}
 
-/* --------------------------------- Private methods --------------------------------- */
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        out[i] = 0.0f;
+    }
+
+    // octave major: the y lattice coordinate is shared by the whole row
+    for (size_t octave = 0; octave < m_nbLayers; ++octave)
+    {
+        float amplitude = m_octaveAmplitudes[octave];
+        float frequency = m_octaveFrequencies[octave];
+        LatticeCoord ly = computeLatticeCoord(float(y) * frequency, kernelHeight);
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            LatticeCoord lx = computeLatticeCoord(float(x0 + i) * frequency, kernelWidth);
+            out[i] += computeNoiseValue(lx, ly) / amplitude;
+        }
+    }
+
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        out[i] = out[i] / m_noiseMax;
+    }
+}
 
-float PerlinNoise2D::computeNoiseValue(float x, float y) const
+template <std::size_t Octaves, int KernelSize>
+void PerlinNoise2D::evaluateRowFixed(uint32_t y, uint32_t x0, uint32_t count, float* out) const
 {
-    int xi = int(std::floor(x));
-    int yi = int(std::floor(y));
+    static_assert(KernelSize > 0 && (KernelSize & (KernelSize - 1)) == 0, "the lattice wraps with a mask");
+    constexpr int kernelMask = KernelSize - 1;
+    constexpr float noiseMax = fbmOctaveWeightSum(Octaves);
+
+    const int* permutation = m_permutationTable.data();
+    const vec2* directions = m_kernelDirections.data();
+
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        out[i] = 0.0f;
+    }
 
-    float tx = x - xi;
-    float ty = y - yi;
+    for (std::size_t octave = 0; octave < Octaves; ++octave)
+    {
+        // amplitudes are powers of two, so the multiplication matches the division of the generic path
+        const float weight = 1.0f / fbmOctaveAmplitude(octave);
+        const float frequency = m_octaveFrequencies[octave];
+
+        float vy = float(y) * frequency;
+        int yi = int(std::floor(vy));
+        float y0 = vy - yi, y1 = y0 - 1.0f;
+        float sy = smoothstep(y0);
+        int ry0 = yi & kernelMask;
+        int ry1 = (ry0 + 1) & kernelMask;
+
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            float vx = float(x0 + i) * frequency;
+            int xi = int(std::floor(vx));
+            float xt0 = vx - xi, xt1 = xt0 - 1.0f;
+            float sx = smoothstep(xt0);
+            int rx0 = xi & kernelMask;
+            int rx1 = (rx0 + 1) & kernelMask;
+
+            const vec2& d00 = directions[permutation[permutation[rx0] + ry0]];
+            const vec2& d10 = directions[permutation[permutation[rx1] + ry0]];
+            const vec2& d01 = directions[permutation[permutation[rx0] + ry1]];
+            const vec2& d11 = directions[permutation[permutation[rx1] + ry1]];
+
+            float a = interpolate(Vectormath::dot(d00, vec2(xt0, y0)), Vectormath::dot(d10, vec2(xt1, y0)), sx);
+            float b = interpolate(Vectormath::dot(d01, vec2(xt0, y1)), Vectormath::dot(d11, vec2(xt1, y1)), sx);
+            out[i] += (interpolate(a, b, sy) + 1.0f) / 2.0f * weight;
+        }
+    }
 
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        out[i] = out[i] / noiseMax;
+    }
+}
+
+template void PerlinNoise2D::evaluateRowFixed<3, 64>(uint32_t, uint32_t, uint32_t, float*) const;
+template void PerlinNoise2D::evaluateRowFixed<5, 64>(uint32_t, uint32_t, uint32_t, float*) const;
+
+float PerlinNoise2D::sample(float x, float y) const
+{
+    float brownianNoise = 0.0;
     int kernelWidth = m_kernelSize.getX();
     int kernelHeight = m_kernelSize.getY();
 
-    int rx0 = xi % kernelWidth;
-    int rx1 = (rx0 + 1) % kernelWidth;
-    int ry0 = yi % kernelHeight;
-    int ry1 = (ry0 + 1) % kernelHeight;
-
-    // gradients at the corner of the cell
-    const vec2& d00 = m_kernelDirections[hash(rx0, ry0)];
-    const vec2& d10 = m_kernelDirections[hash(rx1, ry0)];
-    const vec2& d01 = m_kernelDirections[hash(rx0, ry1)];
-    const vec2& d11 = m_kernelDirections[hash(rx1, ry1)];
+    for (size_t i = 0; i < m_nbLayers; ++i)
+    {
+        float amplitude = m_octaveAmplitudes[i];
+        float frequency = m_octaveFrequencies[i];
+        LatticeCoord lx = computeLatticeCoord(x * frequency, kernelWidth);
+        LatticeCoord ly = computeLatticeCoord(y * frequency, kernelHeight);
+        brownianNoise += computeNoiseValue(lx, ly) / amplitude;
+    }
+    brownianNoise = brownianNoise / m_noiseMax;
+    return brownianNoise;
+}
 
-    // generate vectors going from the grid points to p
-    float x0 = tx, x1 = tx - 1;
-    float y0 = ty, y1 = ty - 1;
+/* --------------------------------- Private methods --------------------------------- */
 
-    vec2 p00 = vec2(x0, y0);
-    vec2 p10 = vec2(x1, y0);
-    vec2 p01 = vec2(x0, y1);
-    vec2 p11 = vec2(x1, y1);
+PerlinNoise2D::LatticeCoord PerlinNoise2D::computeLatticeCoord(float value, int kernelSize) const
+{
+    LatticeCoord coord;
+    int vi = int(std::floor(value));
+    coord.t = value - vi;
+    coord.r0 = vi % kernelSize;
+    coord.r1 = (coord.r0 + 1) % kernelSize;
+    // remapping of t using the Smoothstep function 
+    coord.s = smoothstep(coord.t);
+    return coord;
+}
 
-    // remapping of tx and ty using the Smoothstep function 
-    float sx = smoothstep(tx);
-    float sy = smoothstep(ty);
+float PerlinNoise2D::computeNoiseValue(const LatticeCoord& lx, const LatticeCoord& ly) const
+{
+    // generate vectors going from the grid points to p
+    float x0 = lx.t, x1 = lx.t - 1;
+    float y0 = ly.t, y1 = ly.t - 1;
 
-    float a = interpolate(Vectormath::dot(d00, p00), Vectormath::dot(d10, p10), sx);
-    float b = interpolate(Vectormath::dot(d01, p01), Vectormath::dot(d11, p11), sx);
+    float a;
+    float b;
+    if (m_gradientHash == GradientHash::Integer)
+    {
+        // gradients derived from the corner hash, no table lookups
+        uint32_t seed = uint32_t(m_randomSeed);
+        a = interpolate(hashGradient2D(hashLattice(lx.r0, ly.r0, 0, seed), x0, y0), hashGradient2D(hashLattice(lx.r1, ly.r0, 0, seed), x1, y0), lx.s);
+        b = interpolate(hashGradient2D(hashLattice(lx.r0, ly.r1, 0, seed), x0, y1), hashGradient2D(hashLattice(lx.r1, ly.r1, 0, seed), x1, y1), lx.s);
+    }
+    else
+    {
+        // gradients at the corner of the cell
+        const vec2& d00 = m_kernelDirections[hash(lx.r0, ly.r0)];
+        const vec2& d10 = m_kernelDirections[hash(lx.r1, ly.r0)];
+        const vec2& d01 = m_kernelDirections[hash(lx.r0, ly.r1)];
+        const vec2& d11 = m_kernelDirections[hash(lx.r1, ly.r1)];
+
+        vec2 p00 = vec2(x0, y0);
+        vec2 p10 = vec2(x1, y0);
+        vec2 p01 = vec2(x0, y1);
+        vec2 p11 = vec2(x1, y1);
+
+        a = interpolate(Vectormath::dot(d00, p00), Vectormath::dot(d10, p10), lx.s);
+        b = interpolate(Vectormath::dot(d01, p01), Vectormath::dot(d11, p11), lx.s);
+    }
 
     // linearly interpolate the nx0/nx1 along they y axis
-    return (interpolate(a, b, sy) + 1.0f) / 2.0f;
+    return (interpolate(a, b, ly.s) + 1.0f) / 2.0f;
 }
 
 void PerlinNoise2D::computeKernelDirection()
@@ -141,6 +256,21 @@ void PerlinNoise2D::computeKernelDirection()
     }
 }
 
+void PerlinNoise2D::computeOctaves()
+{
+    m_octaveFrequencies.resize(m_nbLayers);
+    m_octaveAmplitudes.resize(m_nbLayers);
+    m_noiseMax = 0.0f;
+
+    for (size_t i = 0; i < m_nbLayers; ++i)
+    {
+        float amplitude = float(pow(m_rateOffChanged, i));
+        m_octaveAmplitudes[i] = amplitude;
+        m_octaveFrequencies[i] = m_baseFrequency * amplitude * m_scaleFactor;
+        m_noiseMax += 1.0f / amplitude;
+    }
+}
+
 float PerlinNoise2D::smoothstep(float val) const
 {
     return val * val * (3.0f - 2.0f * val);
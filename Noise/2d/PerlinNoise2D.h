@@ -3,22 +3,48 @@
 //Math
 #include "../../../../../../Common_3/Utilities/Math/MathTypes.h"
 
+#include "../NoiseHash.h"
+
+#include "../NoiseSink.h"
+
 #include <vector>
 
 class PerlinNoise2D
 {
 public:
-    PerlinNoise2D(const IVector2& textureDim, const IVector2& kernelSize, std::size_t nbLayers, float scaleFactor, int randomSeed);
+    PerlinNoise2D(const IVector2& textureDim, const IVector2& kernelSize, std::size_t nbLayers, float scaleFactor, int randomSeed,
+        GradientHash gradientHash = GradientHash::Permutation);
     ~PerlinNoise2D();
 
 public:
-    std::vector<float> generateTexture();
-    float evaluate(uint32_t x, uint32_t y);
+    /// Stream every row of the texture to sink, rows are evaluated in parallel
+    void generate(NoiseSink& sink) const;
+    /// Stream the extent.x x extent.y texels starting at offset, the same values as these texels of generate().
+    /// Coordinates wrap around the texture, the rows reach the sink in region coordinates (row y of the region is row y, x0 0)
+    void generateRegion(const IVector2& offset, const IVector2& extent, NoiseSink& sink) const;
+    float evaluate(uint32_t x, uint32_t y) const;
+    /// Evaluate count consecutive pixels of row y starting at x0, same values as evaluate()
+    void evaluateRow(uint32_t y, uint32_t x0, uint32_t count, float* out) const;
+    /// evaluateRow with the octave count and the (power of two) kernel size fixed at compile time,
+    /// permutation hash and lacunarity of 2 only. Instantiated in the .cpp for the configurations used by the samples
+    template <std::size_t Octaves, int KernelSize>
+    void evaluateRowFixed(uint32_t y, uint32_t x0, uint32_t count, float* out) const;
 
 private:
-    float sample(float x, float y);
-    float computeNoiseValue(float x, float y) const;
+    /// Lattice cell of a coordinate along one axis
+    struct LatticeCoord
+    {
+        int r0;
+        int r1;
+        float t;
+        float s;
+    };
+
+    float sample(float x, float y) const;
+    float computeNoiseValue(const LatticeCoord& x, const LatticeCoord& y) const;
+    LatticeCoord computeLatticeCoord(float value, int kernelSize) const;
     void computeKernelDirection();
+    void computeOctaves();
     int hash(int x, int y) const;
     float smoothstep(float val) const;
     float interpolate(float min, float max, float value) const;
@@ -31,6 +57,12 @@ private:
     int m_randomSeed;
     float m_baseFrequency;
     float m_rateOffChanged;
+    GradientHash m_gradientHash;
+
+    // per octave frequency and amplitude, and the normalising sum of the octave weights
+    std::vector<float> m_octaveFrequencies;
+    std::vector<float> m_octaveAmplitudes;
+    float m_noiseMax;
 
     std::vector<vec2> m_kernelDirections;
     std::vector<int> m_permutationTable;
@@ -1,4 +1,7 @@
 #include "ValueNoise2D.h"
+#include "../NoiseRegion.h"
+
+#include "../NoiseParallel.h"
 
 #include <cmath> 
 #include <cstdio> 
@@ -24,29 +27,31 @@ ValueNoise2D::~ValueNoise2D()
 
 /* --------------------------------- Public methods --------------------------------- */
 
-std::vector<float> ValueNoise2D::generateTexture()
+void ValueNoise2D::generate(NoiseSink& sink) const
 {
-    std::vector<float> result;
-    int width = m_textureDim.getX();
-    int height = m_textureDim.getY();
-
-    result.resize(width * height);
-    for (int y = 0; y < height; y++) {
-        for (int x = 0; x < width; x++) {
-            float val = evaluate(x, y);
-            result[y * width + x] = val;
-        }
-    }
+    generateRegion(IVector2(0, 0), m_textureDim, sink);
+}
 
-    return result;
+void ValueNoise2D::generateRegion(const IVector2& offset, const IVector2& extent, NoiseSink& sink) const
+{
+    uint32_t width = extent.getX();
+
+    NoiseParallel::parallelFor(extent.getY(), [&](uint32_t y) {
+        std::vector<float> row(width);
+        uint32_t textureY = wrapRegionCoord(int64_t(offset.getY()) + y, m_textureDim.getY());
+        for (uint32_t x = 0; x < width; x++) {
+            row[x] = evaluate(wrapRegionCoord(int64_t(offset.getX()) + x, m_textureDim.getX()), textureY);
+        }
+        sink.writeRow(y, 0, 0, width, row.data());
+    });
 }
 
-float ValueNoise2D::evaluate(uint32_t x, uint32_t y)
+float ValueNoise2D::evaluate(uint32_t x, uint32_t y) const
 {
     return sample(float(x), float(y));
 }
 
-float ValueNoise2D::sample(float x, float y)
+float ValueNoise2D::sample(float x, float y) const
 {
     float brownianNoise = 0.0;
     float noiseMax = 0.0;
@@ -3,6 +3,8 @@
 //Math
 #include "../../../../../../Common_3/Utilities/Math/MathTypes.h"
 
+#include "../NoiseSink.h"
+
 #include <vector>
 
 class ValueNoise2D
@@ -12,11 +14,15 @@ public:
     ~ValueNoise2D();
 
 public:
-    std::vector<float> generateTexture();
-    float evaluate(uint32_t x, uint32_t y);
+    /// Stream every row of the texture to sink, rows are evaluated in parallel
+    void generate(NoiseSink& sink) const;
+    /// Stream the extent.x x extent.y texels starting at offset, the same values as these texels of generate().
+    /// Coordinates wrap around the texture, the rows reach the sink in region coordinates (row y of the region is row y, x0 0)
+    void generateRegion(const IVector2& offset, const IVector2& extent, NoiseSink& sink) const;
+    float evaluate(uint32_t x, uint32_t y) const;
 
 private:
-    float sample(float x, float y);
+    float sample(float x, float y) const;
     float computeNoiseValue(float x, float y) const;
     void computeKernel();
     float smoothstep(float val) const;
@@ -1,5 +1,9 @@
 #include "WorleyNoise2D.h"
+#include "../WorleyKernel.h"
+#include "../NoiseRegion.h"
+#include "../NoiseParallel.h"
 
+#include <algorithm>
 #include <cmath> 
 #include <cstdio> 
 #include <random> 
@@ -22,30 +26,27 @@ WorleyNoise2D::~WorleyNoise2D()
 
 /* --------------------------------- Public methods --------------------------------- */
 
-std::vector<float> WorleyNoise2D::generateTexture()
+void WorleyNoise2D::generate(NoiseSink& sink) const
 {
-    std::vector<float> result;
-    int width = m_dimension.getX();
-    int height = m_dimension.getY();
-    float invX = 1.0f / width;
-    float invY = 1.0f / height;
-
-    result.resize(width * height);
-    for (int y = 0; y < height; y++) {
-        int row = y / m_rowHeight;
-        float yoffset = (y - (row * m_rowHeight)) / float(m_rowHeight);
-        for (int x = 0; x < width; x++) {
-            int col = x / m_colWidth;
-            float xoffset = (x - (col * m_colWidth)) / float(m_colWidth);
-            float val = sample(row, col, vec2(xoffset, yoffset));
-            result[y * width + x] = val;
-        }
-    }
+    generateRegion(IVector2(0, 0), m_dimension, sink);
+}
 
-    return result;
+void WorleyNoise2D::generateRegion(const IVector2& offset, const IVector2& extent, NoiseSink& sink) const
+{
+    uint32_t width = extent.getX();
+    std::vector<NoiseRegionSpan> spans = splitRegionAxis(offset.getX(), width, m_dimension.getX());
+
+    NoiseParallel::parallelFor(extent.getY(), [&](uint32_t y) {
+        std::vector<float> row(width);
+        uint32_t textureY = wrapRegionCoord(int64_t(offset.getY()) + y, m_dimension.getY());
+        for (const NoiseRegionSpan& span : spans) {
+            evaluateSpan(textureY, span.src, span.count, &row[span.dst]);
+        }
+        sink.writeRow(y, 0, 0, width, row.data());
+    });
 }
 
-float WorleyNoise2D::evaluate(uint32_t x, uint32_t y)
+float WorleyNoise2D::evaluate(uint32_t x, uint32_t y) const
 {
     uint32_t row = y / m_rowHeight;
     uint32_t col = x / m_colWidth;
@@ -54,9 +55,50 @@ float WorleyNoise2D::evaluate(uint32_t x, uint32_t y)
     return sample(row, col, vec2(xoffset, yoffset));
 }
 
-float WorleyNoise2D::sample(int row, int col, const vec2& offset)
+void WorleyNoise2D::evaluateSpan(uint32_t y, uint32_t x0, uint32_t count, float* out) const
+{
+    uint32_t row = y / m_rowHeight;
+    float yoffset = (y - (row * m_rowHeight)) / float(m_rowHeight);
+
+    float pointX[9];
+    float pointRest[9];
+    uint32_t x = x0;
+    uint32_t end = x0 + count;
+    while (x < end) {
+        // every pixel until the end of the cell shares the same 9 feature points
+        uint32_t col = x / m_colWidth;
+        uint32_t cellEnd = std::min(uint32_t((col + 1) * m_colWidth), end);
+        gatherCell(row, col, yoffset, pointX, pointRest);
+        worleyMinDistanceSpan<9>(pointX, pointRest, col * m_colWidth, m_colWidth, x, cellEnd - x, out + (x - x0));
+        x = cellEnd;
+    }
+}
+
+float WorleyNoise2D::sample(int row, int col, const vec2& offset) const
 {
-    float minDist = 100.0f;
+    float pointX[9];
+    float pointRest[9];
+    gatherCell(row, col, offset.getY(), pointX, pointRest);
+
+    // compare squared distances, only the closest one needs a sqrt
+    float minDist = 10000.0f;
+    for (int i = 0; i < 9; i++) {
+        float dx = pointX[i] - offset.getX();
+        float dist = dx * dx + pointRest[i];
+        if (dist < minDist) {
+            minDist = dist;
+        }
+    }
+
+    minDist = min(std::sqrt(minDist), 1.0f);
+    return minDist;
+}
+
+/* --------------------------------- Private methods --------------------------------- */
+
+void WorleyNoise2D::gatherCell(int row, int col, float yoffset, float* pointX, float* pointRest) const
+{
+    int i = 0;
 
     // Sample 9 box around the currentPoint
     for (int y = -1; y <= 1; y++) {
@@ -68,21 +110,15 @@ float WorleyNoise2D::sample(int row, int col, const vec2& offset)
             sampledCol = sampledCol < 0 ? m_nbSubDiv - 1 : sampledCol;
             sampledCol = sampledCol >= m_nbSubDiv ? 0 : sampledCol;
             // current reference point in the [-1, 1] cube
-            vec2 pointPos = vec2(float(x), float(y));
-            pointPos += m_kernelData[sampledRow * m_nbSubDiv + sampledCol];
-            float dist = Vectormath::length(pointPos - offset);
-            if (dist < minDist) {
-                minDist = dist;
-            }
+            const vec2& point = m_kernelData[sampledRow * m_nbSubDiv + sampledCol];
+            float dy = (float(y) + point.getY()) - yoffset;
+            pointX[i] = float(x) + point.getX();
+            pointRest[i] = dy * dy;
+            i++;
         }
     }
-
-    minDist = min(minDist, 1.0f);
-    return minDist;
 }
 
-/* --------------------------------- Private methods --------------------------------- */
-
 void WorleyNoise2D::computeKernel()
 {
     std::mt19937 gen(m_randomSeed);
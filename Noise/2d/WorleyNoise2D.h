@@ -3,6 +3,8 @@
 //Math
 #include "../../../../../Common_3/Utilities/Math/MathTypes.h"
 
+#include "../NoiseSink.h"
+
 #include <vector>
 
 class WorleyNoise2D
@@ -12,11 +14,18 @@ public:
     ~WorleyNoise2D();
 
 public:
-    std::vector<float> generateTexture();
-    float evaluate(uint32_t x, uint32_t y);
+    /// Stream every row of the texture to sink, rows are evaluated in parallel
+    void generate(NoiseSink& sink) const;
+    /// Stream the extent.x x extent.y texels starting at offset, the same values as these texels of generate().
+    /// Coordinates wrap around the texture, the rows reach the sink in region coordinates (row y of the region is row y, x0 0)
+    void generateRegion(const IVector2& offset, const IVector2& extent, NoiseSink& sink) const;
+    float evaluate(uint32_t x, uint32_t y) const;
+    /// Evaluate count consecutive pixels of row y starting at x0, same values as evaluate()
+    void evaluateSpan(uint32_t y, uint32_t x0, uint32_t count, float* out) const;
 
 private:
-    float sample(int row, int col, const vec2& offset);
+    float sample(int row, int col, const vec2& offset) const;
+    void gatherCell(int row, int col, float yoffset, float* pointX, float* pointRest) const;
     void computeKernel();
 
 private:
@@ -1,5 +1,9 @@
 #include "PerlinNoise3D.h"
 
+#include "../NoiseOctaves.h"
+#include "../NoiseRegion.h"
+#include "../NoiseParallel.h"
+
 #include "../../../../../Common_3/Utilities/ThirdParty/OpenSource/EASTL/vector.h"
 
 #include <cmath> 
@@ -9,16 +13,19 @@
 
 #define PI 3.14159265358979323846f
 
-PerlinNoise3D::PerlinNoise3D(const IVector3& textureDim, uint32_t kernelSize, size_t nbLayers, float scaleFactor, int randomSeed) :
+PerlinNoise3D::PerlinNoise3D(const IVector3& textureDim, uint32_t kernelSize, size_t nbLayers, float scaleFactor, int randomSeed,
+    GradientHash gradientHash) :
     m_textureDim(textureDim),
     m_kernelSize(kernelSize),
     m_nbLayers(nbLayers),
     m_randomSeed(randomSeed),
     m_scaleFactor(scaleFactor),
     m_baseFrequency(0.05f),
-    m_rateOffChanged(2.0f)
+    m_rateOffChanged(2.0f),
+    m_gradientHash(gradientHash)
 {
     computeKernelDirection();
+    computeOctaves();
 }
 
 PerlinNoise3D::~PerlinNoise3D()
@@ -28,108 +35,222 @@ PerlinNoise3D::~PerlinNoise3D()
 
 /* --------------------------------- Public methods --------------------------------- */
 
-std::vector<float> PerlinNoise3D::generateTexture()
+void PerlinNoise3D::generate(NoiseSink& sink) const
+{
+    generateRegion(IVector3(0, 0, 0), m_textureDim, sink);
+}
+
+void PerlinNoise3D::generateRegion(const IVector3& offset, const IVector3& extent, NoiseSink& sink) const
 {
-    std::vector<float> result;
-    int width = m_textureDim.getX();
-    int height = m_textureDim.getY();
-    int depth = m_textureDim.getZ();
-    int pageSize = width * height;
-
-    result.resize(width * height * depth);
-    for (int z = 0; z < height; z++) {
-        for (int y = 0; y < height; y++) {
-            for (int x = 0; x < width; x++) {
-                float val = evaluate(x, y, z);
-                result[z * pageSize + y * width + x] = val;
+    uint32_t width = extent.getX();
+    uint32_t height = extent.getY();
+    std::vector<NoiseRegionSpan> spans = splitRegionAxis(offset.getX(), width, m_textureDim.getX());
+
+    NoiseParallel::parallelFor(extent.getZ(), [&](uint32_t z) {
+        std::vector<float> row(width);
+        uint32_t textureZ = wrapRegionCoord(int64_t(offset.getZ()) + z, m_textureDim.getZ());
+        for (uint32_t y = 0; y < height; y++) {
+            uint32_t textureY = wrapRegionCoord(int64_t(offset.getY()) + y, m_textureDim.getY());
+            for (const NoiseRegionSpan& span : spans) {
+                evaluateRow(textureY, textureZ, span.src, span.count, &row[span.dst]);
             }
+            sink.writeRow(y, z, 0, width, row.data());
+        }
+    });
+}
+
+float PerlinNoise3D::evaluate(uint32_t x, uint32_t y, uint32_t z) const
+{
+    return sample(float(x), float(y), float(z));
+}
+
+void PerlinNoise3D::evaluateRow(uint32_t y, uint32_t z, uint32_t x0, uint32_t count, float* out) const
+{
+    // specialised kernels of the configurations baked by ImageLoader
+    if (m_gradientHash == GradientHash::Permutation && m_rateOffChanged == 2.0f && m_kernelSize == 64)
+    {
+        switch (m_nbLayers)
+        {
+        case 3: evaluateRowFixed<3, 64>(y, z, x0, count, out); return;
+        default: break;
         }
     }
 
-    return result;
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        out[i] = 0.0f;
+    }
+
+    // octave major: the y and z lattice coordinates are shared by the whole row
+    for (size_t octave = 0; octave < m_nbLayers; ++octave)
+    {
+        float amplitude = m_octaveAmplitudes[octave];
+        float frequency = m_octaveFrequencies[octave];
+        LatticeCoord ly = computeLatticeCoord(float(y) * frequency);
+        LatticeCoord lz = computeLatticeCoord(float(z) * frequency);
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            LatticeCoord lx = computeLatticeCoord(float(x0 + i) * frequency);
+            out[i] += computeNoiseValue(lx, ly, lz) / amplitude;
+        }
+    }
+
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        out[i] = out[i] / m_noiseMax;
+    }
 }
 
-float PerlinNoise3D::evaluate(uint32_t x, uint32_t y, uint32_t z)
+template <std::size_t Octaves, int KernelSize>
+void PerlinNoise3D::evaluateRowFixed(uint32_t y, uint32_t z, uint32_t x0, uint32_t count, float* out) const
 {
-    return sample(float(x), float(y), float(z));
+    static_assert(KernelSize > 0 && (KernelSize & (KernelSize - 1)) == 0, "the lattice wraps with a mask");
+    constexpr int kernelMask = KernelSize - 1;
+    constexpr float noiseMax = fbmOctaveWeightSum(Octaves);
+
+    const int* permutation = m_permutationTable.data();
+    const vec3* directions = m_kernelDirections.data();
+
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        out[i] = 0.0f;
+    }
+
+    for (std::size_t octave = 0; octave < Octaves; ++octave)
+    {
+        // amplitudes are powers of two, so the multiplication matches the division of the generic path
+        const float weight = 1.0f / fbmOctaveAmplitude(octave);
+        const float frequency = m_octaveFrequencies[octave];
+
+        float vy = float(y) * frequency;
+        int yi = int(std::floor(vy));
+        float y0 = vy - yi, y1 = y0 - 1.0f;
+        float sy = smoothstep(y0);
+        int ry0 = yi & kernelMask;
+        int ry1 = (ry0 + 1) & kernelMask;
+
+        float vz = float(z) * frequency;
+        int zi = int(std::floor(vz));
+        float z0 = vz - zi, z1 = z0 - 1.0f;
+        float sz = smoothstep(z0);
+        int rz0 = zi & kernelMask;
+        int rz1 = (rz0 + 1) & kernelMask;
+
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            float vx = float(x0 + i) * frequency;
+            int xi = int(std::floor(vx));
+            float xt0 = vx - xi, xt1 = xt0 - 1.0f;
+            float sx = smoothstep(xt0);
+            int px0 = permutation[xi & kernelMask];
+            int px1 = permutation[((xi & kernelMask) + 1) & kernelMask];
+
+            int p00 = permutation[px0 + ry0], p10 = permutation[px1 + ry0];
+            int p01 = permutation[px0 + ry1], p11 = permutation[px1 + ry1];
+
+            float g000 = dot(directions[permutation[p00 + rz0]], vec3(xt0, y0, z0));
+            float g100 = dot(directions[permutation[p10 + rz0]], vec3(xt1, y0, z0));
+            float g010 = dot(directions[permutation[p01 + rz0]], vec3(xt0, y1, z0));
+            float g110 = dot(directions[permutation[p11 + rz0]], vec3(xt1, y1, z0));
+            float g001 = dot(directions[permutation[p00 + rz1]], vec3(xt0, y0, z1));
+            float g101 = dot(directions[permutation[p10 + rz1]], vec3(xt1, y0, z1));
+            float g011 = dot(directions[permutation[p01 + rz1]], vec3(xt0, y1, z1));
+            float g111 = dot(directions[permutation[p11 + rz1]], vec3(xt1, y1, z1));
+
+            float a = interpolate(g000, g100, sx);
+            float b = interpolate(g010, g110, sx);
+            float c = interpolate(g001, g101, sx);
+            float d = interpolate(g011, g111, sx);
+
+            float e = interpolate(a, b, sy);
+            float f = interpolate(c, d, sy);
+            out[i] += (interpolate(e, f, sz) + 1.0f) / 2.0f * weight;
+        }
+    }
+
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        out[i] = out[i] / noiseMax;
+    }
 }
 
-float PerlinNoise3D::sample(float x, float y, float z)
+template void PerlinNoise3D::evaluateRowFixed<3, 64>(uint32_t, uint32_t, uint32_t, uint32_t, float*) const;
+
+float PerlinNoise3D::sample(float x, float y, float z) const
 {
     float brownianNoise = 0.0;
-    float noiseMax = 0.0;
 
     for (size_t i = 0; i < m_nbLayers; ++i)
     {
-        float amplitude = float(pow(m_rateOffChanged, i));
-        float frequency = m_baseFrequency * amplitude * m_scaleFactor;
-        brownianNoise += computeNoiseValue(x * frequency, y * frequency, z * frequency) / amplitude;
-        noiseMax += 1.0f / amplitude;
+        float amplitude = m_octaveAmplitudes[i];
+        float frequency = m_octaveFrequencies[i];
+        LatticeCoord lx = computeLatticeCoord(x * frequency);
+        LatticeCoord ly = computeLatticeCoord(y * frequency);
+        LatticeCoord lz = computeLatticeCoord(z * frequency);
+        brownianNoise += computeNoiseValue(lx, ly, lz) / amplitude;
     }
-    brownianNoise = brownianNoise / noiseMax;
+    brownianNoise = brownianNoise / m_noiseMax;
     return brownianNoise;
 }
 
 /* --------------------------------- Private methods --------------------------------- */
 
-float PerlinNoise3D::computeNoiseValue(float x, float y, float z) const
+PerlinNoise3D::LatticeCoord PerlinNoise3D::computeLatticeCoord(float value) const
 {
-    int xi = int(std::floor(x));
-    int yi = int(std::floor(y));
-    int zi = int(std::floor(z));
-
-    float tx = x - xi;
-    float ty = y - yi;
-    float tz = z - zi;
-
-    int rx0 = xi % m_kernelSize;
-    int rx1 = (rx0 + 1) % m_kernelSize;
-    int ry0 = yi % m_kernelSize;
-    int ry1 = (ry0 + 1) % m_kernelSize;
-    int rz0 = zi % m_kernelSize;
-    int rz1 = (rz0 + 1) % m_kernelSize;
-
-    // gradients at the corner of the cell
-    const vec3& d000 = m_kernelDirections[hash(rx0, ry0, rz0)];
-    const vec3& d100 = m_kernelDirections[hash(rx1, ry0, rz0)];
-    const vec3& d010 = m_kernelDirections[hash(rx0, ry1, rz0)];
-    const vec3& d110 = m_kernelDirections[hash(rx1, ry1, rz0)];
-
-    const vec3& d001 = m_kernelDirections[hash(rx0, ry0, rz1)];
-    const vec3& d101 = m_kernelDirections[hash(rx1, ry0, rz1)];
-    const vec3& d011 = m_kernelDirections[hash(rx0, ry1, rz1)];
-    const vec3& d111 = m_kernelDirections[hash(rx1, ry1, rz1)];
+    LatticeCoord coord;
+    int vi = int(std::floor(value));
+    coord.t = value - vi;
+    coord.r0 = vi % m_kernelSize;
+    coord.r1 = (coord.r0 + 1) % m_kernelSize;
+    // remapping of t using the Smoothstep function 
+    coord.s = smoothstep(coord.t);
+    return coord;
+}
 
+float PerlinNoise3D::computeNoiseValue(const LatticeCoord& lx, const LatticeCoord& ly, const LatticeCoord& lz) const
+{
     // generate vectors going from the grid points to p
-    float x0 = tx, x1 = tx - 1;
-    float y0 = ty, y1 = ty - 1;
-    float z0 = tz, z1 = tz - 1;
-
-    vec3 p000 = vec3(x0, y0, z0);
-    vec3 p100 = vec3(x1, y0, z0);
-    vec3 p010 = vec3(x0, y1, z0);
-    vec3 p110 = vec3(x1, y1, z0);
+    float x0 = lx.t, x1 = lx.t - 1;
+    float y0 = ly.t, y1 = ly.t - 1;
+    float z0 = lz.t, z1 = lz.t - 1;
 
-    vec3 p001 = vec3(x0, y0, z1);
-    vec3 p101 = vec3(x1, y0, z1);
-    vec3 p011 = vec3(x0, y1, z1);
-    vec3 p111 = vec3(x1, y1, z1);
-
-    // remapping of tx and ty using the Smoothstep function 
-    float sx = smoothstep(tx);
-    float sy = smoothstep(ty);
-    float sz = smoothstep(tz);
+    float g000, g100, g010, g110, g001, g101, g011, g111;
+    if (m_gradientHash == GradientHash::Integer)
+    {
+        // gradients derived from the corner hash, no table lookups
+        uint32_t seed = uint32_t(m_randomSeed);
+        g000 = hashGradient3D(hashLattice(lx.r0, ly.r0, lz.r0, seed), x0, y0, z0);
+        g100 = hashGradient3D(hashLattice(lx.r1, ly.r0, lz.r0, seed), x1, y0, z0);
+        g010 = hashGradient3D(hashLattice(lx.r0, ly.r1, lz.r0, seed), x0, y1, z0);
+        g110 = hashGradient3D(hashLattice(lx.r1, ly.r1, lz.r0, seed), x1, y1, z0);
+        g001 = hashGradient3D(hashLattice(lx.r0, ly.r0, lz.r1, seed), x0, y0, z1);
+        g101 = hashGradient3D(hashLattice(lx.r1, ly.r0, lz.r1, seed), x1, y0, z1);
+        g011 = hashGradient3D(hashLattice(lx.r0, ly.r1, lz.r1, seed), x0, y1, z1);
+        g111 = hashGradient3D(hashLattice(lx.r1, ly.r1, lz.r1, seed), x1, y1, z1);
+    }
+    else
+    {
+        // gradients at the corner of the cell
+        g000 = dot(m_kernelDirections[hash(lx.r0, ly.r0, lz.r0)], vec3(x0, y0, z0));
+        g100 = dot(m_kernelDirections[hash(lx.r1, ly.r0, lz.r0)], vec3(x1, y0, z0));
+        g010 = dot(m_kernelDirections[hash(lx.r0, ly.r1, lz.r0)], vec3(x0, y1, z0));
+        g110 = dot(m_kernelDirections[hash(lx.r1, ly.r1, lz.r0)], vec3(x1, y1, z0));
+        g001 = dot(m_kernelDirections[hash(lx.r0, ly.r0, lz.r1)], vec3(x0, y0, z1));
+        g101 = dot(m_kernelDirections[hash(lx.r1, ly.r0, lz.r1)], vec3(x1, y0, z1));
+        g011 = dot(m_kernelDirections[hash(lx.r0, ly.r1, lz.r1)], vec3(x0, y1, z1));
+        g111 = dot(m_kernelDirections[hash(lx.r1, ly.r1, lz.r1)], vec3(x1, y1, z1));
+    }
 
-    float a = interpolate(dot(d000, p000), dot(d100, p100), sx);
-    float b = interpolate(dot(d010, p010), dot(d110, p110), sx);
-    float c = interpolate(dot(d001, p001), dot(d101, p101), sx);
-    float d = interpolate(dot(d011, p011), dot(d111, p111), sx);
+    float a = interpolate(g000, g100, lx.s);
+    float b = interpolate(g010, g110, lx.s);
+    float c = interpolate(g001, g101, lx.s);
+    float d = interpolate(g011, g111, lx.s);
 
-    float e = interpolate(a, b, sy);
-    float f = interpolate(c, d, sy);
+    float e = interpolate(a, b, ly.s);
+    float f = interpolate(c, d, ly.s);
 
     // linearly interpolate the nx0/nx1 along they y axis
-    return (interpolate(e, f, sz) + 1.0f) / 2.0f;
+    return (interpolate(e, f, lz.s) + 1.0f) / 2.0f;
 }
 
 void PerlinNoise3D::computeKernelDirection()
@@ -163,6 +284,21 @@ void PerlinNoise3D::computeKernelDirection()
     }
 }
 
+void PerlinNoise3D::computeOctaves()
+{
+    m_octaveFrequencies.resize(m_nbLayers);
+    m_octaveAmplitudes.resize(m_nbLayers);
+    m_noiseMax = 0.0f;
+
+    for (size_t i = 0; i < m_nbLayers; ++i)
+    {
+        float amplitude = float(pow(m_rateOffChanged, i));
+        m_octaveAmplitudes[i] = amplitude;
+        m_octaveFrequencies[i] = m_baseFrequency * amplitude * m_scaleFactor;
+        m_noiseMax += 1.0f / amplitude;
+    }
+}
+
 float PerlinNoise3D::smoothstep(float val) const
 {
     return val * val * (3.0f - 2.0f * val);
@@ -0,0 +1,78 @@
+#include "WorleyFBM3D.h"
+
+WorleyFBM3D::WorleyFBM3D(const IVector3& dimension, uint32_t nbChannels, int randomSeed) :
+    m_dimension(dimension),
+    m_nbChannels(nbChannels),
+    m_randomSeed(randomSeed)
+{
+
+}
+
+WorleyFBM3D::~WorleyFBM3D()
+{
+
+}
+
+/* --------------------------------- Public methods --------------------------------- */
+
+void WorleyFBM3D::addTerm(uint32_t nbSubdiv, float weight, uint32_t channel)
+{
+    uint32_t octave = 0;
+    while (octave < m_octaveSubdivs.size() && m_octaveSubdivs[octave] != nbSubdiv) {
+        octave++;
+    }
+
+    // first use of this subdivision
+    if (octave == m_octaveSubdivs.size()) {
+        m_octaveSubdivs.push_back(nbSubdiv);
+        m_octaves.emplace_back(m_dimension, nbSubdiv, m_randomSeed);
+    }
+
+    Term term;
+    term.octave = octave;
+    term.channel = channel;
+    term.weight = weight;
+    m_terms.push_back(term);
+}
+
+void WorleyFBM3D::evaluateSpan(uint32_t y, uint32_t z, uint32_t x0, uint32_t count, float* const* channels) const
+{
+    std::vector<float> octaveRows(m_octaves.size() * count);
+    for (size_t i = 0; i < m_octaves.size(); ++i) {
+        m_octaves[i].evaluateSpan(y, z, x0, count, &octaveRows[i * count]);
+    }
+
+    accumulate(octaveRows, count, channels);
+}
+
+void WorleyFBM3D::evaluateBlock(const IVector3& offset, const IVector3& extent, float* const* channels) const
+{
+    uint32_t count = uint32_t(extent.getX() * extent.getY() * extent.getZ());
+    std::vector<float> octaveBlocks(m_octaves.size() * count);
+    for (size_t i = 0; i < m_octaves.size(); ++i) {
+        m_octaves[i].evaluateBlock(offset, extent, &octaveBlocks[i * count]);
+    }
+
+    accumulate(octaveBlocks, count, channels);
+}
+
+/* --------------------------------- Private methods --------------------------------- */
+
+void WorleyFBM3D::accumulate(const std::vector<float>& octaveValues, uint32_t count, float* const* channels) const
+{
+    for (uint32_t c = 0; c < m_nbChannels; ++c) {
+        float* channel = channels[c];
+        for (uint32_t x = 0; x < count; ++x) {
+            channel[x] = 0.0f;
+        }
+    }
+
+    // terms are accumulated in insertion order so a channel matches the equivalent hand written sum
+    for (const Term& term : m_terms) {
+        const float* octave = &octaveValues[term.octave * count];
+        float* channel = channels[term.channel];
+        for (uint32_t x = 0; x < count; ++x) {
+            channel[x] += term.weight * octave[x];
+        }
+    }
+}
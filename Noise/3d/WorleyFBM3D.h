@@ -0,0 +1,44 @@
+#pragma once
+
+//Math
+#include "../../../../../../Common_3/Utilities/Math/MathTypes.h"
+
+#include "WorleyNoise3D.h"
+
+#include <vector>
+
+/// Weighted sums of Worley octaves written to several channels.
+/// Each octave (subdivision) is evaluated once per voxel and scattered to every channel using it.
+class WorleyFBM3D
+{
+public:
+    WorleyFBM3D(const IVector3& dimension, uint32_t nbChannels, int randomSeed);
+    ~WorleyFBM3D();
+
+public:
+    /// channel += weight * worley(nbSubdiv), terms of a channel are summed in the order they are added
+    void addTerm(uint32_t nbSubdiv, float weight, uint32_t channel);
+    /// channels[c] receives the count values of channel c for the (y, z) row starting at x0
+    void evaluateSpan(uint32_t y, uint32_t z, uint32_t x0, uint32_t count, float* const* channels) const;
+    /// Cell-major evaluation of a box, channels[c] receives a dense x-major block of extent voxels
+    void evaluateBlock(const IVector3& offset, const IVector3& extent, float* const* channels) const;
+
+private:
+    void accumulate(const std::vector<float>& octaveValues, uint32_t count, float* const* channels) const;
+
+private:
+    struct Term
+    {
+        uint32_t octave;
+        uint32_t channel;
+        float weight;
+    };
+
+    IVector3 m_dimension;
+    uint32_t m_nbChannels;
+    int m_randomSeed;
+
+    std::vector<WorleyNoise3D> m_octaves;
+    std::vector<uint32_t> m_octaveSubdivs;
+    std::vector<Term> m_terms;
+};
@@ -1,7 +1,11 @@
 #include "WorleyNoise3D.h"
+#include "../WorleyKernel.h"
+#include "../NoiseRegion.h"
+#include "../NoiseParallel.h"
 
 #include "../../../../../Common_3/Utilities/ThirdParty/OpenSource/EASTL/vector.h"
 
+#include <algorithm>
 #include <cmath> 
 #include <cstdio> 
 #include <random> 
@@ -16,6 +20,7 @@ WorleyNoise3D::WorleyNoise3D(const IVector3& dimension, uint32_t nbSubdiv, int r
     m_randomSeed(randomSeed)
 {
     computeKernel();
+    computeAxisTables();
 }
 
 WorleyNoise3D::~WorleyNoise3D()
@@ -25,39 +30,45 @@ WorleyNoise3D::~WorleyNoise3D()
 
 /* --------------------------------- Public methods --------------------------------- */
 
-std::vector<float> WorleyNoise3D::generateTexture()
+void WorleyNoise3D::generate(NoiseSink& sink) const
 {
-    std::vector<float> result;
-    int width = m_dimension.getX();
-    int height = m_dimension.getY();
-    int depth = m_dimension.getZ();
-    float invX = 1.0f / width;
-    float invY = 1.0f / height;
-    float invZ = 1.0f / depth;
-    int32_t pageSize = height * width;
+    generateRegion(IVector3(0, 0, 0), m_dimension, sink);
+}
 
-    result.resize(depth * width * height);
-    for (int z = 0; z < depth; z++) {
-        int slice = z / m_sliceDepth;
-        float zOffset = (z - (slice * m_sliceDepth)) / float(m_sliceDepth);
-
-        for (int y = 0; y < height; y++) {
-            int row = y / m_rowHeight;
-            float yoffset = (y - (row * m_rowHeight)) / float(m_rowHeight);
-
-            for (int x = 0; x < width; x++) {
-                int col = x / m_colWidth;
-                float xoffset = (x - (col * m_colWidth)) / float(m_colWidth);
-                float val = sample(slice, row, col, vec3(xoffset, yoffset, zOffset));
-                result[z * pageSize + y * width + x] = val;
+void WorleyNoise3D::generateRegion(const IVector3& offset, const IVector3& extent, NoiseSink& sink) const
+{
+    uint32_t width = extent.getX();
+    uint32_t height = extent.getY();
+    std::vector<NoiseRegionSpan> spansX = splitRegionAxis(offset.getX(), width, m_dimension.getX());
+    std::vector<NoiseRegionSpan> spansY = splitRegionAxis(offset.getY(), height, m_dimension.getY());
+
+    // cell-major bake of one slice at a time, one block per piece of the slice that doesn't wrap, then hand it over row by row
+    NoiseParallel::parallelFor(extent.getZ(), [&](uint32_t z) {
+        uint32_t textureZ = wrapRegionCoord(int64_t(offset.getZ()) + z, m_dimension.getZ());
+        std::vector<float> slice(width * height);
+        std::vector<float> block;
+        for (const NoiseRegionSpan& spanY : spansY) {
+            for (const NoiseRegionSpan& spanX : spansX) {
+                IVector3 blockOffset(spanX.src, spanY.src, textureZ);
+                IVector3 blockExtent(spanX.count, spanY.count, 1);
+                if (spansX.size() == 1) {
+                    evaluateBlock(blockOffset, blockExtent, &slice[spanY.dst * width]);
+                    continue;
+                }
+                block.resize(spanX.count * spanY.count);
+                evaluateBlock(blockOffset, blockExtent, block.data());
+                for (uint32_t y = 0; y < spanY.count; y++) {
+                    std::copy_n(&block[y * spanX.count], spanX.count, &slice[(spanY.dst + y) * width + spanX.dst]);
+                }
             }
         }
-    }
-
-    return result;
+        for (uint32_t y = 0; y < height; y++) {
+            sink.writeRow(y, z, 0, width, &slice[y * width]);
+        }
+    });
 }
 
-float WorleyNoise3D::evaluate(uint32_t x, uint32_t y, uint32_t z)
+float WorleyNoise3D::evaluate(uint32_t x, uint32_t y, uint32_t z) const
 {
     uint32_t slice = z / m_sliceDepth;
     uint32_t row = y / m_rowHeight;
@@ -68,10 +79,92 @@ float WorleyNoise3D::evaluate(uint32_t x, uint32_t y, uint32_t z)
     return sample(slice, row, col, vec3(xoffset, yoffset, zoffset));
 }
 
-float WorleyNoise3D::sample(int slice, int row, int col, const vec3& offset)
+void WorleyNoise3D::evaluateSpan(uint32_t y, uint32_t z, uint32_t x0, uint32_t count, float* out) const
+{
+    int32_t slice = m_cellZ[z];
+    int32_t row = m_cellY[y];
+
+    Neighbourhood neighbourhood;
+    float pointRest[27];
+    uint32_t x = x0;
+    uint32_t end = x0 + count;
+    while (x < end) {
+        // every voxel until the end of the cell shares the same 27 feature points
+        int32_t col = m_cellX[x];
+        uint32_t cellEnd = std::min(uint32_t((col + 1) * m_colWidth), end);
+        gatherNeighbourhood(slice, row, col, neighbourhood);
+        computeRest(neighbourhood, m_offsetY[y], m_offsetZ[z], pointRest);
+        worleyMinDistanceSpan<27>(neighbourhood.x, pointRest, col * m_colWidth, m_colWidth, x, cellEnd - x, out + (x - x0));
+        x = cellEnd;
+    }
+}
+
+void WorleyNoise3D::evaluateBlock(const IVector3& offset, const IVector3& extent, float* out) const
+{
+    int32_t x0 = offset.getX(), y0 = offset.getY(), z0 = offset.getZ();
+    int32_t x1 = x0 + extent.getX(), y1 = y0 + extent.getY(), z1 = z0 + extent.getZ();
+    int32_t rowStride = extent.getX();
+    int32_t sliceStride = extent.getX() * extent.getY();
+
+    Neighbourhood neighbourhood;
+    float pointRest[27];
+
+    // walk the runs of pixels sharing a cell on each axis
+    for (int32_t zStart = z0; zStart < z1;) {
+        int32_t slice = m_cellZ[zStart];
+        int32_t zEnd = std::min((slice + 1) * m_sliceDepth, z1);
+
+        for (int32_t yStart = y0; yStart < y1;) {
+            int32_t row = m_cellY[yStart];
+            int32_t yEnd = std::min((row + 1) * m_rowHeight, y1);
+
+            for (int32_t xStart = x0; xStart < x1;) {
+                int32_t col = m_cellX[xStart];
+                int32_t xEnd = std::min((col + 1) * m_colWidth, x1);
+                gatherNeighbourhood(slice, row, col, neighbourhood);
+
+                for (int32_t z = zStart; z < zEnd; z++) {
+                    for (int32_t y = yStart; y < yEnd; y++) {
+                        computeRest(neighbourhood, m_offsetY[y], m_offsetZ[z], pointRest);
+                        float* dst = out + (z - z0) * sliceStride + (y - y0) * rowStride + (xStart - x0);
+                        worleyMinDistanceSpan<27>(neighbourhood.x, pointRest, col * m_colWidth, m_colWidth, xStart, xEnd - xStart, dst);
+                    }
+                }
+                xStart = xEnd;
+            }
+            yStart = yEnd;
+        }
+        zStart = zEnd;
+    }
+}
+
+float WorleyNoise3D::sample(int slice, int row, int col, const vec3& offset) const
+{
+    Neighbourhood neighbourhood;
+    float pointRest[27];
+    gatherNeighbourhood(slice, row, col, neighbourhood);
+    computeRest(neighbourhood, offset.getY(), offset.getZ(), pointRest);
+
+    // compare squared distances, only the closest one needs a sqrt
+    float minDist = 10000.0f;
+    for (int i = 0; i < 27; i++) {
+        float dx = neighbourhood.x[i] - offset.getX();
+        float dist = dx * dx + pointRest[i];
+        if (dist < minDist) {
+            minDist = dist;
+        }
+    }
+
+    minDist = min(std::sqrt(minDist), 1.0f);
+    return minDist;
+}
+
+/* --------------------------------- Private methods --------------------------------- */
+
+void WorleyNoise3D::gatherNeighbourhood(int slice, int row, int col, Neighbourhood& neighbourhood) const
 {
-    float minDist = 100.0f;
     int32_t kernelPageSize = m_nbSubDiv * m_nbSubDiv;
+    int i = 0;
 
     // Sample 27 box around the currentPoint
     for (int z = -1; z <= 1; z++) {
@@ -89,21 +182,25 @@ float WorleyNoise3D::sample(int slice, int row, int col, const vec3& offset)
                 sampledCol = sampledCol < 0 ? m_nbSubDiv - 1 : sampledCol;
                 sampledCol = sampledCol >= m_nbSubDiv ? 0 : sampledCol;
                 // current reference point in the [-1, 1] cube
-                vec3 pointPos = vec3(float(x), float(y), float(z));
-                pointPos += m_kernelData[sampledSlice * kernelPageSize + sampledRow * m_nbSubDiv + sampledCol];
-                float dist = length(pointPos - offset);
-                if (dist < minDist) {
-                    minDist = dist;
-                }
+                const vec3& point = m_kernelData[sampledSlice * kernelPageSize + sampledRow * m_nbSubDiv + sampledCol];
+                neighbourhood.x[i] = float(x) + point.getX();
+                neighbourhood.y[i] = float(y) + point.getY();
+                neighbourhood.z[i] = float(z) + point.getZ();
+                i++;
             }
         }
     }
-
-    minDist = min(minDist, 1.0f);
-    return minDist;
 }
 
-/* --------------------------------- Private methods --------------------------------- */
+void WorleyNoise3D::computeRest(const Neighbourhood& neighbourhood, float yoffset, float zoffset, float* pointRest) const
+{
+    // squared distance along y and z, shared by the whole row of the cell
+    for (int i = 0; i < 27; i++) {
+        float dy = neighbourhood.y[i] - yoffset;
+        float dz = neighbourhood.z[i] - zoffset;
+        pointRest[i] = dy * dy + dz * dz;
+    }
+}
 
 void WorleyNoise3D::computeKernel()
 {
@@ -122,4 +219,30 @@ void WorleyNoise3D::computeKernel()
             }
         }
     }
+}
+
+void WorleyNoise3D::computeAxisTables()
+{
+    int width = m_dimension.getX();
+    int height = m_dimension.getY();
+    int depth = m_dimension.getZ();
+
+    m_cellX.resize(width);
+    for (int x = 0; x < width; x++) {
+        m_cellX[x] = x / m_colWidth;
+    }
+
+    m_cellY.resize(height);
+    m_offsetY.resize(height);
+    for (int y = 0; y < height; y++) {
+        m_cellY[y] = y / m_rowHeight;
+        m_offsetY[y] = (y - (m_cellY[y] * m_rowHeight)) / float(m_rowHeight);
+    }
+
+    m_cellZ.resize(depth);
+    m_offsetZ.resize(depth);
+    for (int z = 0; z < depth; z++) {
+        m_cellZ[z] = z / m_sliceDepth;
+        m_offsetZ[z] = (z - (m_cellZ[z] * m_sliceDepth)) / float(m_sliceDepth);
+    }
 }
\ No newline at end of file
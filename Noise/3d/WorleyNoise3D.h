@@ -3,6 +3,8 @@
 //Math
 #include "../../../../../Common_3/Utilities/Math/MathTypes.h"
 
+#include "../NoiseSink.h"
+
 #include <vector>
 
 class WorleyNoise3D
@@ -12,12 +14,32 @@ public:
     ~WorleyNoise3D();
 
 public:
-    std::vector<float> generateTexture();
-    float evaluate(uint32_t x, uint32_t y, uint32_t z);
+    /// Stream every row of the volume to sink, slices are evaluated in parallel
+    void generate(NoiseSink& sink) const;
+    /// Stream the extent voxels starting at offset, the same values as these voxels of generate().
+    /// Coordinates wrap around the volume, the rows reach the sink in region coordinates
+    void generateRegion(const IVector3& offset, const IVector3& extent, NoiseSink& sink) const;
+    float evaluate(uint32_t x, uint32_t y, uint32_t z) const;
+    /// Evaluate count consecutive voxels of the (y, z) row starting at x0, same values as evaluate()
+    void evaluateSpan(uint32_t y, uint32_t z, uint32_t x0, uint32_t count, float* out) const;
+    /// Cell-major evaluation of the [offset, offset + extent) box into a dense x-major block.
+    /// The neighbourhood of a cell is gathered once and reused by all the voxels of the cell inside the box.
+    void evaluateBlock(const IVector3& offset, const IVector3& extent, float* out) const;
 
 private:
-    float sample(int row, int col, int depth, const vec3& offset);
+    /// Feature points of the 27 cells around a cell, relative to that cell
+    struct Neighbourhood
+    {
+        float x[27];
+        float y[27];
+        float z[27];
+    };
+
+    float sample(int row, int col, int depth, const vec3& offset) const;
+    void gatherNeighbourhood(int slice, int row, int col, Neighbourhood& neighbourhood) const;
+    void computeRest(const Neighbourhood& neighbourhood, float yoffset, float zoffset, float* pointRest) const;
     void computeKernel();
+    void computeAxisTables();
 
 private:
     IVector3 m_dimension;
@@ -28,5 +50,12 @@ private:
     int m_randomSeed;
 
     std::vector<vec3> m_kernelData;
+
+    // pixel -> cell index and fractional offset inside the cell, per axis
+    std::vector<int32_t> m_cellX;
+    std::vector<int32_t> m_cellY;
+    std::vector<int32_t> m_cellZ;
+    std::vector<float> m_offsetY;
+    std::vector<float> m_offsetZ;
 };
 
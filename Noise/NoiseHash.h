@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+
+/// How the gradient noises pick the gradient of a lattice corner
+enum class GradientHash
+{
+    /// Double indirection through a shuffled permutation table, then a lookup in the random directions
+    Permutation,
+    /// Arithmetic hash of the corner coordinates, the gradient is derived from its bits (no table access)
+    Integer,
+};
+
+/// Integer hash of a lattice corner, avalanche finaliser of the lowbias32 family
+inline uint32_t hashLattice(uint32_t x, uint32_t y, uint32_t z, uint32_t seed)
+{
+    uint32_t h = seed;
+    h ^= x * 0x8da6b343u;
+    h ^= y * 0xd8163841u;
+    h ^= z * 0xcb1ab31fu;
+    h ^= h >> 16;
+    h *= 0x7feb352du;
+    h ^= h >> 15;
+    h *= 0x846ca68bu;
+    h ^= h >> 16;
+    return h;
+}
+
+/// Dot product with one of 8 unit gradients (axes and diagonals) chosen by the low bits of the hash
+inline float hashGradient2D(uint32_t hash, float x, float y)
+{
+    const float diagonal = 0.70710678f;
+    float u = (hash & 1) ? -1.0f : 1.0f;
+    float v = (hash & 2) ? -1.0f : 1.0f;
+    float gx = (hash & 4) ? u * diagonal : ((hash & 8) ? u : 0.0f);
+    float gy = (hash & 4) ? v * diagonal : ((hash & 8) ? 0.0f : v);
+    return gx * x + gy * y;
+}
+
+/// Dot product with one of the 12 cube edge gradients of improved Perlin noise, rescaled to unit length
+inline float hashGradient3D(uint32_t hash, float x, float y, float z)
+{
+    const float invSqrt2 = 0.70710678f;
+    uint32_t h = hash & 15;
+    float u = h < 8 ? x : y;
+    float v = h < 4 ? y : (h == 12 || h == 14 ? x : z);
+    return (((h & 1) ? -u : u) + ((h & 2) ? -v : v)) * invSqrt2;
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstddef>
+
+/// Amplitude divisor of an fbm octave when the frequency doubles at each octave (lacunarity of 2)
+constexpr float fbmOctaveAmplitude(std::size_t octave)
+{
+    return float(1u << octave);
+}
+
+/// Sum of the octave weights 1 / amplitude, in the same order as the runtime loop so the result is identical
+constexpr float fbmOctaveWeightSum(std::size_t nbOctaves)
+{
+    float sum = 0.0f;
+    for (std::size_t i = 0; i < nbOctaves; ++i)
+    {
+        sum += 1.0f / fbmOctaveAmplitude(i);
+    }
+    return sum;
+}
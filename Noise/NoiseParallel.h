@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+
+/// Parallel loop of the generators, so Noise/ doesn't depend on any scheduler.
+/// The loops run serially until the application installs its own (Utils/TaskScheduler does in init),
+/// the tasks of different indices may then run concurrently.
+class NoiseParallel
+{
+public:
+    typedef void (*ParallelForFunc)(uint32_t count, const std::function<void(uint32_t)>& task);
+
+    /// NULL restores the serial loop
+    static void setParallelFor(ParallelForFunc pParallelFor) { getParallelForFunc() = pParallelFor; }
+
+    /// Run task(0) ... task(count - 1) and return once all of them are done
+    static void parallelFor(uint32_t count, const std::function<void(uint32_t)>& task)
+    {
+        ParallelForFunc pParallelFor = getParallelForFunc();
+        if (pParallelFor)
+        {
+            pParallelFor(count, task);
+            return;
+        }
+        for (uint32_t i = 0; i < count; ++i)
+            task(i);
+    }
+
+private:
+    static ParallelForFunc& getParallelForFunc()
+    {
+        static ParallelForFunc s_pParallelFor = NULL;
+        return s_pParallelFor;
+    }
+};
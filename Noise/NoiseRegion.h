@@ -0,0 +1,37 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+/// Run of texels of a region along one axis that are consecutive in the texture
+struct NoiseRegionSpan
+{
+    /// first texel in the texture, in [0, size)
+    uint32_t src;
+    /// first texel in the region
+    uint32_t dst;
+    uint32_t count;
+};
+
+/// Texel of the texture a coordinate lands on, coordinates wrap around the texture in both directions
+inline uint32_t wrapRegionCoord(int64_t coord, uint32_t size)
+{
+    int64_t wrapped = coord % int64_t(size);
+    return uint32_t(wrapped < 0 ? wrapped + size : wrapped);
+}
+
+/// Split the [offset, offset + extent) coordinates of a region along an axis of size texels into runs of consecutive texels
+inline std::vector<NoiseRegionSpan> splitRegionAxis(int32_t offset, uint32_t extent, uint32_t size)
+{
+    std::vector<NoiseRegionSpan> spans;
+    uint32_t dst = 0;
+    while (dst < extent)
+    {
+        uint32_t src = wrapRegionCoord(int64_t(offset) + dst, size);
+        uint32_t count = std::min(extent - dst, size - src);
+        spans.push_back({ src, dst, count });
+        dst += count;
+    }
+    return spans;
+}
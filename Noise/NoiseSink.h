@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstdint>
+
+/// Destination of the values produced by the generators and the bakes.
+/// Rows are handed over as soon as they are evaluated, the sink converts them straight into its own storage
+/// so no full resolution float copy of the texture is ever made.
+/// Different rows are written concurrently and may arrive in any order.
+class NoiseSink
+{
+public:
+    virtual ~NoiseSink() {}
+
+    /// channels[c] holds the count values of channel c for the (y, z) row starting at x0, only valid during the call
+    virtual void writeChannels(uint32_t y, uint32_t z, uint32_t x0, uint32_t count, const float* const* channels, uint32_t channelCount) = 0;
+
+    /// Single channel row
+    void writeRow(uint32_t y, uint32_t z, uint32_t x0, uint32_t count, const float* values)
+    {
+        writeChannels(y, z, x0, count, &values, 1);
+    }
+};
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <cstdint>
+
+/// Algorithm version of each generator. Bump it whenever the output of a generator changes for the same
+/// parameters (new hash, different summation order...), baked textures keyed on it are then regenerated.
+struct NoiseVersion
+{
+    static const uint32_t PerlinNoise2D = 1;
+    static const uint32_t PerlinNoise3D = 1;
+    static const uint32_t WorleyNoise2D = 1;
+    static const uint32_t WorleyNoise3D = 1;
+    static const uint32_t BlueNoise2D = 1;
+};
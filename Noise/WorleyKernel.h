@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cstdint>
+#include <cmath>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define WORLEY_KERNEL_AVX2 1
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define WORLEY_KERNEL_SSE2 1
+#endif
+
+/// Shared inner loop of the Worley generators.
+/// All the pixels of [xBegin, xBegin + count) lie in the same cell (starting at cellStart, cellWidth pixels wide),
+/// so they are compared against the same feature points. For each feature point pointX holds its x coordinate in
+/// cell space and pointRest the already squared distance along the other axes.
+/// Squared distances are compared and only the closest one goes through a sqrt.
+/// PointCount is 9 (2D) or 27 (3D), known at compile time so the feature point loop is fully unrolled.
+template <uint32_t PointCount>
+inline void worleyMinDistanceSpan(const float* pointX, const float* pointRest,
+    int32_t cellStart, int32_t cellWidth, int32_t xBegin, uint32_t count, float* out)
+{
+    const float cellSize = float(cellWidth);
+    uint32_t i = 0;
+
+#if defined(WORLEY_KERNEL_AVX2)
+    const __m256 vCellSize = _mm256_set1_ps(cellSize);
+    const __m256i vLane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    for (; i < count; i += 8)
+    {
+        __m256i vLocal = _mm256_add_epi32(_mm256_set1_epi32(xBegin + int32_t(i) - cellStart), vLane);
+        __m256 vOffset = _mm256_div_ps(_mm256_cvtepi32_ps(vLocal), vCellSize);
+        __m256 vMin = _mm256_set1_ps(10000.0f);
+        for (uint32_t p = 0; p < PointCount; ++p)
+        {
+            __m256 vDx = _mm256_sub_ps(_mm256_set1_ps(pointX[p]), vOffset);
+            __m256 vDist = _mm256_add_ps(_mm256_mul_ps(vDx, vDx), _mm256_set1_ps(pointRest[p]));
+            vMin = _mm256_min_ps(vMin, vDist);
+        }
+        vMin = _mm256_min_ps(_mm256_sqrt_ps(vMin), _mm256_set1_ps(1.0f));
+        if (count - i >= 8)
+        {
+            _mm256_storeu_ps(out + i, vMin);
+        }
+        else
+        {
+            alignas(32) float tail[8];
+            _mm256_store_ps(tail, vMin);
+            for (uint32_t t = 0; t < count - i; ++t)
+                out[i + t] = tail[t];
+        }
+    }
+#elif defined(WORLEY_KERNEL_SSE2)
+    const __m128 vCellSize = _mm_set1_ps(cellSize);
+    const __m128i vLane = _mm_setr_epi32(0, 1, 2, 3);
+    for (; i < count; i += 4)
+    {
+        __m128i vLocal = _mm_add_epi32(_mm_set1_epi32(xBegin + int32_t(i) - cellStart), vLane);
+        __m128 vOffset = _mm_div_ps(_mm_cvtepi32_ps(vLocal), vCellSize);
+        __m128 vMin = _mm_set1_ps(10000.0f);
+        for (uint32_t p = 0; p < PointCount; ++p)
+        {
+            __m128 vDx = _mm_sub_ps(_mm_set1_ps(pointX[p]), vOffset);
+            __m128 vDist = _mm_add_ps(_mm_mul_ps(vDx, vDx), _mm_set1_ps(pointRest[p]));
+            vMin = _mm_min_ps(vMin, vDist);
+        }
+        vMin = _mm_min_ps(_mm_sqrt_ps(vMin), _mm_set1_ps(1.0f));
+        if (count - i >= 4)
+        {
+            _mm_storeu_ps(out + i, vMin);
+        }
+        else
+        {
+            alignas(16) float tail[4];
+            _mm_store_ps(tail, vMin);
+            for (uint32_t t = 0; t < count - i; ++t)
+                out[i + t] = tail[t];
+        }
+    }
+#else
+    for (; i < count; ++i)
+    {
+        float offset = float(xBegin + int32_t(i) - cellStart) / cellSize;
+        float minDist = 10000.0f;
+        for (uint32_t p = 0; p < PointCount; ++p)
+        {
+            float dx = pointX[p] - offset;
+            float dist = dx * dx + pointRest[p];
+            minDist = dist < minDist ? dist : minDist;
+        }
+        minDist = std::sqrt(minDist);
+        out[i] = minDist < 1.0f ? minDist : 1.0f;
+    }
+#endif
+}
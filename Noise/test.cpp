@@ -1,4 +1,4 @@
-#include "PerlinNoise2D.h"
+#include "test.h"
 
 #include <cmath> 
 #include <cstdio> 
@@ -46,21 +46,21 @@ unsigned char perm[512] = {
 	50,  45,  127, 4,   150, 254, 138, 236, 205, 93,  222, 114, 67,  29,  24,  72,  243, 141, 128, 195, 78,  66,  215, 61,  156, 180
 };
 
-PerlinNoise2D::PerlinNoise2D(const IVector2& dimension, float noiseScale):
+SimplexNoise2D::SimplexNoise2D(const IVector2& dimension, float noiseScale):
     m_dimension(dimension),
 	m_noiseScale(noiseScale)
 {
 
 }
 
-PerlinNoise2D::~PerlinNoise2D()
+SimplexNoise2D::~SimplexNoise2D()
 {
 
 }
 
 /* --------------------------------- Public methods --------------------------------- */
 
-float PerlinNoise2D::evaluate(uint32_t xPixel, uint32_t yPixel)
+float SimplexNoise2D::evaluate(uint32_t xPixel, uint32_t yPixel)
 {
 
 	float x = float(xPixel) * m_noiseScale;
@@ -150,7 +150,7 @@ float PerlinNoise2D::evaluate(uint32_t xPixel, uint32_t yPixel)
 
 /* --------------------------------- Private methods --------------------------------- */
 
-float PerlinNoise2D::grad2(int hash, float x, float y)
+float SimplexNoise2D::grad2(int hash, float x, float y)
 {
 	int   h = hash & 7;         // Convert low 3 bits of hash code
 	float u = h < 4 ? x : y;    // into 8 simple gradient directions,
@@ -5,11 +5,11 @@
 
 #include <vector>
 
-class PerlinNoise2D
+class SimplexNoise2D
 {
 public:
-    PerlinNoise2D(const IVector2& dimension, float noiseScale);
-    ~PerlinNoise2D();
+    SimplexNoise2D(const IVector2& dimension, float noiseScale);
+    ~SimplexNoise2D();
 
 public:
     float evaluate(uint32_t xPixel, uint32_t yPixel);
@@ -0,0 +1,60 @@
+#include "CloudLightTexture.h"
+#include "CloudLightVolume.h"
+#include "ImageLoader.h"
+
+/* --------------------------------- Public methods --------------------------------- */
+
+CloudLightTexture::CloudLightTexture() :
+	m_ppTexture(NULL),
+	m_pTextures{ NULL, NULL },
+	m_current(0),
+	m_syncToken(),
+	m_uploading(false)
+{
+}
+
+void CloudLightTexture::init(const CloudLightVolume& volume, Texture** ppTexture)
+{
+	exit();
+
+	m_ppTexture = ppTexture;
+	m_current = 0;
+	ImageLoader::genCloudLightTexture(volume, &m_pTextures[0]);
+	ImageLoader::genCloudLightTexture(volume, &m_pTextures[1]);
+	*m_ppTexture = m_pTextures[m_current];
+}
+
+void CloudLightTexture::exit()
+{
+	if (!m_ppTexture)
+		return;
+
+	waitForToken(&m_syncToken);
+	m_uploading = false;
+	*m_ppTexture = NULL;
+	m_ppTexture = NULL;
+	for (Texture*& pTexture : m_pTextures)
+	{
+		removeResource(pTexture);
+		pTexture = NULL;
+	}
+}
+
+void CloudLightTexture::upload(const CloudLightVolume& volume)
+{
+	// the idle texture isn't sampled, a pending upload to it is simply followed by this one
+	m_syncToken = {};
+	ImageLoader::updateCloudLightTexture(volume, &m_pTextures[1 - m_current], &m_syncToken);
+	m_uploading = true;
+}
+
+bool CloudLightTexture::update()
+{
+	if (!m_uploading || !isTokenCompleted(&m_syncToken))
+		return false;
+
+	m_current = 1 - m_current;
+	*m_ppTexture = m_pTextures[m_current];
+	m_uploading = false;
+	return true;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "../../../../../Common_3/Resources/ResourceLoader/Interfaces/IResourceLoader.h"
+
+#include <cstdint>
+
+struct Texture;
+class CloudLightVolume;
+
+/// GPU copy of a CloudLightVolume refreshed while frames are in flight (LIGHT_VOLUME). Two R16F volumes: the one published
+/// to the caller's texture pointer is only read, a new volume is uploaded into the other one and swapped in once the
+/// SyncToken of its upload completes, like the textures of NoiseBakeQueue.
+/// The texture swapped out receives the next upload: the caller must be done with it by then, the descriptors updated and
+/// the frames still sampling it completed (the sample waits for the queue when update() returns true).
+class CloudLightTexture
+{
+public:
+    CloudLightTexture();
+
+public:
+    /// Creates both textures at the size of volume, the one published to *ppTexture holds volume
+    void init(const CloudLightVolume& volume, Texture** ppTexture);
+    /// Waits for the upload in progress, removes both textures and sets the published pointer to NULL
+    void exit();
+
+    /// Upload the volume in use into the idle texture, typically once CloudLightVolume::update completed a new one.
+    /// An upload still in progress is replaced
+    void upload(const CloudLightVolume& volume);
+    /// Main thread, once per frame. True when an upload completed and the published pointer switched to its texture: the
+    /// descriptors referencing it must be updated
+    bool update();
+    bool isUploading() const { return m_uploading; }
+
+private:
+    Texture** m_ppTexture;
+    Texture* m_pTextures[2];
+    /// Index of the published texture in m_pTextures
+    uint32_t m_current;
+    SyncToken m_syncToken;
+    bool m_uploading;
+};
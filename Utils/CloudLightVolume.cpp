@@ -0,0 +1,126 @@
+#include "CloudLightVolume.h"
+#include "CloudMarcher.h"
+#include "NoiseSinks.h"
+#include "TaskScheduler.h"
+
+#include <algorithm>
+#include <cmath>
+
+// the lod of the light samples of the march (LIGHT_SAMPLE_LOD)
+static const float kSampleLod = 1.0f;
+
+/* --------------------------------- Public methods --------------------------------- */
+
+CloudLightVolume::CloudLightVolume(uint32_t width, uint32_t height, uint32_t depth) :
+	m_width(width),
+	m_height(height),
+	m_depth(depth),
+	m_opticalDepth(size_t(width) * height * depth, 0.0f),
+	m_valid(false),
+	m_pMarcher(NULL),
+	m_nextSlice(0),
+	m_densityFetches(0)
+{
+}
+
+void CloudLightVolume::beginUpdate(const CloudMarcher& marcher)
+{
+	// a pending update is dropped, its sun or cloud are outdated
+	m_pMarcher = &marcher;
+	m_nextOpticalDepth.assign(m_opticalDepth.size(), 0.0f);
+	m_nextFetches.assign(m_opticalDepth.size(), 0);
+	m_nextSlice = 0;
+}
+
+bool CloudLightVolume::update(uint32_t sliceCount)
+{
+	if (!m_pMarcher)
+		return false;
+
+	uint32_t endSlice = std::min(m_depth, m_nextSlice + std::max(1u, sliceCount));
+	uint32_t rowCount = (endSlice - m_nextSlice) * m_height;
+	TaskScheduler::parallelFor(rowCount, [&](uint32_t row)
+	{
+		uint32_t z = m_nextSlice + row / m_height;
+		uint32_t y = row % m_height;
+		size_t offset = (size_t(z) * m_height + y) * m_width;
+		for (uint32_t x = 0; x < m_width; ++x)
+			m_nextOpticalDepth[offset + x] = computeOpticalDepth(x, y, z, m_nextFetches[offset + x]);
+	});
+	m_nextSlice = endSlice;
+	if (m_nextSlice < m_depth)
+		return false;
+
+	m_opticalDepth.swap(m_nextOpticalDepth);
+	m_densityFetches = 0;
+	for (uint32_t fetchCount : m_nextFetches)
+		m_densityFetches += fetchCount;
+	m_valid = true;
+	m_pMarcher = NULL;
+	return true;
+}
+
+void CloudLightVolume::build(const CloudMarcher& marcher)
+{
+	beginUpdate(marcher);
+	update(m_depth);
+}
+
+float CloudLightVolume::getOpticalDepth(const vec3& uv) const
+{
+	// cell centers are at half integers, the coordinates are clamped to the centers of the edge cells
+	const uint32_t sizes[3] = { m_width, m_height, m_depth };
+	uint32_t i0[3], i1[3];
+	float weights[3];
+	for (uint32_t axis = 0; axis < 3; ++axis)
+	{
+		float cell = std::min(std::max(uv[axis] * float(sizes[axis]) - 0.5f, 0.0f), float(sizes[axis] - 1));
+		float base = std::floor(cell);
+		i0[axis] = uint32_t(base);
+		i1[axis] = std::min(i0[axis] + 1, sizes[axis] - 1);
+		weights[axis] = cell - base;
+	}
+
+	float value = 0.0f;
+	for (uint32_t corner = 0; corner < 8; ++corner)
+	{
+		uint32_t x = corner & 1 ? i1[0] : i0[0];
+		uint32_t y = corner & 2 ? i1[1] : i0[1];
+		uint32_t z = corner & 4 ? i1[2] : i0[2];
+		float weight = (corner & 1 ? weights[0] : 1.0f - weights[0]) * (corner & 2 ? weights[1] : 1.0f - weights[1]) *
+			(corner & 4 ? weights[2] : 1.0f - weights[2]);
+		value += weight * m_opticalDepth[(size_t(z) * m_height + y) * m_width + x];
+	}
+	return value;
+}
+
+std::vector<uint16_t> CloudLightVolume::getTexels() const
+{
+	std::vector<uint16_t> texels(m_opticalDepth.size());
+	for (size_t i = 0; i < m_opticalDepth.size(); ++i)
+		texels[i] = floatToHalf(m_opticalDepth[i]);
+	return texels;
+}
+
+/* --------------------------------- Private methods --------------------------------- */
+
+float CloudLightVolume::computeOpticalDepth(uint32_t x, uint32_t y, uint32_t z, uint32_t& fetchCount) const
+{
+	const CloudMarchParams& params = m_pMarcher->getParams();
+	vec3 boxSize = params.boxMax - params.boxMin;
+	vec3 uv = vec3((float(x) + 0.5f) / float(m_width), (float(y) + 0.5f) / float(m_height), (float(z) + 0.5f) / float(m_depth));
+	vec3 pos = params.boxMin + mulPerElem(uv, boxSize);
+	vec3 toSun = -params.sunDir;
+	vec3 invToSun = vec3(1.0f / toSun.getX(), 1.0f / toSun.getY(), 1.0f / toSun.getZ());
+	float distance = CloudMarcher::rayBoxDst(params.boxMin, params.boxMax, pos, invToSun).getY();
+
+	// midpoint rule, steps of half the smallest cell side
+	float cellSide = minElem(divPerElem(boxSize, vec3(float(m_width), float(m_height), float(m_depth))));
+	uint32_t stepCount = std::max(1u, uint32_t(std::ceil(distance / (cellSide * 0.5f))));
+	float step = distance / float(stepCount);
+	float densitySum = 0.0f;
+	for (uint32_t i = 0; i < stepCount; ++i)
+		densitySum += m_pMarcher->sampleCloudDensity(pos + toSun * (step * (float(i) + 0.5f)), kSampleLod);
+	fetchCount = stepCount;
+	return densitySum * step;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+//Math
+#include "../../../../../Common_3/Utilities/Math/MathTypes.h"
+
+#include <cstdint>
+#include <vector>
+
+class CloudMarcher;
+
+/// Optical depth toward the sun over a coarse grid spanning the cloud box: the integral of the density the march samples
+/// from the center of each cell to the box, along -sunDir. The march then reads the light reaching a sample with one
+/// trilinear lookup (LIGHT_VOLUME) instead of a nested march of nbLightSamples density fetches.
+/// The volume depends on the sun direction and on the cloud (textures and params of the marcher), it is recomputed in the
+/// background when they change: beginUpdate() then a few slices per frame with update(), the previous volume stays in
+/// use until the new one is complete. Cells are independent, the result doesn't depend on the worker count.
+class CloudLightVolume
+{
+public:
+    /// width x height x depth cells spanning the box, a few dozen per axis is enough for the soft light of the clouds
+    CloudLightVolume(uint32_t width, uint32_t height, uint32_t depth);
+
+public:
+    /// Start a new volume for the sun and the cloud of marcher, which must outlive the update
+    void beginUpdate(const CloudMarcher& marcher);
+    /// Compute up to sliceCount more z slices, their cells in parallel on the TaskScheduler.
+    /// True when this call completed the volume, it then replaces the one in use
+    bool update(uint32_t sliceCount);
+    /// Whole update at once
+    void build(const CloudMarcher& marcher);
+    bool isUpdating() const { return m_pMarcher != NULL; }
+    /// A complete volume is in use
+    bool isValid() const { return m_valid; }
+
+    /// Optical depth at the box uv, trilinear between the cell centers and clamped to the edge cells.
+    /// Mirrors the LIGHT_VOLUME lookup of PS_MAIN
+    float getOpticalDepth(const vec3& uv) const;
+
+    uint32_t getWidth() const { return m_width; }
+    uint32_t getHeight() const { return m_height; }
+    uint32_t getDepth() const { return m_depth; }
+    /// Volume in use as R16F texels
+    std::vector<uint16_t> getTexels() const;
+    /// Density fetches of a whole update
+    uint64_t getDensityFetches() const { return m_densityFetches; }
+
+private:
+    /// Integral of the density from the center of the cell to the box, toward the sun
+    float computeOpticalDepth(uint32_t x, uint32_t y, uint32_t z, uint32_t& fetchCount) const;
+
+private:
+    uint32_t m_width;
+    uint32_t m_height;
+    uint32_t m_depth;
+    std::vector<float> m_opticalDepth;
+    bool m_valid;
+
+    // -------- update in progress
+    const CloudMarcher* m_pMarcher;
+    std::vector<float> m_nextOpticalDepth;
+    std::vector<uint32_t> m_nextFetches;
+    uint32_t m_nextSlice;
+    uint64_t m_densityFetches;
+};
@@ -0,0 +1,447 @@
+#include "CloudMarcher.h"
+#include "CloudOccupancyGrid.h"
+#include "CloudLightVolume.h"
+#include "NoiseBrickVolume.h"
+#include "NoiseBaker.h"
+#include "NoiseSampler.h"
+#include "TaskScheduler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#define M_PI_F 3.14159265359f
+// light samples only feed an exponential extinction, a coarser level of the noise is enough
+static const float kLightSampleLod = 1.0f;
+// pixels of a tile side, a tile is marched by a single task
+static const uint32_t kTileSize = 16;
+
+static float hermiteInterpolation(float x, float min, float max)
+{
+	float t = saturate((x - min) / (max - min));
+	return t * t * (3.0f - 2.0f * t);
+}
+
+/* --------------------------------- Stats --------------------------------- */
+
+void CloudMarchStats::merge(const CloudMarchStats& other)
+{
+	pixelCount += other.pixelCount;
+	hitCount += other.hitCount;
+	raySteps += other.raySteps;
+	lightSteps += other.lightSteps;
+	densityFetches += other.densityFetches;
+}
+
+double CloudMarchStats::getRayStepsPerPixel() const
+{
+	return pixelCount > 0 ? double(raySteps) / double(pixelCount) : 0.0;
+}
+
+double CloudMarchStats::getLightStepsPerPixel() const
+{
+	return pixelCount > 0 ? double(lightSteps) / double(pixelCount) : 0.0;
+}
+
+double CloudMarchStats::getDensityFetchesPerPixel() const
+{
+	return pixelCount > 0 ? double(densityFetches) / double(pixelCount) : 0.0;
+}
+
+/* --------------------------------- Camera --------------------------------- */
+
+// left handed: x right, y up, the camera looks along z
+static void getCameraBasis(const CloudMarchCamera& camera, vec3& forward, vec3& right, vec3& up)
+{
+	forward = normalize(camera.lookAt - camera.position);
+	right = normalize(cross(vec3(0.0f, 1.0f, 0.0f), forward));
+	up = cross(forward, right);
+}
+
+vec3 CloudMarchCamera::getPixelTarget(float x, float y, uint32_t width, uint32_t height) const
+{
+	vec3 forward, right, up;
+	getCameraBasis(*this, forward, right, up);
+	float halfWidth = std::tan(horizontalFov * 0.5f);
+	float halfHeight = halfWidth * float(height) / float(width);
+	float ndcX = 2.0f * x / float(width) - 1.0f;
+	float ndcY = 1.0f - 2.0f * y / float(height);
+	return position + forward + right * (ndcX * halfWidth) + up * (ndcY * halfHeight);
+}
+
+bool CloudMarchCamera::project(const vec3& pos, uint32_t width, uint32_t height, float& x, float& y, float& depth) const
+{
+	vec3 forward, right, up;
+	getCameraBasis(*this, forward, right, up);
+	float halfWidth = std::tan(horizontalFov * 0.5f);
+	float halfHeight = halfWidth * float(height) / float(width);
+	vec3 offset = pos - position;
+	depth = dot(offset, forward);
+	if (depth <= 0.0f)
+		return false;
+	float ndcX = dot(offset, right) / (depth * halfWidth);
+	float ndcY = dot(offset, up) / (depth * halfHeight);
+	x = (ndcX + 1.0f) * 0.5f * float(width);
+	y = (1.0f - ndcY) * 0.5f * float(height);
+	return true;
+}
+
+/* --------------------------------- Public methods --------------------------------- */
+
+CloudMarcher::CloudMarcher(const CloudMarchParams& params, const CloudMarchTextures& textures) :
+	m_params(params),
+	m_textures(textures)
+{
+}
+
+vec2 CloudMarcher::rayBoxDst(const vec3& boundsMin, const vec3& boundsMax, const vec3& rayOrigin, const vec3& invRayDir)
+{
+	// Adapted from: http://jcgt.org/published/0007/03/04/
+	float t0x = (boundsMin.getX() - rayOrigin.getX()) * invRayDir.getX();
+	float t0y = (boundsMin.getY() - rayOrigin.getY()) * invRayDir.getY();
+	float t0z = (boundsMin.getZ() - rayOrigin.getZ()) * invRayDir.getZ();
+	float t1x = (boundsMax.getX() - rayOrigin.getX()) * invRayDir.getX();
+	float t1y = (boundsMax.getY() - rayOrigin.getY()) * invRayDir.getY();
+	float t1z = (boundsMax.getZ() - rayOrigin.getZ()) * invRayDir.getZ();
+
+	float dstA = max(max(min(t0x, t1x), min(t0y, t1y)), min(t0z, t1z));
+	float dstB = min(max(t0x, t1x), min(max(t0y, t1y), max(t0z, t1z)));
+
+	// inside the box dstA is behind the ray, a miss has dstA > dstB
+	float dstToBox = max(0.0f, dstA);
+	float dstInsideBox = max(0.0f, dstB - dstToBox);
+	return vec2(dstToBox, dstInsideBox);
+}
+
+float CloudMarcher::phase(float g, float cosTheta)
+{
+	float denom = 1.0f + g * g - 2.0f * g * cosTheta;
+	return 1.0f / (4.0f * M_PI_F) * (1.0f - g * g) / (denom * std::sqrt(denom));
+}
+
+float CloudMarcher::heightFunction(float height, float hMin, float hMax)
+{
+	float minimum = saturate(remap(height, hMin - 0.08f, hMin, 0.0f, 1.0f));
+	float maximum = hMax == 1.0f ? 1.0f : saturate(remap(height, hMax + 0.15f, hMax, 0.0f, 1.0f));
+	return minimum * maximum;
+}
+
+float CloudMarcher::horizontalFunction(const vec3& samplePos, const vec3& boxMin, const vec3& boxMax, const vec3& boxSize)
+{
+	float distX = min(samplePos.getX() - boxMin.getX(), boxMax.getX() - samplePos.getX()) / boxSize.getX();
+	// the shader normalises the z distance by the height of the box too
+	float distZ = min(samplePos.getZ() - boxMin.getZ(), boxMax.getZ() - samplePos.getZ()) / boxSize.getY();
+	float result = min(distX, distZ);
+	return saturate(remap(result, 0.03f, 0.22f, 0.0f, 1.0f));
+}
+
+float CloudMarcher::sampleBaseDensity(vec3 uv, float lod) const
+{
+	float textureOffset = m_params.shapeFunction.getZ();
+	uv = vec3(uv.getX(), uv.getY(), std::fmod(uv.getZ() + textureOffset, 1.0f));
+
+	float noiseValue[4];
+	if (m_textures.pShapeBricks)
+	{
+		// an empty brick has no density whatever the coverage and the detail, the other fetches are skipped
+		if (!m_textures.pShapeBricks->sample(uv.getX(), uv.getY(), uv.getZ(), noiseValue))
+			return 0.0f;
+		lod = 0.0f;
+	}
+	else
+	{
+		m_textures.pCloudShape->sample(uv.getX(), uv.getY(), uv.getZ(), lod, noiseValue);
+	}
+	// extrude shapes
+	float density = saturate(remap(noiseValue[0], 1.0f - noiseValue[1], 1.0f, 0.0f, 1.0f));
+
+	float cloudCoverage[4];
+	m_textures.pWeather->sample(uv.getX(), uv.getZ(), 0.0f, lod, cloudCoverage);
+	return saturate(remap(density, cloudCoverage[0], 1.0f, 0.0f, 1.0f));
+}
+
+float CloudMarcher::sampleDensity(vec3 uv, float lod) const
+{
+	float baseCloudWithCoverage = sampleBaseDensity(uv, lod);
+	if (m_textures.pShapeBricks)
+	{
+		// the erosion can't add density, the detail isn't fetched under an empty base. The dense detail texture of the
+		// sparse shape only has level 0
+		if (baseCloudWithCoverage == 0.0f)
+			return 0.0f;
+		lod = 0.0f;
+	}
+	float textureOffset = m_params.shapeFunction.getZ();
+	uv = vec3(uv.getX(), uv.getY(), std::fmod(uv.getZ() + textureOffset, 1.0f));
+
+	float finalCloud = baseCloudWithCoverage;
+	const vec4& detailParams = m_params.detailParams;
+	if (detailParams.getX() > 0.0f)
+	{
+		float heightTreshold = detailParams.getW();
+		float heightFallOff = hermiteInterpolation(uv.getY(), heightTreshold, heightTreshold * 1.5f);
+		float detailScale = detailParams.getY();
+		float detailClamp = detailParams.getZ();
+		float detail[4];
+		m_textures.pCloudShape->sample(uv.getX() * detailScale, uv.getY() * detailScale, uv.getZ() * detailScale, lod, detail);
+		float detailNoise = detail[2] * (detailClamp * heightFallOff);
+		// erode base cloud with detailed one
+		finalCloud = saturate(remap(baseCloudWithCoverage, detailNoise, 1.0f, 0.0f, 1.0f));
+	}
+	return finalCloud;
+}
+
+float CloudMarcher::sampleCloudDensity(const vec3& pos, float lod) const
+{
+	const vec3& boxMin = m_params.boxMin;
+	const vec3& boxMax = m_params.boxMax;
+	float boxHeight = boxMax.getY() - boxMin.getY();
+	float density = sampleDensity(getBoxUV(pos), lod);
+	density *= heightFunction((pos.getY() - boxMin.getY()) / boxHeight, m_params.shapeFunction.getX(), m_params.shapeFunction.getY());
+	density *= horizontalFunction(pos, boxMin, boxMax, boxMax - boxMin);
+	return density;
+}
+
+vec4 CloudMarcher::march(const vec3& rayOrigin, const vec3& worldPosition, CloudMarchStats* pStats, float* pDepth) const
+{
+	const CloudMarchParams& params = m_params;
+	const vec3& boxMin = params.boxMin;
+	const vec3& boxMax = params.boxMax;
+	vec3 rayDir = normalize(worldPosition - rayOrigin);
+	vec3 invRayDir = vec3(1.0f / rayDir.getX(), 1.0f / rayDir.getY(), 1.0f / rayDir.getZ());
+
+	vec2 distToBoxInfo = rayBoxDst(boxMin, boxMax, rayOrigin, invRayDir);
+	float distToEntry = distToBoxInfo.getX();
+	float distInside = distToBoxInfo.getY();
+	vec3 boxSize = boxMax - boxMin;
+	float boxLength = max(max(boxSize.getX(), boxSize.getY()), boxSize.getZ());
+	float boxHeight = boxMax.getY() - boxMin.getY();
+	float hMin = params.shapeFunction.getX();
+	float hMax = params.shapeFunction.getY();
+
+	if (pStats)
+		pStats->pixelCount++;
+	if (pDepth)
+		*pDepth = 0.0f;
+	if (distInside == 0.0f)
+		return vec4(0.0f, 0.0f, 0.0f, 0.0f);
+
+	float cloudAbsorption = params.lightParams.getX();
+	float powderStrength = params.lightParams.getY();
+	float phaseAsymetry = params.lightParams.getZ();
+	float sunBrightness = params.lightParams.getW();
+	// Directional light
+	const vec3& lightDir = params.sunDir;
+	vec3 invLightDir = vec3(1.0f / lightDir.getX(), 1.0f / lightDir.getY(), 1.0f / lightDir.getZ());
+	float nbRaySamples = params.samples.getX();
+	float nbLightSamples = params.samples.getY();
+	float jitterOffset = params.samples.getZ();
+	float stepSize = boxLength / nbRaySamples;
+	float lightStep = boxLength / nbLightSamples;
+	vec3 entryPoint = rayOrigin + rayDir * distToEntry;
+
+	float dstTravelled = 0.0f;
+	vec3 lightColor = params.sunColor * sunBrightness;
+	float cosTheta = dot(rayDir, -lightDir);
+	vec3 result = vec3(0.0f, 0.0f, 0.0f);
+	float transmittance = 1.0f;
+	uint64_t raySteps = 0;
+	uint64_t lightSteps = 0;
+	uint64_t densityFetches = 0;
+	const CloudOccupancyGrid* pOccupancy = m_textures.pOccupancy;
+	const CloudLightVolume* pLightVolume = m_textures.pLightVolume;
+	// adaptive march: fine steps left before the coarse steps resume, first distance not known to be empty
+	const CloudStepPolicy& stepPolicy = params.stepPolicy;
+	// a coarse step below the fixed one, or no fine step after a backup, would probe the same point forever
+	float coarseStepSize = stepSize * max(1.0f, stepPolicy.coarseStepScale);
+	float fineStepsLeft = 0.0f;
+	float refineDst = 0.0f;
+	// distances of the samples weighted by the transmittance they take
+	float depthSum = 0.0f;
+	float depthWeight = 0.0f;
+
+	while (dstTravelled < distInside)
+	{
+		raySteps++;
+		vec3 rayPos = entryPoint + rayDir * dstTravelled;
+		vec3 lightPos = rayPos - (lightDir * boxHeight * 3.0f);
+		vec3 currentUV = getBoxUV(rayPos);
+		// past one box length from the camera, every doubling of the distance drops a mip level
+		float sampleLod = max(0.0f, std::log2((distToEntry + dstTravelled) / boxLength));
+		float rayStep = stepSize;
+		float fineStep = stepSize;
+		bool coarse = false;
+		if (stepPolicy.enabled)
+		{
+			fineStep *= 1.0f + stepPolicy.distanceStretch * (distToEntry + dstTravelled) / boxLength;
+			fineStep *= 1.0f + stepPolicy.transmittanceStretch * (1.0f - transmittance);
+			fineStep = min(fineStep, coarseStepSize);
+			coarse = fineStepsLeft <= 0.0f;
+			rayStep = coarse ? coarseStepSize : fineStep;
+		}
+		if (pOccupancy)
+		{
+			// an empty cell is crossed in one step, to the first sample past it
+			float emptyDistance = pOccupancy->getEmptyDistance(rayPos, rayDir, sampleLod);
+			if (emptyDistance > 0.0f)
+			{
+				refineDst = dstTravelled + emptyDistance;
+				dstTravelled += std::ceil(emptyDistance / rayStep) * rayStep;
+				continue;
+			}
+		}
+		densityFetches++;
+		// the coarse steps only probe the base shape, the erosion of the detail can't add density
+		float density = coarse ? sampleBaseDensity(currentUV, sampleLod) : sampleDensity(currentUV, sampleLod);
+		float heightPercentage = (rayPos.getY() - boxMin.getY()) / boxHeight;
+		density *= heightFunction(heightPercentage, hMin, hMax);
+		density *= horizontalFunction(rayPos, boxMin, boxMax, boxSize);
+		if (stepPolicy.enabled)
+		{
+			if (coarse && density > 0.0f)
+			{
+				// entering cloud: back up and cross the coarse step again in fine steps, the probe is sampled again at the
+				// start of the ray
+				fineStepsLeft = max(1.0f, stepPolicy.fineStepCount + std::ceil((dstTravelled - refineDst) / fineStep));
+				dstTravelled = refineDst;
+				continue;
+			}
+			fineStepsLeft = density > 0.0f ? stepPolicy.fineStepCount : fineStepsLeft - 1.0f;
+			refineDst = dstTravelled + fineStep;
+		}
+
+		// Compute light transmission through the volume
+		if (density > 0.0f)
+		{
+			float lightTransmission = 1.0f;
+			vec2 distToLightBox = rayBoxDst(boxMin, boxMax, lightPos, invLightDir);
+			float ldistInside = distToLightBox.getY();
+
+			if (pLightVolume)
+			{
+				// one lookup of the optical depth toward the sun instead of the light march
+				float lightOpticalDepth = pLightVolume->getOpticalDepth(currentUV);
+				lightTransmission = std::exp(-1.0f * lightOpticalDepth * cloudAbsorption);
+				float lightPowderEffect = 1.0f - powderStrength * std::exp(-1.0f * lightOpticalDepth * cloudAbsorption * 2.0f);
+				lightPowderEffect = 2.0f * lightPowderEffect;
+				lightTransmission *= lightPowderEffect;
+			}
+			else if (ldistInside != 0.0f)
+			{
+				vec3 lightEntry = lightPos + lightDir * distToLightBox.getX();
+				vec3 lightUV = getBoxUV(lightEntry);
+				lightEntry = applyRandomOffset(lightEntry, (lightUV.getX() + lightUV.getY()) / 2.0f, (lightUV.getZ() + lightUV.getY()) / 2.0f,
+					lightDir * lightStep * jitterOffset);
+				float lightDistance = length(lightEntry - rayPos);
+				float lightDensityAccumulation = 0.0f;
+				float lightDistanceTravelled = 0.0f;
+
+				while (lightDistanceTravelled < lightDistance)
+				{
+					lightSteps++;
+					vec3 lSamplePos = lightEntry + lightDir * lightDistanceTravelled;
+					float lightLod = max(sampleLod, kLightSampleLod);
+					if (pOccupancy)
+					{
+						float emptyDistance = pOccupancy->getEmptyDistance(lSamplePos, lightDir, lightLod);
+						if (emptyDistance > 0.0f)
+						{
+							lightDistanceTravelled += std::ceil(emptyDistance / lightStep) * lightStep;
+							continue;
+						}
+					}
+					lightUV = getBoxUV(lSamplePos);
+
+					densityFetches++;
+					float lDensity = sampleDensity(lightUV, lightLod);
+					float lightHeightPercentage = (lSamplePos.getY() - boxMin.getY()) / boxHeight;
+					lDensity *= heightFunction(lightHeightPercentage, hMin, hMax);
+					lDensity *= horizontalFunction(lSamplePos, boxMin, boxMax, boxSize);
+					lightDensityAccumulation += lDensity;
+					lightDistanceTravelled += lightStep;
+				}
+				// Sum of exp(-step * density * absorp) -> exp(-step * SumDensity * absorp)
+				lightTransmission = std::exp(-1.0f * lightStep * lightDensityAccumulation * cloudAbsorption);
+				// Reduce in scattering when no participating medium is found (inverse of Beer's law)
+				float lightPowderEffect = 1.0f - powderStrength * std::exp(-1.0f * lightStep * lightDensityAccumulation * cloudAbsorption * 2.0f);
+				lightPowderEffect = 2.0f * lightPowderEffect;
+				lightTransmission *= lightPowderEffect;
+			}
+
+			float sampleTransmittance = std::exp(-density * rayStep * cloudAbsorption);
+			depthSum += (distToEntry + dstTravelled) * transmittance * (1.0f - sampleTransmittance);
+			depthWeight += transmittance * (1.0f - sampleTransmittance);
+			transmittance *= sampleTransmittance;
+			result += lightColor * lightTransmission * rayStep * density * transmittance * phase(phaseAsymetry, cosTheta);
+
+			// Exit early if T is close to zero as further samples won't affect the result much
+			if (transmittance < 0.025f)
+				break;
+		}
+		dstTravelled += rayStep;
+	}
+
+	if (pStats)
+	{
+		pStats->hitCount++;
+		pStats->raySteps += raySteps;
+		pStats->lightSteps += lightSteps;
+		pStats->densityFetches += densityFetches;
+	}
+	if (pDepth)
+		*pDepth = depthWeight > 0.0f ? depthSum / depthWeight : distToEntry;
+	return vec4(result, 1.0f - transmittance);
+}
+
+CloudMarchStats CloudMarcher::render(const CloudMarchCamera& camera, uint32_t width, uint32_t height, NoiseSink& sink) const
+{
+	uint32_t tilesX = (width + kTileSize - 1) / kTileSize;
+	uint32_t tilesY = (height + kTileSize - 1) / kTileSize;
+	// stats are merged in tile order so the counts are exact whatever the scheduling
+	std::vector<CloudMarchStats> tileStats(tilesX * tilesY);
+	TaskScheduler::parallelFor(tilesX * tilesY, [&](uint32_t tile)
+	{
+		uint32_t x0 = (tile % tilesX) * kTileSize;
+		uint32_t y0 = (tile / tilesX) * kTileSize;
+		uint32_t count = std::min(kTileSize, width - x0);
+		uint32_t rowCount = std::min(kTileSize, height - y0);
+
+		float planes[4][kTileSize];
+		const float* channels[4] = { planes[0], planes[1], planes[2], planes[3] };
+		for (uint32_t y = y0; y < y0 + rowCount; ++y)
+		{
+			for (uint32_t i = 0; i < count; ++i)
+			{
+				vec3 target = camera.getPixelTarget(float(x0 + i) + 0.5f, float(y) + 0.5f, width, height);
+				vec4 color = march(camera.position, target, &tileStats[tile]);
+				planes[0][i] = saturate(color.getX());
+				planes[1][i] = saturate(color.getY());
+				planes[2][i] = saturate(color.getZ());
+				planes[3][i] = saturate(color.getW());
+			}
+			sink.writeChannels(y, 0, x0, count, channels, 4);
+		}
+	});
+
+	CloudMarchStats stats;
+	for (const CloudMarchStats& other : tileStats)
+		stats.merge(other);
+	return stats;
+}
+
+/* --------------------------------- Private methods --------------------------------- */
+
+vec3 CloudMarcher::applyRandomOffset(const vec3& pos, float u, float v, const vec3& offset) const
+{
+	float coef[4];
+	m_textures.pBlueNoise->sample(u, v, 0.0f, 0.0f, coef);
+	return pos + offset * coef[0];
+}
+
+vec3 CloudMarcher::getBoxUV(const vec3& pos) const
+{
+	const vec3& boxMin = m_params.boxMin;
+	const vec3& boxMax = m_params.boxMax;
+	return vec3(remap(pos.getX(), boxMin.getX(), boxMax.getX(), 0.0f, 1.0f), remap(pos.getY(), boxMin.getY(), boxMax.getY(), 0.0f, 1.0f),
+		remap(pos.getZ(), boxMin.getZ(), boxMax.getZ(), 0.0f, 1.0f));
+}
@@ -0,0 +1,144 @@
+#pragma once
+
+//Math
+#include "../../../../../Common_3/Utilities/Math/MathTypes.h"
+
+#include "../Noise/NoiseSink.h"
+
+#include <cstdint>
+
+class NoiseSampler;
+class CloudOccupancyGrid;
+class CloudLightVolume;
+class NoiseBrickVolume;
+
+/// Step policy of the adaptive march (ADAPTIVE_STEP), packed like the stepPolicy uniform. The fine step is the fixed step
+/// of box length / ray samples, stretched with the distance from the camera and as the transmittance falls, up to the
+/// coarse step. Empty space is crossed in coarse steps probing the base shape only, on entering cloud the march backs up
+/// to the fine step after the last empty sample.
+struct CloudStepPolicy
+{
+    /// Off: the fixed step march
+    bool enabled = false;
+    /// Coarse step in fixed steps, x of the uniform, at least 1
+    float coarseStepScale = 4.0f;
+    /// Fine steps without density before the coarse steps resume, y. A backup always takes at least one fine step
+    float fineStepCount = 4.0f;
+    /// Growth of the fine step per box length from the camera, z
+    float distanceStretch = 0.25f;
+    /// Growth of the fine step as the transmittance falls to 0, w
+    float transmittanceStretch = 0.5f;
+};
+
+/// Parameters of the cloud pass, packed like the cube.frag uniforms they mirror
+struct CloudMarchParams
+{
+    vec3 boxMin = vec3(-220.0f, -80.0f, -220.0f);
+    vec3 boxMax = vec3(220.0f, 80.0f, 220.0f);
+    /// x: lowest cloud height, y: highest cloud height (both in [0-1] of the box), z: offset of the shape along w
+    vec3 shapeFunction = vec3(0.15f, 0.85f, 0.0f);
+    /// x: detail enabled when above 0, y: detail scale, z: detail strength, w: height of the detail fade in
+    vec4 detailParams = vec4(1.0f, 4.0f, 0.4f, 0.2f);
+    /// x: absorption, y: powder strength, z: phase asymmetry, w: sun brightness
+    vec4 lightParams = vec4(0.05f, 0.5f, 0.3f, 1.0f);
+    /// x: ray samples per box length, y: light samples per box length, z: jitter of the light march entry
+    vec3 samples = vec3(64.0f, 8.0f, 1.0f);
+    /// Direction the light travels in, normalized
+    vec3 sunDir = vec3(0.0f, -1.0f, 0.0f);
+    vec3 sunColor = vec3(0.7f, 0.8f, 0.92f);
+    CloudStepPolicy stepPolicy;
+};
+
+/// Textures sampled by the cloud pass, the first three must be set
+struct CloudMarchTextures
+{
+    /// r: perlin remapped by worley, g: extrusion factor, b: detail (NoiseBaker::bakeCloudShape)
+    const NoiseSampler* pCloudShape;
+    const NoiseSampler* pWeather;
+    const NoiseSampler* pBlueNoise;
+    /// Built from the same textures and params, the empty cells are then crossed in one step (CLOUD_OCCUPANCY)
+    const CloudOccupancyGrid* pOccupancy = NULL;
+    /// Computed for the sun of the params, replaces the light march of every sample by one lookup (LIGHT_VOLUME)
+    const CloudLightVolume* pLightVolume = NULL;
+    /// Base and extrusion of pCloudShape split in bricks (SPARSE_CLOUD_SHAPE, NoiseBrickVolume::buildCloudShape): read in
+    /// place of its r and g, at level 0 like the weather and the detail
+    const NoiseBrickVolume* pShapeBricks = NULL;
+};
+
+/// Work done by the march, the figures the optimisations of the GPU pass are measured with
+struct CloudMarchStats
+{
+    uint64_t pixelCount = 0;
+    /// Pixels whose ray crosses the box
+    uint64_t hitCount = 0;
+    /// Iterations of the view ray and of the nested light rays, crossing an empty cell of the occupancy grid is one, and so
+    /// is a coarse step of the adaptive march backed up on entering cloud
+    uint64_t raySteps = 0;
+    uint64_t lightSteps = 0;
+    /// Calls to sampleDensity, the texture fetches of the pass
+    uint64_t densityFetches = 0;
+
+    void merge(const CloudMarchStats& other);
+    double getRayStepsPerPixel() const;
+    double getLightStepsPerPixel() const;
+    double getDensityFetchesPerPixel() const;
+};
+
+/// Pinhole camera of render(), the image plane spans horizontalFov and keeps square pixels
+struct CloudMarchCamera
+{
+    vec3 position;
+    vec3 lookAt;
+    float horizontalFov;
+
+    /// Point one unit in front of the camera on the ray through (x, y) of a width x height image, in pixels from the top
+    /// left corner (the center of the first pixel is at 0.5)
+    vec3 getPixelTarget(float x, float y, uint32_t width, uint32_t height) const;
+    /// Inverse of getPixelTarget: image coordinates of pos and its depth along the view axis, false when pos is behind
+    /// the camera
+    bool project(const vec3& pos, uint32_t width, uint32_t height, float& x, float& y, float& depth) const;
+};
+
+/// CPU port of the volumetric cloud integrator of cube.frag (PS_MAIN), to profile and test it without a GPU.
+/// The shader functions keep their names and their order of operations, the textures are read through NoiseSampler.
+/// Any change to the shader must be mirrored here.
+class CloudMarcher
+{
+public:
+    CloudMarcher(const CloudMarchParams& params, const CloudMarchTextures& textures);
+
+public:
+    // -------- shader functions
+    /// x: distance to the box, y: distance inside the box (0 when the ray misses it)
+    static vec2 rayBoxDst(const vec3& boundsMin, const vec3& boundsMax, const vec3& rayOrigin, const vec3& invRayDir);
+    /// Henyey-Greenstein phase function
+    static float phase(float g, float cosTheta);
+    static float heightFunction(float height, float hMin, float hMax);
+    static float horizontalFunction(const vec3& samplePos, const vec3& boxMin, const vec3& boxMax, const vec3& boxSize);
+    /// Density of the shape under the coverage, before the erosion by the detail noise
+    float sampleBaseDensity(vec3 uv, float lod) const;
+    float sampleDensity(vec3 uv, float lod) const;
+    /// sampleDensity at a position of the box weighted by the height and horizontal profiles, as the march weights its samples
+    float sampleCloudDensity(const vec3& pos, float lod) const;
+
+    // -------- integration
+    /// PS_MAIN for the ray from rayOrigin through worldPosition: rgb the in-scattered light, a 1 - transmittance.
+    /// pDepth gets the distance from rayOrigin to the cloud, the samples weighted by the light they absorb (the box entry
+    /// when the ray crosses no density, 0 when it misses the box), the depth the temporal pass reprojects with
+    vec4 march(const vec3& rayOrigin, const vec3& worldPosition, CloudMarchStats* pStats = NULL, float* pDepth = NULL) const;
+    /// March one ray per pixel center, tiles of pixels in parallel on the TaskScheduler.
+    /// Rows of the tiles reach sink as 4 channels (rgba) saturated like the render target of the sample.
+    /// The image and the stats don't depend on the worker count
+    CloudMarchStats render(const CloudMarchCamera& camera, uint32_t width, uint32_t height, NoiseSink& sink) const;
+
+    const CloudMarchParams& getParams() const { return m_params; }
+
+private:
+    vec3 applyRandomOffset(const vec3& pos, float u, float v, const vec3& offset) const;
+    /// Position in the box remapped to [0-1]
+    vec3 getBoxUV(const vec3& pos) const;
+
+private:
+    CloudMarchParams m_params;
+    CloudMarchTextures m_textures;
+};
@@ -0,0 +1,291 @@
+#include "CloudOccupancyGrid.h"
+#include "CloudMarcher.h"
+#include "NoiseBaker.h"
+#include "NoiseMipChain.h"
+#include "TaskScheduler.h"
+
+#include "../../../../../Common_3/Utilities/Interfaces/ILog.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+
+static bool isByteLayout(NoiseChannelLayout layout)
+{
+	return layout == NoiseChannelLayout::R8 || layout == NoiseChannelLayout::RG8 || layout == NoiseChannelLayout::RGBA8;
+}
+
+/// First and last texel (unwrapped) of the linear fetches at coordinates in [c0, c1] along an axis of size texels.
+/// The range is widened by a thousandth of a texel for the rounding of the coordinates
+static void addTexelRange(float c0, float c1, uint32_t size, std::vector<int64_t>& ranges)
+{
+	ranges.push_back(int64_t(std::floor(c0 * float(size) - 0.501f)));
+	ranges.push_back(int64_t(std::floor(c1 * float(size) - 0.499f)) + 1);
+}
+
+/// Texels of an axis of size texels reached from each of the cellCount cells of the box, shifted by offset
+static std::vector<int64_t> getCellRanges(uint32_t cellCount, uint32_t size, float offset)
+{
+	std::vector<int64_t> ranges;
+	for (uint32_t cell = 0; cell < cellCount; ++cell)
+		addTexelRange(float(cell) / float(cellCount) + offset, float(cell + 1) / float(cellCount) + offset, size, ranges);
+	return ranges;
+}
+
+/// Texels of an axis of size texels fetched together with each texel of an axis of texelCount texels (same coordinates),
+/// the fetches reading texel i are at coordinates in ((i - 0.5) / texelCount, (i + 1.5) / texelCount)
+static std::vector<int64_t> getFootprintRanges(uint32_t texelCount, uint32_t size)
+{
+	std::vector<int64_t> ranges;
+	for (uint32_t texel = 0; texel < texelCount; ++texel)
+		addTexelRange((float(texel) - 0.5f) / float(texelCount), (float(texel) + 1.5f) / float(texelCount), size, ranges);
+	return ranges;
+}
+
+/// Reduce the middle axis of src (outerCount x size x innerCount bytes) over the texel ranges of each cell, wrapped:
+/// dst is outerCount x cellCount x innerCount
+template <typename Reduce>
+static std::vector<uint8_t> reduceAxis(const uint8_t* pSrc, uint32_t outerCount, uint32_t size, uint32_t innerCount,
+	const std::vector<int64_t>& ranges, Reduce reduce)
+{
+	uint32_t cellCount = uint32_t(ranges.size() / 2);
+	std::vector<uint8_t> dst(size_t(outerCount) * cellCount * innerCount);
+	TaskScheduler::parallelFor(outerCount, [&](uint32_t outer)
+	{
+		const uint8_t* pOuter = pSrc + size_t(outer) * size * innerCount;
+		for (uint32_t cell = 0; cell < cellCount; ++cell)
+		{
+			uint8_t* pCell = &dst[(size_t(outer) * cellCount + cell) * innerCount];
+			int64_t first = ranges[cell * 2 + 0];
+			int64_t last = std::min(ranges[cell * 2 + 1], first + int64_t(size) - 1);
+			for (int64_t texel = first; texel <= last; ++texel)
+			{
+				int64_t wrapped = texel % int64_t(size);
+				const uint8_t* pTexel = pOuter + size_t(wrapped < 0 ? wrapped + size : wrapped) * innerCount;
+				if (texel == first)
+					memcpy(pCell, pTexel, innerCount);
+				else
+					for (uint32_t i = 0; i < innerCount; ++i)
+						pCell[i] = reduce(pCell[i], pTexel[i]);
+			}
+		}
+	});
+	return dst;
+}
+
+/// Highest density sampleDensity can return from a texel of base r and extrusion g under a coverage from c, rounded up to 8 bit.
+/// The extruded density remap(r, 1 - g, 1, 0, 1) stays below 1 - t once r + t * g <= 1, a convex set: an interpolated
+/// texel is never denser than the densest corner of its footprint. The coverage remap shrinks as the coverage grows and
+/// the detail only erodes. A remap over an empty range only lets a full value through
+static uint8_t getDensityBound(uint8_t r, uint8_t g, uint8_t c)
+{
+	float density = g == 0 ? (r == 255 ? 1.0f : 0.0f) : saturate(remap(r / 255.0f, 1.0f - g / 255.0f, 1.0f, 0.0f, 1.0f));
+	if (c == 255)
+		density = density >= 1.0f ? 1.0f : 0.0f;
+	else
+		density = saturate(remap(density, c / 255.0f, 1.0f, 0.0f, 1.0f));
+	return uint8_t(std::min(255.0f, std::ceil(density * 255.0f)));
+}
+
+/* --------------------------------- Public methods --------------------------------- */
+
+CloudOccupancyGrid::CloudOccupancyGrid(uint32_t width, uint32_t height, uint32_t depth, uint32_t maxLod) :
+	m_maxLod(maxLod),
+	m_boxMin(0.0f, 0.0f, 0.0f),
+	m_boxSize(1.0f, 1.0f, 1.0f)
+{
+	for (;;)
+	{
+		Level level = { width, height, depth, std::vector<float>(size_t(width) * height * depth, 1.0f) };
+		m_levels.push_back(std::move(level));
+		if (width == 1 && height == 1 && depth == 1)
+			break;
+		width = std::max(1u, width / 2);
+		height = std::max(1u, height / 2);
+		depth = std::max(1u, depth / 2);
+	}
+}
+
+void CloudOccupancyGrid::build(const NoiseMipChain& cloudShape, const NoiseMipChain& weather, const CloudMarchParams& params)
+{
+	m_boxMin = params.boxMin;
+	m_boxSize = params.boxMax - params.boxMin;
+	Level& base = m_levels[0];
+	uint32_t width = base.width;
+	uint32_t height = base.height;
+	uint32_t depth = base.depth;
+	std::vector<float>& bounds = base.maxDensity;
+
+	if (!isByteLayout(cloudShape.getLayout()) || !isByteLayout(weather.getLayout()))
+	{
+		LOGF(LogLevel::eWARNING, "CloudOccupancyGrid: the cloud shape and the weather must be 8 bit textures, nothing is skipped");
+		std::fill(bounds.begin(), bounds.end(), 1.0f);
+	}
+	else
+	{
+		std::fill(bounds.begin(), bounds.end(), 0.0f);
+		// sampleDensity offsets the w of the shape and the v of the weather, both scroll together
+		float textureOffset = params.shapeFunction.getZ();
+		auto maxOf = [](uint8_t a, uint8_t b) { return a > b ? a : b; };
+		auto minOf = [](uint8_t a, uint8_t b) { return a < b ? a : b; };
+		for (uint32_t lod = 0; lod <= m_maxLod; ++lod)
+		{
+			// the fetches round the lod then clamp it to the levels of each texture
+			uint32_t shapeLevel = std::min(lod, cloudShape.getLevelCount() - 1);
+			uint32_t weatherLevel = std::min(lod, weather.getLevelCount() - 1);
+			if (lod > 0 && shapeLevel < lod && weatherLevel < lod)
+				break;
+
+			uint32_t shapeTexelSize = PackedRowSink::getBytesPerTexel(cloudShape.getLayout());
+			uint32_t shapeWidth = cloudShape.getWidth(shapeLevel);
+			uint32_t shapeHeight = cloudShape.getHeight(shapeLevel);
+			uint32_t shapeDepth = cloudShape.getDepth(shapeLevel);
+
+			// lowest coverage met by the fetches reading each xz column of the shape, the weather is sampled at the xz of the shape uv
+			uint32_t weatherTexelSize = PackedRowSink::getBytesPerTexel(weather.getLayout());
+			uint32_t weatherWidth = weather.getWidth(weatherLevel);
+			uint32_t weatherHeight = weather.getHeight(weatherLevel);
+			std::vector<uint8_t> weatherX = reduceAxis(weather.getData(weatherLevel), weatherHeight, weatherWidth, weatherTexelSize,
+				getFootprintRanges(shapeWidth, weatherWidth), minOf);
+			std::vector<uint8_t> coverage = reduceAxis(weatherX.data(), 1, weatherHeight, shapeWidth * weatherTexelSize,
+				getFootprintRanges(shapeDepth, weatherHeight), minOf);
+
+			// densest texel under its coverage, then highest of each cell reduced along x, y then z
+			size_t sliceSize = size_t(shapeWidth) * shapeHeight;
+			std::vector<uint8_t> density(sliceSize * shapeDepth);
+			TaskScheduler::parallelFor(shapeDepth, [&](uint32_t z)
+			{
+				const uint8_t* pSrc = cloudShape.getData(shapeLevel) + cloudShape.getSliceStride(shapeLevel) * z;
+				const uint8_t* pCoverage = &coverage[size_t(z) * shapeWidth * weatherTexelSize];
+				for (size_t i = 0; i < sliceSize; ++i)
+				{
+					const uint8_t* pTexel = pSrc + i * shapeTexelSize;
+					density[sliceSize * z + i] = getDensityBound(pTexel[0], shapeTexelSize > 1 ? pTexel[1] : 0,
+						pCoverage[(i % shapeWidth) * weatherTexelSize]);
+				}
+			});
+			std::vector<uint8_t> densityX = reduceAxis(density.data(), shapeDepth * shapeHeight, shapeWidth, 1,
+				getCellRanges(width, shapeWidth, 0.0f), maxOf);
+			std::vector<uint8_t> densityXY = reduceAxis(densityX.data(), shapeDepth, shapeHeight, width,
+				getCellRanges(height, shapeHeight, 0.0f), maxOf);
+			std::vector<uint8_t> densityMax = reduceAxis(densityXY.data(), 1, shapeDepth, height * width,
+				getCellRanges(depth, shapeDepth, textureOffset), maxOf);
+			for (size_t cell = 0; cell < bounds.size(); ++cell)
+				bounds[cell] = std::max(bounds[cell], densityMax[cell] / 255.0f);
+		}
+	}
+
+	// the profiles only depend on the position: height rises up to hMin and falls past hMax, horizontal peaks at the box center
+	float hMin = params.shapeFunction.getX();
+	float hMax = params.shapeFunction.getY();
+	for (uint32_t z = 0; z < depth; ++z)
+	{
+		float z0 = float(z) / float(depth);
+		float z1 = float(z + 1) / float(depth);
+		for (uint32_t y = 0; y < height; ++y)
+		{
+			float y0 = float(y) / float(height);
+			float y1 = float(y + 1) / float(height);
+			float minimum = saturate(remap(y1, hMin - 0.08f, hMin, 0.0f, 1.0f));
+			float maximum = hMax == 1.0f ? 1.0f : saturate(remap(y0, hMax + 0.15f, hMax, 0.0f, 1.0f));
+			float heightBound = minimum * maximum;
+			for (uint32_t x = 0; x < width; ++x)
+			{
+				float x0 = float(x) / float(width);
+				float x1 = float(x + 1) / float(width);
+				vec3 center = vec3(std::min(std::max(0.5f, x0), x1), 0.5f, std::min(std::max(0.5f, z0), z1));
+				float horizontalBound = CloudMarcher::horizontalFunction(m_boxMin + mulPerElem(center, m_boxSize), params.boxMin,
+					params.boxMax, m_boxSize);
+				bounds[(size_t(z) * height + y) * width + x] *= heightBound * horizontalBound;
+			}
+		}
+	}
+
+	// a coarser cell holds the max of the 2x2x2 cells it covers
+	for (uint32_t level = 1; level < getLevelCount(); ++level)
+	{
+		const Level& src = m_levels[level - 1];
+		Level& dst = m_levels[level];
+		for (uint32_t z = 0; z < dst.depth; ++z)
+		{
+			for (uint32_t y = 0; y < dst.height; ++y)
+			{
+				for (uint32_t x = 0; x < dst.width; ++x)
+				{
+					float maxDensity = 0.0f;
+					for (uint32_t sz = z * 2; sz < std::min(z * 2 + 2, src.depth); ++sz)
+						for (uint32_t sy = y * 2; sy < std::min(y * 2 + 2, src.height); ++sy)
+							for (uint32_t sx = x * 2; sx < std::min(x * 2 + 2, src.width); ++sx)
+								maxDensity = std::max(maxDensity, src.maxDensity[(size_t(sz) * src.height + sy) * src.width + sx]);
+					dst.maxDensity[(size_t(z) * dst.height + y) * dst.width + x] = maxDensity;
+				}
+			}
+		}
+	}
+}
+
+float CloudOccupancyGrid::getEmptyDistance(const vec3& pos, const vec3& dir, float lod) const
+{
+	// the fetches use level floor(lod + 0.5)
+	if (lod >= float(m_maxLod) + 0.5f)
+		return 0.0f;
+	vec3 uv = divPerElem(pos - m_boxMin, m_boxSize);
+	if (minElem(uv) < 0.0f || maxElem(uv) > 1.0f)
+		return 0.0f;
+
+	// climb while the parent cell is empty too
+	int32_t emptyLevel = -1;
+	uint32_t cell[3] = {};
+	for (uint32_t level = 0; level < getLevelCount(); ++level)
+	{
+		const Level& grid = m_levels[level];
+		uint32_t x = std::min(uint32_t(uv.getX() * float(grid.width)), grid.width - 1);
+		uint32_t y = std::min(uint32_t(uv.getY() * float(grid.height)), grid.height - 1);
+		uint32_t z = std::min(uint32_t(uv.getZ() * float(grid.depth)), grid.depth - 1);
+		if (grid.maxDensity[(size_t(z) * grid.height + y) * grid.width + x] > 0.0f)
+			break;
+		emptyLevel = int32_t(level);
+		cell[0] = x;
+		cell[1] = y;
+		cell[2] = z;
+	}
+	if (emptyLevel < 0)
+		return 0.0f;
+
+	const Level& grid = m_levels[emptyLevel];
+	const uint32_t cellCounts[3] = { grid.width, grid.height, grid.depth };
+	float distance = FLT_MAX;
+	for (uint32_t axis = 0; axis < 3; ++axis)
+	{
+		// uv units per world unit along the ray
+		float speed = dir[axis] / m_boxSize[axis];
+		if (speed > 0.0f)
+			distance = std::min(distance, (float(cell[axis] + 1) / float(cellCounts[axis]) - uv[axis]) / speed);
+		else if (speed < 0.0f)
+			distance = std::min(distance, (float(cell[axis]) / float(cellCounts[axis]) - uv[axis]) / speed);
+	}
+	return std::max(0.0f, distance);
+}
+
+float CloudOccupancyGrid::getMaxDensity(uint32_t level, uint32_t x, uint32_t y, uint32_t z) const
+{
+	const Level& grid = m_levels[level];
+	return grid.maxDensity[(size_t(z) * grid.height + y) * grid.width + x];
+}
+
+std::vector<uint8_t> CloudOccupancyGrid::getTexels(uint32_t level) const
+{
+	const std::vector<float>& maxDensity = m_levels[level].maxDensity;
+	std::vector<uint8_t> texels(maxDensity.size());
+	for (size_t i = 0; i < maxDensity.size(); ++i)
+		texels[i] = uint8_t(std::min(255.0f, std::ceil(maxDensity[i] * 255.0f)));
+	return texels;
+}
+
+float CloudOccupancyGrid::getEmptyRatio() const
+{
+	const std::vector<float>& maxDensity = m_levels[0].maxDensity;
+	size_t emptyCount = std::count(maxDensity.begin(), maxDensity.end(), 0.0f);
+	return maxDensity.empty() ? 0.0f : float(emptyCount) / float(maxDensity.size());
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+//Math
+#include "../../../../../Common_3/Utilities/Math/MathTypes.h"
+
+#include <cstdint>
+#include <vector>
+
+class NoiseMipChain;
+struct CloudMarchParams;
+
+/// Coarse grid over the cloud box holding, per cell, the highest density the cloud pass can sample in it: the density of
+/// sampleDensity times the height and horizontal profiles. It is built once the textures are baked, from the cloud shape
+/// and weather texels the linear fetches of the cell can reach, so a cell at 0 has no density at all and the march can
+/// cross it without any fetch. Each level of the hierarchy keeps the max of 2x2x2 cells of the previous one, up to a
+/// single cell, to cross large empty regions in one step too.
+/// The bounds only hold for the texture levels up to maxLod and for the texture offset of the params it was built with,
+/// it must be rebuilt when the textures, the offset or the height profile change.
+class CloudOccupancyGrid
+{
+public:
+    /// width x height x depth cells on level 0 spanning the box, powers of 2
+    CloudOccupancyGrid(uint32_t width, uint32_t height, uint32_t depth, uint32_t maxLod = 1);
+
+public:
+    /// Bound every cell from the 8 bit cloud shape (r: base, g: extrusion) and weather (r: coverage) levels up to maxLod,
+    /// cells are reduced in parallel. A texture in another layout can't be bounded, nothing is skipped then
+    void build(const NoiseMipChain& cloudShape, const NoiseMipChain& weather, const CloudMarchParams& params);
+
+    /// Distance along dir (normalized, world units) from pos to the exit of the largest empty cell holding it.
+    /// 0 when the cell may hold density, pos is outside the box or the fetches at lod use a level past maxLod
+    float getEmptyDistance(const vec3& pos, const vec3& dir, float lod) const;
+
+    uint32_t getLevelCount() const { return uint32_t(m_levels.size()); }
+    uint32_t getWidth(uint32_t level) const { return m_levels[level].width; }
+    uint32_t getHeight(uint32_t level) const { return m_levels[level].height; }
+    uint32_t getDepth(uint32_t level) const { return m_levels[level].depth; }
+    uint32_t getMaxLod() const { return m_maxLod; }
+    float getMaxDensity(uint32_t level, uint32_t x, uint32_t y, uint32_t z) const;
+    /// Level as R8 texels of the CLOUD_OCCUPANCY texture, rounded up so only an empty cell reads 0
+    std::vector<uint8_t> getTexels(uint32_t level) const;
+    /// Part of the level 0 cells without density
+    float getEmptyRatio() const;
+
+private:
+    struct Level
+    {
+        uint32_t width;
+        uint32_t height;
+        uint32_t depth;
+        std::vector<float> maxDensity;
+    };
+
+    std::vector<Level> m_levels;
+    uint32_t m_maxLod;
+    vec3 m_boxMin;
+    vec3 m_boxSize;
+};
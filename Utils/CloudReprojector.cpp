@@ -0,0 +1,220 @@
+#include "CloudReprojector.h"
+#include "TaskScheduler.h"
+
+#include <algorithm>
+#include <cmath>
+
+// slot of a frame in the 16 frames cycle -> pixel of the block, the 4x4 Bayer matrix
+//  0  8  2 10
+// 12  4 14  6
+//  3 11  1  9
+// 15  7 13  5
+static const uint8_t kBayerOffsets[16][2] = {
+	{ 0, 0 }, { 2, 2 }, { 2, 0 }, { 0, 2 }, { 1, 1 }, { 3, 3 }, { 3, 1 }, { 1, 3 },
+	{ 1, 0 }, { 3, 2 }, { 3, 0 }, { 1, 2 }, { 0, 1 }, { 2, 3 }, { 2, 1 }, { 0, 3 },
+};
+// relative difference between the depth a history pixel was resolved at and the one of the reprojected point past which
+// the pixel is disoccluded, loose enough for the noise of the cloud depths of neighbouring pixels
+static const float kDepthTolerance = 0.25f;
+
+/* --------------------------------- Public methods --------------------------------- */
+
+CloudReprojector::CloudReprojector(uint32_t width, uint32_t height) :
+	m_width(width),
+	m_height(height),
+	m_blocksX((width + kBlockSize - 1) / kBlockSize),
+	m_blocksY((height + kBlockSize - 1) / kBlockSize),
+	m_frameIndex(0),
+	m_samples(size_t(m_blocksX) * m_blocksY),
+	m_sampleDistances(size_t(m_blocksX) * m_blocksY),
+	m_history(size_t(width) * height),
+	m_historyDepth(size_t(width) * height),
+	m_nextHistory(size_t(width) * height),
+	m_nextHistoryDepth(size_t(width) * height),
+	m_historyValid(false),
+	m_reprojectedCount(0),
+	m_rejectedCount(0)
+{
+}
+
+void CloudReprojector::getBlockOffset(uint32_t frameIndex, uint32_t& x, uint32_t& y)
+{
+	const uint8_t* offset = kBayerOffsets[frameIndex % 16];
+	x = offset[0];
+	y = offset[1];
+}
+
+CloudMarchStats CloudReprojector::render(const CloudMarcher& marcher, const CloudMarchCamera& camera, NoiseSink& sink)
+{
+	uint32_t offsetX, offsetY;
+	getBlockOffset(m_frameIndex, offsetX, offsetY);
+
+	// the pixels of this frame, a row of blocks per task
+	std::vector<CloudMarchStats> rowStats(m_blocksY);
+	TaskScheduler::parallelFor(m_blocksY, [&](uint32_t blockY)
+	{
+		float y = float(getMarchedY(blockY, offsetY)) + 0.5f;
+		for (uint32_t blockX = 0; blockX < m_blocksX; ++blockX)
+		{
+			float x = float(getMarchedX(blockX, offsetX)) + 0.5f;
+			size_t index = size_t(blockY) * m_blocksX + blockX;
+			vec4 color = marcher.march(camera.position, camera.getPixelTarget(x, y, m_width, m_height), &rowStats[blockY],
+				&m_sampleDistances[index]);
+			m_samples[index] = vec4(saturate(color.getX()), saturate(color.getY()), saturate(color.getZ()), saturate(color.getW()));
+		}
+	});
+
+	// resolve, a row per task
+	const CloudMarchParams& params = marcher.getParams();
+	std::vector<uint32_t> rowReprojected(m_height, 0);
+	std::vector<uint32_t> rowRejected(m_height, 0);
+	TaskScheduler::parallelFor(m_height, [&](uint32_t y)
+	{
+		std::vector<float> planes[4];
+		for (std::vector<float>& plane : planes)
+			plane.resize(m_width);
+		uint32_t blockY = y / kBlockSize;
+		bool marchedRow = y == getMarchedY(blockY, offsetY);
+		for (uint32_t x = 0; x < m_width; ++x)
+		{
+			size_t index = size_t(y) * m_width + x;
+			uint32_t blockX = x / kBlockSize;
+			vec3 rayDir = normalize(camera.getPixelTarget(float(x) + 0.5f, float(y) + 0.5f, m_width, m_height) - camera.position);
+			vec3 invRayDir = vec3(1.0f / rayDir.getX(), 1.0f / rayDir.getY(), 1.0f / rayDir.getZ());
+			vec2 distToBox = CloudMarcher::rayBoxDst(params.boxMin, params.boxMax, camera.position, invRayDir);
+
+			vec4 color = vec4(0.0f, 0.0f, 0.0f, 0.0f);
+			float depth = 0.0f;
+			if (distToBox.getY() != 0.0f)
+			{
+				size_t indices[4];
+				float weights[4];
+				getUpsampleWeights(x, y, offsetX, offsetY, indices, weights);
+				bool marched = marchedRow && x == getMarchedX(blockX, offsetX);
+				float distance = marched ? m_sampleDistances[size_t(blockY) * m_blocksX + blockX] : 0.0f;
+				if (!marched)
+				{
+					// cloud depth of the marched pixels around, the ones whose ray misses the box don't count
+					float weightSum = 0.0f;
+					for (uint32_t i = 0; i < 4; ++i)
+					{
+						if (m_sampleDistances[indices[i]] > 0.0f)
+						{
+							distance += weights[i] * m_sampleDistances[indices[i]];
+							weightSum += weights[i];
+						}
+					}
+					distance = weightSum > 0.0f ? distance / weightSum : distToBox.getX();
+					distance = std::min(std::max(distance, distToBox.getX()), distToBox.getX() + distToBox.getY());
+				}
+				vec3 point = camera.position + rayDir * distance;
+				float pixelX, pixelY;
+				camera.project(point, m_width, m_height, pixelX, pixelY, depth);
+
+				float previousX, previousY, previousDepth;
+				if (marched)
+				{
+					color = m_samples[size_t(blockY) * m_blocksX + blockX];
+				}
+				else if (m_historyValid && m_previousCamera.project(point, m_width, m_height, previousX, previousY, previousDepth) &&
+					previousX >= 0.0f && previousX < float(m_width) && previousY >= 0.0f && previousY < float(m_height) &&
+					std::fabs(m_historyDepth[size_t(previousY) * m_width + uint32_t(previousX)] - previousDepth) <=
+						kDepthTolerance * previousDepth)
+				{
+					color = sampleHistory(previousX, previousY);
+					rowReprojected[y]++;
+				}
+				else
+				{
+					for (uint32_t i = 0; i < 4; ++i)
+						color = color + m_samples[indices[i]] * weights[i];
+					rowRejected[y]++;
+				}
+			}
+
+			m_nextHistory[index] = color;
+			m_nextHistoryDepth[index] = depth;
+			planes[0][x] = color.getX();
+			planes[1][x] = color.getY();
+			planes[2][x] = color.getZ();
+			planes[3][x] = color.getW();
+		}
+		const float* channels[4] = { planes[0].data(), planes[1].data(), planes[2].data(), planes[3].data() };
+		sink.writeChannels(y, 0, 0, m_width, channels, 4);
+	});
+
+	m_history.swap(m_nextHistory);
+	m_historyDepth.swap(m_nextHistoryDepth);
+	m_historyValid = true;
+	m_previousCamera = camera;
+	m_frameIndex++;
+
+	m_reprojectedCount = 0;
+	m_rejectedCount = 0;
+	for (uint32_t y = 0; y < m_height; ++y)
+	{
+		m_reprojectedCount += rowReprojected[y];
+		m_rejectedCount += rowRejected[y];
+	}
+	CloudMarchStats stats;
+	for (const CloudMarchStats& other : rowStats)
+		stats.merge(other);
+	stats.pixelCount = uint64_t(m_width) * m_height;
+	return stats;
+}
+
+void CloudReprojector::reset()
+{
+	m_historyValid = false;
+}
+
+/* --------------------------------- Private methods --------------------------------- */
+
+uint32_t CloudReprojector::getMarchedX(uint32_t blockX, uint32_t offsetX) const
+{
+	return std::min(blockX * kBlockSize + offsetX, m_width - 1);
+}
+
+uint32_t CloudReprojector::getMarchedY(uint32_t blockY, uint32_t offsetY) const
+{
+	return std::min(blockY * kBlockSize + offsetY, m_height - 1);
+}
+
+vec4 CloudReprojector::sampleHistory(float x, float y) const
+{
+	float cellX = std::min(std::max(x - 0.5f, 0.0f), float(m_width - 1));
+	float cellY = std::min(std::max(y - 0.5f, 0.0f), float(m_height - 1));
+	uint32_t x0 = uint32_t(cellX);
+	uint32_t y0 = uint32_t(cellY);
+	uint32_t x1 = std::min(x0 + 1, m_width - 1);
+	uint32_t y1 = std::min(y0 + 1, m_height - 1);
+	float tx = cellX - float(x0);
+	float ty = cellY - float(y0);
+	const vec4& c00 = m_history[size_t(y0) * m_width + x0];
+	const vec4& c10 = m_history[size_t(y0) * m_width + x1];
+	const vec4& c01 = m_history[size_t(y1) * m_width + x0];
+	const vec4& c11 = m_history[size_t(y1) * m_width + x1];
+	return (c00 * (1.0f - tx) + c10 * tx) * (1.0f - ty) + (c01 * (1.0f - tx) + c11 * tx) * ty;
+}
+
+void CloudReprojector::getUpsampleWeights(uint32_t x, uint32_t y, uint32_t offsetX, uint32_t offsetY, size_t indices[4],
+	float weights[4]) const
+{
+	// block coordinates of the pixel, the samples sit at the offset of their block
+	float blockX = std::min(std::max((float(x) - float(offsetX)) / float(kBlockSize), 0.0f), float(m_blocksX - 1));
+	float blockY = std::min(std::max((float(y) - float(offsetY)) / float(kBlockSize), 0.0f), float(m_blocksY - 1));
+	uint32_t x0 = uint32_t(blockX);
+	uint32_t y0 = uint32_t(blockY);
+	uint32_t x1 = std::min(x0 + 1, m_blocksX - 1);
+	uint32_t y1 = std::min(y0 + 1, m_blocksY - 1);
+	float tx = blockX - float(x0);
+	float ty = blockY - float(y0);
+	indices[0] = size_t(y0) * m_blocksX + x0;
+	indices[1] = size_t(y0) * m_blocksX + x1;
+	indices[2] = size_t(y1) * m_blocksX + x0;
+	indices[3] = size_t(y1) * m_blocksX + x1;
+	weights[0] = (1.0f - tx) * (1.0f - ty);
+	weights[1] = tx * (1.0f - ty);
+	weights[2] = (1.0f - tx) * ty;
+	weights[3] = tx * ty;
+}
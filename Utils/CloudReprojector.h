@@ -0,0 +1,72 @@
+#pragma once
+
+#include "CloudMarcher.h"
+
+#include <cstdint>
+#include <vector>
+
+/// Temporally amortised cloud pass (TEMPORAL_REPROJECTION): each frame marches one pixel of every 4x4 block, the 16
+/// pixels of a block in the order of a 4x4 Bayer matrix, and resolves the others from the image of the previous frame.
+/// A pixel is reprojected through the point of its ray at the depth of the cloud, upsampled from the depths the marched
+/// pixels return: the point is projected with the previous camera and the history is read there. It is rejected, and
+/// upsampled from the pixels marched this frame, when the point falls outside the previous image or when the history
+/// pixel was resolved at another depth (disocclusion).
+/// Mirrors the cube.frag and cloudResolve.frag passes of the sample, with the camera of CloudMarcher::render in place of
+/// mModelViewProj / mInvModelViewProj.
+class CloudReprojector
+{
+public:
+    /// Side of the blocks, one pixel of a block is marched per frame
+    static const uint32_t kBlockSize = 4;
+
+    CloudReprojector(uint32_t width, uint32_t height);
+
+public:
+    /// Pixel of every block marched at frameIndex
+    static void getBlockOffset(uint32_t frameIndex, uint32_t& x, uint32_t& y);
+
+    /// March the pixels of this frame, resolve the others and write the image to sink as CloudMarcher::render does, it
+    /// becomes the history of the next frame. Blocks and rows are spread on the TaskScheduler, the image doesn't depend
+    /// on the worker count. The stats count the work of the marched pixels over all the pixels of the image
+    CloudMarchStats render(const CloudMarcher& marcher, const CloudMarchCamera& camera, NoiseSink& sink);
+    /// Drop the history (resize, camera cut), the next frame upsamples every pixel it doesn't march
+    void reset();
+
+    uint32_t getWidth() const { return m_width; }
+    uint32_t getHeight() const { return m_height; }
+    uint32_t getFrameIndex() const { return m_frameIndex; }
+    /// Pixels of the last frame read from the history, and the ones rejected then upsampled
+    uint64_t getReprojectedCount() const { return m_reprojectedCount; }
+    uint64_t getRejectedCount() const { return m_rejectedCount; }
+
+private:
+    /// Image coordinates of the pixel marched in the block, clamped to the image on its right and bottom edges
+    uint32_t getMarchedX(uint32_t blockX, uint32_t offsetX) const;
+    uint32_t getMarchedY(uint32_t blockY, uint32_t offsetY) const;
+    /// Bilinear fetch of the history at image coordinates (pixel centers at half integers)
+    vec4 sampleHistory(float x, float y) const;
+    /// Bilinear weights of the 4 pixels marched this frame around the pixel (x, y), indices in m_samples
+    void getUpsampleWeights(uint32_t x, uint32_t y, uint32_t offsetX, uint32_t offsetY, size_t indices[4], float weights[4]) const;
+
+private:
+    uint32_t m_width;
+    uint32_t m_height;
+    uint32_t m_blocksX;
+    uint32_t m_blocksY;
+    uint32_t m_frameIndex;
+
+    /// Pixels marched this frame, one per block, and the distances of their cloud
+    std::vector<vec4> m_samples;
+    std::vector<float> m_sampleDistances;
+    /// Resolved image of the previous frame (saturated rgba) and the depth along the view axis each pixel was resolved
+    /// at, 0 where the ray missed the box
+    std::vector<vec4> m_history;
+    std::vector<float> m_historyDepth;
+    std::vector<vec4> m_nextHistory;
+    std::vector<float> m_nextHistoryDepth;
+    bool m_historyValid;
+    CloudMarchCamera m_previousCamera;
+
+    uint64_t m_reprojectedCount;
+    uint64_t m_rejectedCount;
+};
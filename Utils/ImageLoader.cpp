@@ -1,462 +1,421 @@
 #include "ImageLoader.h"
-#include "../Noise/2d/WorleyNoise2D.h"
-#include "../Noise/2d/PerlinNoise2D.h"
-#include "../Noise/2d/BlueNoise2D.h"
-#include "../Noise/3d/WorleyNoise3D.h"
-#include "../Noise/3d/PerlinNoise3D.h"
+#include "NoiseCache.h"
+#include "NoiseBaker.h"
+#include "NoiseMipChain.h"
+#include "NoiseBlockCompressor.h"
+#include "NoiseGraph.h"
+#include "NoiseBrickVolume.h"
+#include "CloudOccupancyGrid.h"
+#include "CloudLightVolume.h"
+#include "TaskScheduler.h"
+#include "../Noise/NoiseVersion.h"
 
-#include "../../../../../Common_3/Utilities/ThirdParty/OpenSource/Nothings/stb_image_write.h"
 #include "../../../../../Common_3/Resources/ResourceLoader/Interfaces/IResourceLoader.h"
 #include "../../../../../Common_3/Graphics/Interfaces/IGraphics.h"
-#include "../../../../../Common_3/Utilities/Interfaces/IMemory.h"
+#include "../../../../../Common_3/Utilities/Interfaces/ILog.h"
 
-/// Map a value from from the [l0-h0] to [l1-h1] range
-float remap(float val, float l0, float h0, float l1, float h1)
-{
-	return l1 + (val - l0) * (h1 - l1) / (h0 - l0);
-}
+#include <cmath>
+#include <cstring>
+#include <vector>
 
-/* --------------------------------- Public methods --------------------------------- */
+// bump when the packing of a cached texture changes (remaps, thresholds...), the channel layout is part of the key
+static const uint32_t kBakeVersion = 1;
 
-void ImageLoader::saveOneChannel(const std::string& filename, const std::vector<float>& data, int width, int height)
+static TinyImageFormat getTextureFormat(NoiseChannelLayout layout)
 {
-	char* imageData = (char*)tf_malloc(width * height * 3);
-	for (int j = 0; j < height; j++) {
-		for (int i = 0; i < width; i++) {
-			int srcIndex = j * width + i;
-			int dstIndex = 3 * srcIndex;
-			unsigned char pixel = static_cast<unsigned char>(data[srcIndex] * 255);
-			imageData[dstIndex] = pixel;
-			imageData[dstIndex + 1] = pixel;
-			imageData[dstIndex + 2] = pixel;
-		}
+	switch (layout)
+	{
+	case NoiseChannelLayout::R8:
+		return TinyImageFormat_R8_UNORM;
+	case NoiseChannelLayout::R16_UNORM:
+		return TinyImageFormat_R16_UNORM;
+	case NoiseChannelLayout::R16F:
+		return TinyImageFormat_R16_SFLOAT;
+	case NoiseChannelLayout::RG8:
+		return TinyImageFormat_R8G8_UNORM;
+	case NoiseChannelLayout::BC4:
+		return TinyImageFormat_DXBC4_UNORM;
+	case NoiseChannelLayout::BC5:
+		return TinyImageFormat_DXBC5_UNORM;
+	case NoiseChannelLayout::RGBA8:
+	default:
+		return TinyImageFormat_R8G8B8A8_UNORM;
 	}
-	stbi_write_png(filename.c_str(), width, height, 3, imageData, width * 3);
-	
-	tf_free(imageData);
 }
 
-/* --------------------------------- 2D Noise Texture --------------------------------- */
-
-void ImageLoader::genTestTexture(uint32_t width, uint32_t height, std::vector<float>& data)
+/// Copy depth slices of height rows of rowSize bytes
+static void copyRows(const uint8_t* pSrc, size_t srcRowStride, size_t srcSliceStride, uint8_t* pDst, size_t dstRowStride, size_t dstSliceStride,
+	size_t rowSize, uint32_t height, uint32_t depth)
 {
-
-	data.reserve(width * height);
-
-	IVector2 dim = IVector2(width, height);
-	WorleyNoise2D worleyGenerator2D(dim, 3);
-	WorleyNoise2D worleyGenerator2DFirst(dim, 6);
-	WorleyNoise2D worleyGenerator2DSecond(dim, 12);
-	WorleyNoise2D worleyGenerator2DThird(dim, 24);
-	WorleyNoise2D worleyGenerator2DFourth(dim, 32);
-	WorleyNoise2D worleyGenerator2DFifth(dim, 64);
-	PerlinNoise2D perlinGenerator2D(dim, IVector2(64), 3, 1.0f, 42);
-	PerlinNoise2D weatherGenerator2D(IVector2(width, height), IVector2(64, 64), 5, 0.1f, 42);
-
-
-	float threshold = 0.2f;
-
-	for (uint32_t y = 0; y < height; ++y)
+	for (uint32_t z = 0; z < depth; ++z)
 	{
-		for (uint32_t x = 0; x < width; ++x)
+		for (uint32_t y = 0; y < height; ++y)
 		{
-			float worley = worleyGenerator2D.evaluate(x, y);
-			worley = 1.0f - worley;
-			float perlin = perlinGenerator2D.evaluate(x, y);
-			// remap perlin with worley (ie: keep worley values when high)
-			float c = remap(perlin, 0.0f, 1.0, worley, 1.0);
-
-			float extrusionFactor = 0.5f * worleyGenerator2DFirst.evaluate(x, y)
-				+ 0.25f * worleyGenerator2DSecond.evaluate(x, y)
-				+ 0.175f * worleyGenerator2DThird.evaluate(x, y)
-				+ 0.075f * worleyGenerator2DFourth.evaluate(x, y);
-
-			float detail = 0.625f * worleyGenerator2DThird.evaluate(x, y)
-				+ 0.25f * worleyGenerator2DFourth.evaluate(x, y)
-				+ 0.125f * worleyGenerator2DFifth.evaluate(x, y);
-
-			float afterExtrude = saturate(remap(c, 1.0f - extrusionFactor, 1.0f, 0.0f, 1.0f));
-
-			float w = weatherGenerator2D.evaluate(x, y);
-			w = max(w - threshold, 0.0f);
-			w = min(1.0f, remap(w, 0.0f, 1.0f - threshold, 0.0f, 1.0f));
-			w *= 1.6f;
-			w = min(w, 1.0f);
-
-			float afterWeather = saturate(remap(afterExtrude, 1.0f - w, 1.0f, 0.0f, 1.0f));
-
-			float final = saturate(remap(afterWeather, detail, 1.0f, 0.0f, 1.0f));
-
-			//afterWeather = afterExtrude * w;
-			//detail = worleyGenerator3DFourth.evaluate(x, y, z);;
-
-			int32_t cr = (int32_t)(c * 255.0f);
-			int32_t cg = (int32_t)(extrusionFactor * 255.0f);
-			int32_t cb = (int32_t)(detail * 255.0f);
-
-			data[y * height + x] = perlin; // (cr) << 16 | (cr) << 8 | (cr) << 0;
+			memcpy(pDst + dstSliceStride * z + dstRowStride * y, pSrc + srcSliceStride * z + srcRowStride * y, rowSize);
 		}
 	}
 }
 
-
-void ImageLoader::genTexture(const std::vector<float>& data, int width, int height, Texture** pOutTexture)
+/// Copy the cached texels of key to pDst, false on a miss
+static bool loadCachedTexels(uint64_t key, uint32_t width, uint32_t height, uint32_t depth, uint32_t bytesPerTexel,
+	uint8_t* pDst, size_t rowStride, size_t sliceStride)
 {
-	TextureDesc desc = {};
-	desc.mArraySize = 1;
-	desc.mFormat = TinyImageFormat_R8G8B8A8_UNORM;
-	desc.mDepth = 1;
-	desc.mWidth = width;
-	desc.mHeight = height;
-	desc.mMipLevels = 1;
-	desc.mSampleCount = SAMPLE_COUNT_1;
-	desc.mDescriptors = DESCRIPTOR_TYPE_TEXTURE;
-	desc.mStartState = RESOURCE_STATE_COMMON;
-	TextureLoadDesc textureDesc = {};
-	textureDesc.pDesc = &desc;
-	textureDesc.ppTexture = pOutTexture;
-	addResource(&textureDesc, NULL);
+	NoiseCache::Entry entry;
+	if (!NoiseCache::open(key, width, height, depth, bytesPerTexel, entry))
+		return false;
 
-	uint32_t    slice = 0;
-	TextureUpdateDesc updateDesc = {};
-	updateDesc.pTexture = *pOutTexture;
-	updateDesc.mArrayLayer = slice;
-	beginUpdateResource(&updateDesc);
+	size_t rowSize = size_t(width) * bytesPerTexel;
+	copyRows(entry.pTexels, rowSize, rowSize * height, pDst, rowStride, sliceStride, rowSize, height, depth);
+
+	NoiseCache::close(entry);
+	return true;
+}
 
-	for (size_t y = 0; y < updateDesc.mRowCount; ++y)
+/// Bake level 0 (or load it from the cache) on the CPU, filter the rest of the mip chain of pTexture and upload every level.
+/// Also the path of the block compressed layouts: the chain is built in the source layout and each level is encoded into the mapped blocks.
+/// A cacheKey of 0 always bakes
+static void uploadMipChain(Texture* pTexture, uint64_t cacheKey, uint32_t width, uint32_t height, uint32_t depth,
+	NoiseChannelLayout layout, const std::function<void(NoiseSink&)>& bake, SyncToken* pSyncToken)
+{
+	bool compressed = NoiseBlockCompressor::isBlockCompressed(layout);
+	NoiseChannelLayout sourceLayout = NoiseBlockCompressor::getSourceLayout(layout);
+	NoiseMipChain mipChain(sourceLayout, width, height, depth, pTexture->mMipLevels);
+	uint32_t bytesPerTexel = PackedRowSink::getBytesPerTexel(sourceLayout);
+	if (cacheKey == 0 || !loadCachedTexels(cacheKey, width, height, depth, bytesPerTexel, mipChain.getData(0), mipChain.getRowStride(0), mipChain.getSliceStride(0)))
 	{
-		uint32_t* scanline = (uint32_t*)(updateDesc.pMappedData + (y * updateDesc.mDstRowStride));
-		for (size_t x = 0; x < width; ++x)
+		PackedRowSink sink = mipChain.getSink();
+		bake(sink);
+		if (cacheKey != 0)
+			NoiseCache::store(cacheKey, width, height, depth, bytesPerTexel, mipChain.getData(0), mipChain.getRowStride(0), mipChain.getSliceStride(0));
+	}
+	mipChain.build();
+
+	// every level is queued without waiting in between, they are uploaded in the same batch
+	NoiseCompressionStats stats;
+	for (uint32_t level = 0; level < mipChain.getLevelCount(); ++level)
+	{
+		TextureUpdateDesc updateDesc = {};
+		updateDesc.pTexture = pTexture;
+		updateDesc.mMipLevel = level;
+		updateDesc.mArrayLayer = 0;
+		beginUpdateResource(&updateDesc);
+		if (compressed)
+		{
+			stats.merge(NoiseBlockCompressor::encode(layout, mipChain.getData(level), mipChain.getRowStride(level), mipChain.getSliceStride(level),
+				mipChain.getWidth(level), mipChain.getHeight(level), mipChain.getDepth(level),
+				updateDesc.pMappedData, updateDesc.mDstRowStride, updateDesc.mDstSliceStride));
+		}
+		else
 		{
-			float c = data[width * y + x];
-			int32_t cr = (int32_t)(c * 255.0f);
-			int32_t cg = (int32_t)(c * 255.0f);
-			int32_t cb = (int32_t)(c * 255.0f);
-			scanline[x] = (cb) << 16 | (cg) << 8 | (cr) << 0;
+			copyRows(mipChain.getData(level), mipChain.getRowStride(level), mipChain.getSliceStride(level),
+				updateDesc.pMappedData, updateDesc.mDstRowStride, updateDesc.mDstSliceStride,
+				mipChain.getRowStride(level), mipChain.getHeight(level), mipChain.getDepth(level));
 		}
+		endUpdateResource(&updateDesc, pSyncToken);
 	}
 
-	endUpdateResource(&updateDesc, NULL);
+	if (compressed)
+	{
+		LOGF(LogLevel::eINFO, "ImageLoader: %s %ux%ux%u (%u mips) encoded, rmse %.3f, psnr %.2f dB, max error %u",
+			layout == NoiseChannelLayout::BC4 ? "BC4" : "BC5", width, height, depth, mipChain.getLevelCount(),
+			stats.getRmse(), stats.getPsnr(), stats.maxError);
+	}
 }
 
-void ImageLoader::genBlueNoiseTexture(uint32_t width, uint32_t height, Texture** pOutTexture)
+/// Upload a level of pTexture from tightly packed rows of rowSize bytes
+static void uploadPackedTexels(Texture* pTexture, const uint8_t* pTexels, size_t rowSize, uint32_t height, uint32_t depth,
+	SyncToken* pSyncToken, uint32_t level = 0)
 {
-	BlueNoise2D blueNoiseGenerator(IVector2(width, height));
-
-	TextureDesc desc = {};
-	desc.mArraySize = 1;
-	desc.mFormat = TinyImageFormat_R8G8B8A8_UNORM;
-	desc.mDepth = 1;
-	desc.mWidth = width;
-	desc.mHeight = height;
-	desc.mMipLevels = 1;
-	desc.mSampleCount = SAMPLE_COUNT_1;
-	desc.mDescriptors = DESCRIPTOR_TYPE_TEXTURE;
-	desc.mStartState = RESOURCE_STATE_COMMON;
-	TextureLoadDesc textureDesc = {};
-	textureDesc.pDesc = &desc;
-	textureDesc.ppTexture = pOutTexture;
-	addResource(&textureDesc, NULL);
-
-	uint32_t    slice = 0;
 	TextureUpdateDesc updateDesc = {};
-	updateDesc.pTexture = *pOutTexture;
-	updateDesc.mArrayLayer = slice;
+	updateDesc.pTexture = pTexture;
+	updateDesc.mMipLevel = level;
+	updateDesc.mArrayLayer = 0;
 	beginUpdateResource(&updateDesc);
+	copyRows(pTexels, rowSize, rowSize * height, updateDesc.pMappedData, updateDesc.mDstRowStride, updateDesc.mDstSliceStride,
+		rowSize, height, depth);
+	endUpdateResource(&updateDesc, pSyncToken);
+}
 
-	for (uint32_t y = 0; y < updateDesc.mRowCount; ++y)
-	{
-		uint32_t* scanline = (uint32_t*)(updateDesc.pMappedData + (y * updateDesc.mDstRowStride));
-		for (uint32_t x = 0; x < width; ++x)
-		{
-			float c = blueNoiseGenerator.evaluate(x, y);
-			int32_t cr = (int32_t)(c * 255.0f);
-			int32_t cg = (int32_t)(c * 255.0f);
-			int32_t cb = (int32_t)(c * 255.0f);
-			scanline[x] = (cb) << 16 | (cg) << 8 | (cr) << 0;
-		}
-	}
-
-	endUpdateResource(&updateDesc, NULL);
+static uint64_t getWeatherKey(uint32_t width, uint32_t height, float scale, int randomSeed, NoiseChannelLayout layout)
+{
+	return NoiseCache::Key().add("Weather").add(kBakeVersion).add(NoiseVersion::PerlinNoise2D)
+		.add(width).add(height).add(scale).add(randomSeed).add(uint32_t(layout)).get();
 }
 
-void ImageLoader::genPerlinFBMTexture(uint32_t width, uint32_t height, Texture** pOutTexture)
+static uint64_t getCloudShapeKey(uint32_t width, uint32_t height, uint32_t depth, int randomSeed, NoiseChannelLayout layout)
 {
-	PerlinNoise2D perlinGenerator(IVector2(width, height), IVector2(64, 64), 3, 1.0f, 42);
+	return NoiseCache::Key().add("CloudShape").add(kBakeVersion).add(NoiseVersion::WorleyNoise3D)
+		.add(NoiseVersion::PerlinNoise3D).add(width).add(height).add(depth).add(randomSeed).add(uint32_t(layout)).get();
+}
 
+/// Texture of layout with room for mipLevels levels, filled afterwards by uploadTexels
+static void addNoiseTexture(uint32_t width, uint32_t height, uint32_t depth, uint32_t mipLevels, NoiseChannelLayout layout,
+	Texture** pOutTexture, SyncToken* pSyncToken)
+{
 	TextureDesc desc = {};
 	desc.mArraySize = 1;
-	desc.mFormat = TinyImageFormat_R8G8B8A8_UNORM;
-	desc.mDepth = 1;
+	desc.mFormat = getTextureFormat(layout);
+	//desc.mFlags = TextureCreationFlags::TEXTURE_CREATION_FLAG_FORCE_3D;
 	desc.mWidth = width;
 	desc.mHeight = height;
-	desc.mMipLevels = 1;
+	desc.mDepth = depth;
+	desc.mMipLevels = mipLevels;
 	desc.mSampleCount = SAMPLE_COUNT_1;
 	desc.mDescriptors = DESCRIPTOR_TYPE_TEXTURE;
 	desc.mStartState = RESOURCE_STATE_COMMON;
 	TextureLoadDesc textureDesc = {};
 	textureDesc.pDesc = &desc;
 	textureDesc.ppTexture = pOutTexture;
-	addResource(&textureDesc, NULL);
+	addResource(&textureDesc, pSyncToken);
+}
+
+/// Fill pTexture with bake, or with the cached texels of cacheKey (0 always bakes).
+/// A single level is baked straight into the mapped rows, mip chains and block compressed layouts are staged on the CPU
+static void uploadTexels(Texture* pTexture, uint64_t cacheKey, uint32_t width, uint32_t height, uint32_t depth,
+	NoiseChannelLayout layout, const std::function<void(NoiseSink&)>& bake, SyncToken* pSyncToken)
+{
+	if (pTexture->mMipLevels > 1 || NoiseBlockCompressor::isBlockCompressed(layout))
+	{
+		uploadMipChain(pTexture, cacheKey, width, height, depth, layout, bake, pSyncToken);
+		return;
+	}
 
-	uint32_t    slice = 0;
 	TextureUpdateDesc updateDesc = {};
-	updateDesc.pTexture = *pOutTexture;
-	updateDesc.mArrayLayer = slice;
+	updateDesc.pTexture = pTexture;
+	updateDesc.mArrayLayer = 0;
 	beginUpdateResource(&updateDesc);
 
-	for (uint32_t y = 0; y < updateDesc.mRowCount; ++y)
+	uint32_t bytesPerTexel = PackedRowSink::getBytesPerTexel(layout);
+	if (cacheKey == 0 || !loadCachedTexels(cacheKey, width, height, depth, bytesPerTexel,
+		updateDesc.pMappedData, updateDesc.mDstRowStride, updateDesc.mDstSliceStride))
 	{
-		uint32_t* scanline = (uint32_t*)(updateDesc.pMappedData + (y * updateDesc.mDstRowStride));
-		for (uint32_t x = 0; x < width; ++x)
-		{
-			float c = perlinGenerator.evaluate(x, y);
-			int32_t cr = (int32_t)(c * 255.0f);
-			int32_t cg = (int32_t)(c * 255.0f);
-			int32_t cb = (int32_t)(c * 255.0f);
-			scanline[x] = (cb) << 16 | (cg) << 8 | (cr) << 0;
-		}
+		PackedRowSink sink(layout, updateDesc.pMappedData, updateDesc.mDstRowStride, updateDesc.mDstSliceStride);
+		bake(sink);
+		if (cacheKey != 0)
+			NoiseCache::store(cacheKey, width, height, depth, bytesPerTexel, updateDesc.pMappedData, updateDesc.mDstRowStride, updateDesc.mDstSliceStride);
 	}
 
-	endUpdateResource(&updateDesc, NULL);
+	endUpdateResource(&updateDesc, pSyncToken);
 }
 
-void ImageLoader::genWorleyFBMTexture(uint32_t width, uint32_t height, Texture** pOutTexture)
+/* --------------------------------- 2D Noise Texture --------------------------------- */
+
+void ImageLoader::genTestTexture(uint32_t width, uint32_t height, NoiseSink& sink)
 {
-	WorleyNoise2D firstWorleyGenerator(IVector2(width, height), 3);
-	WorleyNoise2D secondWorleyGenerator(IVector2(width, height), 6);
-	WorleyNoise2D thirdWorleyGenerator(IVector2(width, height), 12);
+	NoiseGraph graph(width, height);
+	NoiseGraph::Node worley = graph.invert(graph.worley2D(3));
+	NoiseGraph::Node perlin = graph.perlin2D(IVector2(64), 3, 1.0f, 42);
+	// remap perlin with worley (ie: keep worley values when high)
+	NoiseGraph::Node c = graph.remap(perlin, graph.constant(0.0f), graph.constant(1.0f), worley, graph.constant(1.0f));
+
+	// octaves 24 and 32 are shared by the extrusion and the detail
+	NoiseGraph::Node extrusionFactor = graph.weightedSum({
+		{ graph.worley2D(6), 0.5f },
+		{ graph.worley2D(12), 0.25f },
+		{ graph.worley2D(24), 0.175f },
+		{ graph.worley2D(32), 0.075f } });
+	NoiseGraph::Node detail = graph.weightedSum({
+		{ graph.worley2D(24), 0.625f },
+		{ graph.worley2D(32), 0.25f },
+		{ graph.worley2D(64), 0.125f } });
+
+	graph.addOutput(c);
+	graph.addOutput(extrusionFactor);
+	graph.addOutput(detail);
+	graph.evaluate(sink);
+}
 
-	TextureDesc desc = {};
-	desc.mArraySize = 1;
-	desc.mFormat = TinyImageFormat_R8G8B8A8_UNORM;
-	desc.mDepth = 1;
-	desc.mWidth = width;
-	desc.mHeight = height;
-	desc.mMipLevels = 1;
-	desc.mSampleCount = SAMPLE_COUNT_1;
-	desc.mDescriptors = DESCRIPTOR_TYPE_TEXTURE;
-	desc.mStartState = RESOURCE_STATE_COMMON;
-	TextureLoadDesc textureDesc = {};
-	textureDesc.pDesc = &desc;
-	textureDesc.ppTexture = pOutTexture;
-	addResource(&textureDesc, NULL);
+void ImageLoader::genTexture(int width, int height, Texture** pOutTexture, const std::function<void(NoiseSink&)>& generate,
+	NoiseChannelLayout layout, SyncToken* pSyncToken)
+{
+	addNoiseTexture(width, height, 1, 1, layout, pOutTexture, pSyncToken);
+	uploadTexels(*pOutTexture, 0, width, height, 1, layout, generate, pSyncToken);
+}
 
-	uint32_t    slice = 0;
-	TextureUpdateDesc updateDesc = {};
-	updateDesc.pTexture = *pOutTexture;
-	updateDesc.mArrayLayer = slice;
-	beginUpdateResource(&updateDesc);
+void ImageLoader::genGraphTexture(const NoiseGraph& graph, Texture** pOutTexture, NoiseChannelLayout layout, bool generateMips,
+	SyncToken* pSyncToken)
+{
+	uint32_t width = graph.getWidth();
+	uint32_t height = graph.getHeight();
+	uint32_t depth = graph.getDepth();
+	uint32_t mipLevels = generateMips ? NoiseMipChain::getFullLevelCount(width, height, depth) : 1;
+	addNoiseTexture(width, height, depth, mipLevels, layout, pOutTexture, pSyncToken);
+
+	uint64_t cacheKey = NoiseCache::Key().add("Graph").add(kBakeVersion).add(graph.getHash())
+		.add(width).add(height).add(depth).add(uint32_t(layout)).get();
+	uploadTexels(*pOutTexture, cacheKey, width, height, depth, layout,
+		[&](NoiseSink& sink) { graph.evaluate(sink); }, pSyncToken);
+}
 
-	for (uint32_t y = 0; y < updateDesc.mRowCount; ++y)
-	{
-		uint32_t* scanline = (uint32_t*)(updateDesc.pMappedData + (y * updateDesc.mDstRowStride));
-		for (uint32_t x = 0; x < width; ++x)
+void ImageLoader::genConstantTexture(uint32_t width, uint32_t height, uint32_t depth, float value, Texture** pOutTexture,
+	NoiseChannelLayout layout, SyncToken* pSyncToken)
+{
+	addNoiseTexture(width, height, depth, 1, layout, pOutTexture, pSyncToken);
+	uploadTexels(*pOutTexture, 0, width, height, depth, layout,
+		[&](NoiseSink& sink)
 		{
-			float c = 0.625f * firstWorleyGenerator.evaluate(x, y)
-				+ 0.25f * secondWorleyGenerator.evaluate(x, y)
-				+ 0.125f * thirdWorleyGenerator.evaluate(x, y);
-			// invert worley noise
-			c = 1.0f - c;
-
-			int32_t cr = (int32_t)(c * 255.0f);
-			int32_t cg = (int32_t)(c * 255.0f);
-			int32_t cb = (int32_t)(c * 255.0f);
-			scanline[x] = (cb) << 16 | (cg) << 8 | (cr) << 0;
-		}
-	}
-
-	endUpdateResource(&updateDesc, NULL);
+			std::vector<float> row(width, value);
+			for (uint32_t z = 0; z < depth; ++z)
+				for (uint32_t y = 0; y < height; ++y)
+					sink.writeRow(y, z, 0, width, row.data());
+		}, pSyncToken);
 }
 
-void ImageLoader::genWeatherTexture(uint32_t width, uint32_t height, Texture** pOutTexture, float scale, int randomSeed)
+void ImageLoader::genBlueNoiseTexture(uint32_t width, uint32_t height, Texture** pOutTexture, NoiseChannelLayout layout,
+	SyncToken* pSyncToken)
 {
-	PerlinNoise2D perlinGenerator(IVector2(width, height), IVector2(64, 64), 5, scale, randomSeed);
-
-	TextureDesc desc = {};
-	desc.mArraySize = 1;
-	desc.mFormat = TinyImageFormat_R8G8B8A8_UNORM;
-	desc.mDepth = 1;
-	desc.mWidth = width;
-	desc.mHeight = height;
-	desc.mMipLevels = 1;
-	desc.mSampleCount = SAMPLE_COUNT_1;
-	desc.mDescriptors = DESCRIPTOR_TYPE_TEXTURE;
-	desc.mStartState = RESOURCE_STATE_COMMON;
-	TextureLoadDesc textureDesc = {};
-	textureDesc.pDesc = &desc;
-	textureDesc.ppTexture = pOutTexture;
-	addResource(&textureDesc, NULL);
+	addNoiseTexture(width, height, 1, 1, layout, pOutTexture, pSyncToken);
 
-	updateWeatherTexture(width, height, pOutTexture, scale, randomSeed);
+	uint64_t cacheKey = NoiseCache::Key().add("BlueNoise").add(kBakeVersion).add(NoiseVersion::BlueNoise2D)
+		.add(width).add(height).add(uint32_t(layout)).get();
+	uploadTexels(*pOutTexture, cacheKey, width, height, 1, layout,
+		[&](NoiseSink& sink) { NoiseBaker::bakeBlueNoise(width, height, sink); }, pSyncToken);
 }
 
-void ImageLoader::updateWeatherTexture(uint32_t width, uint32_t height, Texture** pOutTexture, float scale, int randomSeed)
+void ImageLoader::genPerlinFBMTexture(uint32_t width, uint32_t height, Texture** pOutTexture, NoiseChannelLayout layout,
+	SyncToken* pSyncToken)
 {
-	PerlinNoise2D perlinGenerator(IVector2(width, height), IVector2(64, 64), 5, scale, randomSeed);
+	addNoiseTexture(width, height, 1, 1, layout, pOutTexture, pSyncToken);
+	uploadTexels(*pOutTexture, 0, width, height, 1, layout,
+		[&](NoiseSink& sink) { NoiseBaker::bakePerlinFBM(width, height, sink); }, pSyncToken);
+}
 
-	uint32_t    slice = 0;
-	TextureUpdateDesc updateDesc = {};
-	updateDesc.pTexture = *pOutTexture;
-	updateDesc.mArrayLayer = slice;
-	beginUpdateResource(&updateDesc);
+void ImageLoader::genWorleyFBMTexture(uint32_t width, uint32_t height, Texture** pOutTexture, NoiseChannelLayout layout,
+	SyncToken* pSyncToken)
+{
+	addNoiseTexture(width, height, 1, 1, layout, pOutTexture, pSyncToken);
+	uploadTexels(*pOutTexture, 0, width, height, 1, layout,
+		[&](NoiseSink& sink) { NoiseBaker::bakeWorleyFBM(width, height, sink); }, pSyncToken);
+}
 
-	float threshold = 0.2f;
-	float tresholdLimit = 1.0f - threshold;
-	for (uint32_t y = 0; y < updateDesc.mRowCount; ++y)
-	{
-		uint32_t* scanline = (uint32_t*)(updateDesc.pMappedData + (y * updateDesc.mDstRowStride));
-		for (uint32_t x = 0; x < width; ++x)
-		{
-			float c = perlinGenerator.evaluate(x, y);
-			c = max(c - threshold, 0.0f);
-			c = min(1.0f, remap(c, 0.0f, 1.0f - threshold, 0.0f, 1.0f));
-			//c = 1.0f - c;
-
-			int32_t cr = (int32_t)(c * 255.0f);
-			int32_t cg = (int32_t)(c * 255.0f);
-			int32_t cb = (int32_t)(c * 255.0f);
-			scanline[x] = (cb) << 16 | (cg) << 8 | (cr) << 0;
-		}
-	}
+void ImageLoader::genWeatherTexture(uint32_t width, uint32_t height, Texture** pOutTexture, float scale, int randomSeed,
+	NoiseChannelLayout layout, bool generateMips, SyncToken* pSyncToken)
+{
+	uint32_t mipLevels = generateMips ? NoiseMipChain::getFullLevelCount(width, height, 1) : 1;
+	addNoiseTexture(width, height, 1, mipLevels, layout, pOutTexture, pSyncToken);
+	updateWeatherTexture(width, height, pOutTexture, scale, randomSeed, layout, pSyncToken);
+}
 
-	endUpdateResource(&updateDesc, NULL);
+void ImageLoader::updateWeatherTexture(uint32_t width, uint32_t height, Texture** pOutTexture, float scale, int randomSeed,
+	NoiseChannelLayout layout, SyncToken* pSyncToken)
+{
+	uint64_t cacheKey = getWeatherKey(width, height, scale, randomSeed, layout);
+	uploadTexels(*pOutTexture, cacheKey, width, height, 1, layout,
+		[&](NoiseSink& sink) { NoiseBaker::bakeWeather(width, height, scale, randomSeed, sink); }, pSyncToken);
 }
 
 /* --------------------------------- 3D Noise Texture --------------------------------- */
 
-void ImageLoader::gen3DNoiseTexture(uint32_t width, uint32_t height, uint32_t depth, Texture** pOutTexture, int randomSeed)
+void ImageLoader::gen3DNoiseTexture(uint32_t width, uint32_t height, uint32_t depth, Texture** pOutTexture, int randomSeed,
+	NoiseChannelLayout layout, SyncToken* pSyncToken)
 {
-	WorleyNoise3D firstWorleyGenerator(IVector3(width, height, depth), 3, randomSeed);
-	WorleyNoise3D secondWorleyGenerator(IVector3(width, height, depth), 6, randomSeed);
-	WorleyNoise3D thirdWorleyGenerator(IVector3(width, height, depth), 12, randomSeed);
+	addNoiseTexture(width, height, depth, 1, layout, pOutTexture, pSyncToken);
 
-	TextureDesc desc = {};
-	desc.mArraySize = 1;
-	desc.mFormat = TinyImageFormat_R8G8B8A8_UNORM;
-	//desc.mFlags = TextureCreationFlags::TEXTURE_CREATION_FLAG_FORCE_3D;
-	desc.mWidth = width;
-	desc.mHeight = height;
-	desc.mDepth = depth;
-	desc.mMipLevels = 1;
-	desc.mSampleCount = SAMPLE_COUNT_1;
-	desc.mDescriptors = DESCRIPTOR_TYPE_TEXTURE;
-	desc.mStartState = RESOURCE_STATE_COMMON;
-	TextureLoadDesc textureDesc = {};
-	textureDesc.pDesc = &desc;
-	textureDesc.ppTexture = pOutTexture;
-	addResource(&textureDesc, NULL);
+	uint64_t cacheKey = NoiseCache::Key().add("3DNoise").add(kBakeVersion).add(NoiseVersion::WorleyNoise3D)
+		.add(width).add(height).add(depth).add(randomSeed).add(uint32_t(layout)).get();
+	uploadTexels(*pOutTexture, cacheKey, width, height, depth, layout,
+		[&](NoiseSink& sink) { NoiseBaker::bake3DNoise(width, height, depth, randomSeed, sink); }, pSyncToken);
+}
 
-	uint32_t    layer = 0;
-	TextureUpdateDesc updateDesc = {};
-	updateDesc.pTexture = *pOutTexture;
-	updateDesc.mArrayLayer = layer;
-	beginUpdateResource(&updateDesc);
+void ImageLoader::genCloudShapeTexture(uint32_t width, uint32_t height, uint32_t depth, Texture** pOutTexture, int randomSeed,
+	NoiseChannelLayout layout, bool generateMips, SyncToken* pSyncToken)
+{
+	uint32_t mipLevels = generateMips ? NoiseMipChain::getFullLevelCount(width, height, depth) : 1;
+	addNoiseTexture(width, height, depth, mipLevels, layout, pOutTexture, pSyncToken);
+	updateCloudShapeTexture(width, height, depth, pOutTexture, randomSeed, layout, pSyncToken);
+}
 
-	for (uint32_t z = 0; z < depth; ++z) 
+void ImageLoader::updateCloudShapeTexture(uint32_t width, uint32_t height, uint32_t depth, Texture** pOutTexture, int randomSeed,
+	NoiseChannelLayout layout, SyncToken* pSyncToken)
+{
+	uint64_t cacheKey = getCloudShapeKey(width, height, depth, randomSeed, layout);
+	uploadTexels(*pOutTexture, cacheKey, width, height, depth, layout,
+		[&](NoiseSink& sink) { NoiseBaker::bakeCloudShape(width, height, depth, randomSeed, sink); }, pSyncToken);
+}
+
+void ImageLoader::genCloudShapeBricks(uint32_t width, uint32_t height, uint32_t depth, int randomSeed, uint32_t weatherWidth,
+	uint32_t weatherHeight, float weatherScale, int weatherSeed, Texture** pOutIndex, Texture** pOutPool, Texture** pOutDetail,
+	SyncToken* pSyncToken)
+{
+	// the dense shape and the weather are only staged on the CPU, they share the cache entries of their R8 / RGBA8 textures
+	const NoiseChannelLayout layout = NoiseChannelLayout::RGBA8;
+	size_t rowStride = size_t(width) * PackedRowSink::getBytesPerTexel(layout);
+	size_t sliceStride = rowStride * height;
+	std::vector<uint8_t> shape(sliceStride * depth);
+	uint64_t cacheKey = getCloudShapeKey(width, height, depth, randomSeed, layout);
+	if (!loadCachedTexels(cacheKey, width, height, depth, 4, shape.data(), rowStride, sliceStride))
 	{
-		uint32_t* dstSliceData = (uint32_t*)updateDesc.pMappedData + updateDesc.mDstSliceStride * z;
+		PackedRowSink sink(layout, shape.data(), rowStride, sliceStride);
+		NoiseBaker::bakeCloudShape(width, height, depth, randomSeed, sink);
+		NoiseCache::store(cacheKey, width, height, depth, 4, shape.data(), rowStride, sliceStride);
+	}
 
-		float test = (z / float(depth));
+	std::vector<uint8_t> weather(size_t(weatherWidth) * weatherHeight);
+	cacheKey = getWeatherKey(weatherWidth, weatherHeight, weatherScale, weatherSeed, NoiseChannelLayout::R8);
+	if (!loadCachedTexels(cacheKey, weatherWidth, weatherHeight, 1, 1, weather.data(), weatherWidth, weather.size()))
+	{
+		PackedRowSink sink(NoiseChannelLayout::R8, weather.data(), weatherWidth);
+		NoiseBaker::bakeWeather(weatherWidth, weatherHeight, weatherScale, weatherSeed, sink);
+		NoiseCache::store(cacheKey, weatherWidth, weatherHeight, 1, 1, weather.data(), weatherWidth, weather.size());
+	}
 
-		for (uint32_t y = 0; y < updateDesc.mRowCount; ++y)
+	// base and extrusion go to the bricks, the detail is sampled at another scale and position so it stays dense
+	size_t texelCount = size_t(width) * height;
+	std::vector<uint8_t> base(texelCount * depth * 2);
+	std::vector<uint8_t> detail(texelCount * depth);
+	TaskScheduler::parallelFor(depth, [&](uint32_t z)
+	{
+		const uint8_t* pSrc = &shape[sliceStride * z];
+		for (size_t i = 0; i < texelCount; ++i)
 		{
-			//uint32_t* scanline = (uint32_t*)(dstSliceData + (y * updateDesc.mDstRowStride));
-			uint32_t* scanline = (uint32_t*)(updateDesc.pMappedData + updateDesc.mDstSliceStride * z + (y * updateDesc.mDstRowStride));
-			for (uint32_t x = 0; x < width; ++x)
-			{
-				float c = 0.625f * firstWorleyGenerator.evaluate(x, y, z)
-					+ 0.25f * secondWorleyGenerator.evaluate(x, y, z)
-					+ 0.125f * thirdWorleyGenerator.evaluate(x, y, z);
-				// invert worley noise
-				c = 1.0f - c;
-
-				int32_t cr = (int32_t)(c * 255.0f);
-				int32_t cg = (int32_t)(c * 255.0f);
-				int32_t cb = (int32_t)(c * 255.0f);
-				scanline[x] = (cb) << 16 | (cg) << 8 | (cr) << 0;
-			}
+			base[(texelCount * z + i) * 2 + 0] = pSrc[i * 4 + 0];
+			base[(texelCount * z + i) * 2 + 1] = pSrc[i * 4 + 1];
+			detail[texelCount * z + i] = pSrc[i * 4 + 2];
 		}
-	}
+	});
 
-	endUpdateResource(&updateDesc, NULL);
-}
+	NoiseBrickVolume bricks(NoiseChannelLayout::RG8, width, height, depth, 8);
+	bricks.buildCloudShape(base.data(), size_t(width) * 2, size_t(width) * 2 * height, weather.data(), weatherWidth, weatherHeight);
 
-void ImageLoader::genCloudShapeTexture(uint32_t width, uint32_t height, uint32_t depth, Texture** pOutTexture, int randomSeed)
-{
-	TextureDesc desc = {};
-	desc.mArraySize = 1;
-	desc.mFormat = TinyImageFormat_R8G8B8A8_UNORM;
-	//desc.mFlags = TextureCreationFlags::TEXTURE_CREATION_FLAG_FORCE_3D;
-	desc.mWidth = width;
-	desc.mHeight = height;
-	desc.mDepth = depth;
-	desc.mMipLevels = 1;
-	desc.mSampleCount = SAMPLE_COUNT_1;
-	desc.mDescriptors = DESCRIPTOR_TYPE_TEXTURE;
-	desc.mStartState = RESOURCE_STATE_COMMON;
-	TextureLoadDesc textureDesc = {};
-	textureDesc.pDesc = &desc;
-	textureDesc.ppTexture = pOutTexture;
-	addResource(&textureDesc, NULL);
+	addNoiseTexture(bricks.getGridWidth(), bricks.getGridHeight(), bricks.getGridDepth(), 1, NoiseChannelLayout::RGBA8, pOutIndex, pSyncToken);
+	std::vector<uint8_t> index = bricks.getIndexTexels();
+	uploadPackedTexels(*pOutIndex, index.data(), size_t(bricks.getGridWidth()) * 4, bricks.getGridHeight(), bricks.getGridDepth(), pSyncToken);
+
+	addNoiseTexture(bricks.getPoolWidth(), bricks.getPoolHeight(), bricks.getPoolDepth(), 1, NoiseChannelLayout::RG8, pOutPool, pSyncToken);
+	uploadPackedTexels(*pOutPool, bricks.getPoolData(), bricks.getPoolRowStride(), bricks.getPoolHeight(), bricks.getPoolDepth(), pSyncToken);
+
+	addNoiseTexture(width, height, depth, 1, NoiseChannelLayout::R8, pOutDetail, pSyncToken);
+	uploadPackedTexels(*pOutDetail, detail.data(), width, height, depth, pSyncToken);
 
-	updateCloudShapeTexture(width, height, depth, pOutTexture, randomSeed);
+	LOGF(LogLevel::eINFO, "ImageLoader: cloud shape bricks %u / %u kept, %.2f MB instead of %.2f MB", bricks.getBrickCount(),
+		bricks.getGridWidth() * bricks.getGridHeight() * bricks.getGridDepth(), (bricks.getSparseSize() + detail.size()) / 1048576.0,
+		shape.size() / 1048576.0);
 }
 
-void ImageLoader::updateCloudShapeTexture(uint32_t width, uint32_t height, uint32_t depth, Texture** pOutTexture, int randomSeed)
+void ImageLoader::genCloudOccupancyTexture(const CloudOccupancyGrid& grid, Texture** pOutTexture, SyncToken* pSyncToken)
 {
-	IVector3 dim = IVector3(width, height, depth);
-	WorleyNoise3D worleyGenerator3D(dim, 3, randomSeed);
-	WorleyNoise3D worleyGenerator3DFirst(dim, 6, randomSeed);
-	WorleyNoise3D worleyGenerator3DSecond(dim, 12, randomSeed);
-	WorleyNoise3D worleyGenerator3DThird(dim, 24, randomSeed);
-	WorleyNoise3D worleyGenerator3DFourth(dim, 32, randomSeed);
-	WorleyNoise3D worleyGenerator3DFifth(dim, 64, randomSeed);
-	PerlinNoise3D perlinGenerator3D(dim, 64, 3, 1.0f, randomSeed);
-
-	uint32_t    layer = 0;
-	TextureUpdateDesc updateDesc = {};
-	updateDesc.pTexture = *pOutTexture;
-	updateDesc.mArrayLayer = layer;
-	beginUpdateResource(&updateDesc);
-
-	for (uint32_t z = 0; z < depth; ++z)
+	// the levels of the grid halve like the mips of the texture
+	addNoiseTexture(grid.getWidth(0), grid.getHeight(0), grid.getDepth(0), grid.getLevelCount(), NoiseChannelLayout::R8, pOutTexture,
+		pSyncToken);
+	for (uint32_t level = 0; level < grid.getLevelCount(); ++level)
 	{
-		uint32_t* dstSliceData = (uint32_t*)updateDesc.pMappedData + updateDesc.mDstSliceStride * z;
-
-		float test = (z / float(depth));
-
-		for (uint32_t y = 0; y < updateDesc.mRowCount; ++y)
-		{
-			//uint32_t* scanline = (uint32_t*)(dstSliceData + (y * updateDesc.mDstRowStride));
-			uint32_t* scanline = (uint32_t*)(updateDesc.pMappedData + updateDesc.mDstSliceStride * z + (y * updateDesc.mDstRowStride));
-			for (uint32_t x = 0; x < width; ++x)
-			{
-				float worley = worleyGenerator3D.evaluate(x, y, z);
-				worley = 1.0f - worley;
-				float perlin = perlinGenerator3D.evaluate(x, y, z);
-				// remap perlin with worley (ie: keep worley values when high)
-				float c = remap(perlin, 0.0f, 1.0, worley, 1.0);
-
-				float extrusionFactor = 0.5f * worleyGenerator3DFirst.evaluate(x, y, z)
-					+ 0.25f * worleyGenerator3DSecond.evaluate(x, y, z)
-					+ 0.175f * worleyGenerator3DThird.evaluate(x, y, z)
-					+ 0.075f * worleyGenerator3DFourth.evaluate(x, y, z);
-
-				float detail = 0.625f * worleyGenerator3DThird.evaluate(x, y, z)
-					+ 0.25f * worleyGenerator3DFourth.evaluate(x, y, z)
-					+ 0.125f * worleyGenerator3DFifth.evaluate(x, y, z);
-
-				//detail = worleyGenerator3DFourth.evaluate(x, y, z);;
-
-				int32_t cr = (int32_t)(c * 255.0f);
-				int32_t cg = (int32_t)(extrusionFactor * 255.0f);
-				int32_t cb = (int32_t)(detail * 255.0f);
-				scanline[x] = (cb) << 16 | (cg) << 8 | (cr) << 0;
-			}
-		}
+		std::vector<uint8_t> texels = grid.getTexels(level);
+		uploadPackedTexels(*pOutTexture, texels.data(), grid.getWidth(level), grid.getHeight(level), grid.getDepth(level), pSyncToken,
+			level);
 	}
+	LOGF(LogLevel::eINFO, "ImageLoader: occupancy grid %ux%ux%u, %.1f%% of the cells empty", grid.getWidth(0), grid.getHeight(0),
+		grid.getDepth(0), 100.0f * grid.getEmptyRatio());
+}
 
-	endUpdateResource(&updateDesc, NULL);
+void ImageLoader::genCloudLightTexture(const CloudLightVolume& volume, Texture** pOutTexture, SyncToken* pSyncToken)
+{
+	addNoiseTexture(volume.getWidth(), volume.getHeight(), volume.getDepth(), 1, NoiseChannelLayout::R16F, pOutTexture, pSyncToken);
+	updateCloudLightTexture(volume, pOutTexture, pSyncToken);
 }
 
+void ImageLoader::updateCloudLightTexture(const CloudLightVolume& volume, Texture** pOutTexture, SyncToken* pSyncToken)
+{
+	std::vector<uint16_t> texels = volume.getTexels();
+	uploadPackedTexels(*pOutTexture, (const uint8_t*)texels.data(), size_t(volume.getWidth()) * sizeof(uint16_t), volume.getHeight(),
+		volume.getDepth(), pSyncToken);
+}
@@ -1,29 +1,74 @@
 #pragma once
 
-#include <vector>
-#include <string>
 #include <cstdint>
+#include <functional>
+
+#include "NoiseSinks.h"
+
+#include "../../../../../Common_3/Resources/ResourceLoader/Interfaces/IResourceLoader.h"
 
 struct Texture;
+class NoiseGraph;
+class CloudOccupancyGrid;
+class CloudLightVolume;
 
 class ImageLoader
 {
 public:
-    // -------- files
-    static void saveOneChannel(const std::string& filename, const std::vector<float>& data, int width, int height);
+    // every function can be called from any thread. Given a pSyncToken, the creation and the uploads are tracked
+    // by the token instead of having to wait for all the resource loads (see NoiseBakeQueue)
+
     // -------- 2d
-    static void genTexture(const std::vector<float>& data, int width, int height, Texture** pOutTexture);
-    static void genBlueNoiseTexture(uint32_t width, uint32_t height, Texture** pOutTexture);
-    static void genPerlinFBMTexture(uint32_t width, uint32_t height, Texture** pOutTexture);
-    static void genWorleyFBMTexture(uint32_t width, uint32_t height, Texture** pOutTexture);
-    static void genWeatherTexture(uint32_t width, uint32_t height, Texture** pOutTexture, float scale, int randomSeed);
-    static void updateWeatherTexture(uint32_t width, uint32_t height, Texture** pOutTexture, float scale, int randomSeed);
+    // the texture format follows layout, the update functions must be given the layout the texture was created with
+    // BC4 / BC5 are baked uncompressed then encoded on the CPU (the error is logged), width and height should be multiples of 4
+    /// generate streams the texels to the sink it is given (eg: [&](NoiseSink& sink) { generator.generate(sink); })
+    static void genTexture(int width, int height, Texture** pOutTexture, const std::function<void(NoiseSink&)>& generate,
+        NoiseChannelLayout layout = NoiseChannelLayout::R8, SyncToken* pSyncToken = NULL);
+    static void genBlueNoiseTexture(uint32_t width, uint32_t height, Texture** pOutTexture,
+        NoiseChannelLayout layout = NoiseChannelLayout::R8, SyncToken* pSyncToken = NULL);
+    static void genPerlinFBMTexture(uint32_t width, uint32_t height, Texture** pOutTexture,
+        NoiseChannelLayout layout = NoiseChannelLayout::R8, SyncToken* pSyncToken = NULL);
+    static void genWorleyFBMTexture(uint32_t width, uint32_t height, Texture** pOutTexture,
+        NoiseChannelLayout layout = NoiseChannelLayout::R8, SyncToken* pSyncToken = NULL);
+    /// generateMips creates the full mip chain, box filtered on the CPU. The update functions refresh every level of the texture
+    static void genWeatherTexture(uint32_t width, uint32_t height, Texture** pOutTexture, float scale, int randomSeed,
+        NoiseChannelLayout layout = NoiseChannelLayout::R8, bool generateMips = false, SyncToken* pSyncToken = NULL);
+    static void updateWeatherTexture(uint32_t width, uint32_t height, Texture** pOutTexture, float scale, int randomSeed,
+        NoiseChannelLayout layout = NoiseChannelLayout::R8, SyncToken* pSyncToken = NULL);
 
-    static void genTestTexture(uint32_t width, uint32_t height, std::vector<float>& data);
+    /// r: perlin remapped by worley, g: extrusion factor, b: detail
+    static void genTestTexture(uint32_t width, uint32_t height, NoiseSink& sink);
+
+    // -------- graph
+    /// Texture of the size of the graph, channel c holds output c. Cached under the hash of the graph
+    static void genGraphTexture(const NoiseGraph& graph, Texture** pOutTexture, NoiseChannelLayout layout = NoiseChannelLayout::R8,
+        bool generateMips = false, SyncToken* pSyncToken = NULL);
+    /// Every texel set to value, a depth above 1 makes a volume
+    static void genConstantTexture(uint32_t width, uint32_t height, uint32_t depth, float value, Texture** pOutTexture,
+        NoiseChannelLayout layout = NoiseChannelLayout::R8, SyncToken* pSyncToken = NULL);
 
     // -------- 3d
-    static void genCloudShapeTexture(uint32_t width, uint32_t height, uint32_t depth, Texture** pOutTexture, int randomSeed);
-    static void updateCloudShapeTexture(uint32_t width, uint32_t height, uint32_t depth, Texture** pOutTexture, int randomSeed);
-    static void gen3DNoiseTexture(uint32_t width, uint32_t height, uint32_t depth, Texture** pOutTexture, int randomSeed);
+    // the cloud shape channels differ, rgb are packed in RGBA8 since 3 bytes texels can't be sampled on most targets
+    // BC5 keeps the base and extrusion channels of the cloud shape, the detail channel then reads 0
+    static void genCloudShapeTexture(uint32_t width, uint32_t height, uint32_t depth, Texture** pOutTexture, int randomSeed,
+        NoiseChannelLayout layout = NoiseChannelLayout::RGBA8, bool generateMips = false, SyncToken* pSyncToken = NULL);
+    static void updateCloudShapeTexture(uint32_t width, uint32_t height, uint32_t depth, Texture** pOutTexture, int randomSeed,
+        NoiseChannelLayout layout = NoiseChannelLayout::RGBA8, SyncToken* pSyncToken = NULL);
+    /// Sparse cloud shape (see NoiseBrickVolume), sampled by sampleDensity when SPARSE_CLOUD_SHAPE is set.
+    /// The 8^3 bricks left without density by the coverage of the matching weather texture are dropped, they must be
+    /// rebuilt when the weather changes. index: RGBA8 brick map, pool: RG8 bricks of base and extrusion, detail: dense R8.
+    /// Sizes must be multiples of 8, the bricks only hold level 0 and the shader then reads the weather at level 0 too
+    static void genCloudShapeBricks(uint32_t width, uint32_t height, uint32_t depth, int randomSeed, uint32_t weatherWidth,
+        uint32_t weatherHeight, float weatherScale, int weatherSeed, Texture** pOutIndex, Texture** pOutPool, Texture** pOutDetail,
+        SyncToken* pSyncToken = NULL);
+    /// R8 volume of the occupancy grid, a mip per level of its hierarchy, sampled by PS_MAIN when CLOUD_OCCUPANCY is set.
+    /// The grid must be built from the textures the shader samples, and rebuilt with them
+    static void genCloudOccupancyTexture(const CloudOccupancyGrid& grid, Texture** pOutTexture, SyncToken* pSyncToken = NULL);
+    /// R16F volume of the optical depth toward the sun, read by PS_MAIN when LIGHT_VOLUME is set.
+    /// The update uploads the volume in use into the texture in place, which no frame in flight may sample: CloudLightTexture
+    /// swaps two of them
+    static void genCloudLightTexture(const CloudLightVolume& volume, Texture** pOutTexture, SyncToken* pSyncToken = NULL);
+    static void updateCloudLightTexture(const CloudLightVolume& volume, Texture** pOutTexture, SyncToken* pSyncToken = NULL);
+    static void gen3DNoiseTexture(uint32_t width, uint32_t height, uint32_t depth, Texture** pOutTexture, int randomSeed,
+        NoiseChannelLayout layout = NoiseChannelLayout::R8, SyncToken* pSyncToken = NULL);
 };
-
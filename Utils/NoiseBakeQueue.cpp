@@ -0,0 +1,155 @@
+#include "NoiseBakeQueue.h"
+#include "ImageLoader.h"
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct BakeRequest
+{
+	Texture** ppTexture;
+	Texture* pPlaceholder;
+	Texture* pTexture;
+	NoiseBakeQueue::BakeFunction bake;
+	SyncToken syncToken;
+};
+
+struct NoiseBakeQueue::State
+{
+	std::thread thread;
+	std::mutex mutex;
+	std::condition_variable wakeUp;
+	bool quit = false;
+	// a request is out of both lists while the queue thread bakes it
+	bool baking = false;
+	// waiting for the queue thread, in request order
+	std::deque<std::unique_ptr<BakeRequest>> pending;
+	// baked, waiting for their uploads
+	std::vector<std::unique_ptr<BakeRequest>> baked;
+	// switched placeholders, released once the caller's frames are done with them
+	std::vector<Texture*> replaced;
+};
+
+NoiseBakeQueue::State* NoiseBakeQueue::s_pState = nullptr;
+
+/* --------------------------------- Public methods --------------------------------- */
+
+void NoiseBakeQueue::init()
+{
+	exit();
+
+	s_pState = new State();
+	s_pState->thread = std::thread(bakeLoop, s_pState);
+}
+
+void NoiseBakeQueue::exit()
+{
+	if (!s_pState)
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(s_pState->mutex);
+		s_pState->quit = true;
+	}
+	s_pState->wakeUp.notify_all();
+	// the bake in progress isn't interrupted
+	s_pState->thread.join();
+
+	for (std::unique_ptr<BakeRequest>& pRequest : s_pState->pending)
+	{
+		*pRequest->ppTexture = NULL;
+		removeResource(pRequest->pPlaceholder);
+	}
+	for (std::unique_ptr<BakeRequest>& pRequest : s_pState->baked)
+	{
+		waitForToken(&pRequest->syncToken);
+		*pRequest->ppTexture = pRequest->pTexture;
+		removeResource(pRequest->pPlaceholder);
+	}
+	releasePlaceholders();
+
+	delete s_pState;
+	s_pState = nullptr;
+}
+
+void NoiseBakeQueue::request(Texture** ppTexture, bool volume, NoiseChannelLayout layout, float value, const BakeFunction& bake)
+{
+	std::unique_ptr<BakeRequest> pRequest(new BakeRequest());
+	pRequest->ppTexture = ppTexture;
+	pRequest->pTexture = NULL;
+	pRequest->bake = bake;
+	pRequest->syncToken = {};
+
+	// a single block keeps the block compressed layouts valid
+	ImageLoader::genConstantTexture(4, 4, volume ? 4 : 1, value, &pRequest->pPlaceholder, layout);
+	*ppTexture = pRequest->pPlaceholder;
+
+	{
+		std::lock_guard<std::mutex> lock(s_pState->mutex);
+		s_pState->pending.push_back(std::move(pRequest));
+	}
+	s_pState->wakeUp.notify_one();
+}
+
+bool NoiseBakeQueue::update()
+{
+	bool switched = false;
+	std::lock_guard<std::mutex> lock(s_pState->mutex);
+	for (size_t i = 0; i < s_pState->baked.size();)
+	{
+		BakeRequest& request = *s_pState->baked[i];
+		if (!isTokenCompleted(&request.syncToken))
+		{
+			++i;
+			continue;
+		}
+
+		*request.ppTexture = request.pTexture;
+		s_pState->replaced.push_back(request.pPlaceholder);
+		s_pState->baked.erase(s_pState->baked.begin() + i);
+		switched = true;
+	}
+	return switched;
+}
+
+void NoiseBakeQueue::releasePlaceholders()
+{
+	std::lock_guard<std::mutex> lock(s_pState->mutex);
+	for (Texture* pPlaceholder : s_pState->replaced)
+		removeResource(pPlaceholder);
+	s_pState->replaced.clear();
+}
+
+bool NoiseBakeQueue::isIdle()
+{
+	std::lock_guard<std::mutex> lock(s_pState->mutex);
+	return !s_pState->baking && s_pState->pending.empty() && s_pState->baked.empty();
+}
+
+/* --------------------------------- Private methods --------------------------------- */
+
+void NoiseBakeQueue::bakeLoop(State* pState)
+{
+	for (;;)
+	{
+		std::unique_ptr<BakeRequest> pRequest;
+		{
+			std::unique_lock<std::mutex> lock(pState->mutex);
+			pState->wakeUp.wait(lock, [&]() { return pState->quit || !pState->pending.empty(); });
+			if (pState->quit)
+				return;
+			pRequest = std::move(pState->pending.front());
+			pState->pending.pop_front();
+			pState->baking = true;
+		}
+
+		pRequest->bake(&pRequest->pTexture, &pRequest->syncToken);
+
+		std::lock_guard<std::mutex> lock(pState->mutex);
+		pState->baked.push_back(std::move(pRequest));
+		pState->baking = false;
+	}
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "NoiseSinks.h"
+
+#include "../../../../../Common_3/Resources/ResourceLoader/Interfaces/IResourceLoader.h"
+
+#include <cstdint>
+#include <functional>
+
+struct Texture;
+
+/// Bakes noise textures in the background so the first frames don't wait for them.
+/// A request immediately points its texture at a tiny constant placeholder, the real texture is then baked on the queue
+/// thread (the bake itself still spreads over the TaskScheduler workers) and its uploads are tracked by a SyncToken.
+/// Once the token completes, update() switches the texture pointer over, the placeholders are only released afterwards
+/// so frames still in flight can keep sampling them.
+class NoiseBakeQueue
+{
+public:
+    /// Creates the texture in *ppTexture, uploads tracked by pSyncToken (eg: ImageLoader::genWeatherTexture(..., ppTexture, ..., pSyncToken))
+    typedef std::function<void(Texture** ppTexture, SyncToken* pSyncToken)> BakeFunction;
+
+    // -------- setup
+    static void init();
+    /// Finish the bake in progress and cancel the others: their texture is set to NULL.
+    /// Every published texture belongs to the caller, the placeholders are removed
+    static void exit();
+
+    // -------- requests
+    /// *ppTexture gets a placeholder of layout filled with value (a 4x4x4 volume when volume is set) until the bake is done.
+    /// Requests are baked one after the other, in order
+    static void request(Texture** ppTexture, bool volume, NoiseChannelLayout layout, float value, const BakeFunction& bake);
+    /// Main thread, once per frame. Publishes the bakes whose uploads are complete, true when at least one texture changed:
+    /// the descriptors referencing them must be updated, then releasePlaceholders() called once the GPU is done with the old ones
+    static bool update();
+    static void releasePlaceholders();
+    /// No request left to bake or to publish
+    static bool isIdle();
+
+private:
+    struct State;
+    /// Queue thread, bakes the pending requests in order until exit()
+    static void bakeLoop(State* pState);
+
+    static State* s_pState;
+};
@@ -0,0 +1,91 @@
+#include "NoiseBaker.h"
+#include "NoiseGraph.h"
+#include "../Noise/2d/BlueNoise2D.h"
+
+float remap(float val, float l0, float h0, float l1, float h1)
+{
+	return l1 + (val - l0) * (h1 - l1) / (h0 - l0);
+}
+
+/* --------------------------------- 2D Noise Texture --------------------------------- */
+
+void NoiseBaker::bakeBlueNoise(uint32_t width, uint32_t height, NoiseSink& sink)
+{
+	BlueNoise2D blueNoiseGenerator(IVector2(width, height));
+	blueNoiseGenerator.generate(sink);
+}
+
+void NoiseBaker::bakePerlinFBM(uint32_t width, uint32_t height, NoiseSink& sink)
+{
+	NoiseGraph graph(width, height);
+	graph.addOutput(graph.perlin2D(IVector2(64, 64), 3, 1.0f, 42));
+	graph.evaluate(sink);
+}
+
+void NoiseBaker::bakeWorleyFBM(uint32_t width, uint32_t height, NoiseSink& sink)
+{
+	NoiseGraph graph(width, height);
+	NoiseGraph::Node worley = graph.weightedSum({
+		{ graph.worley2D(3), 0.625f },
+		{ graph.worley2D(6), 0.25f },
+		{ graph.worley2D(12), 0.125f } });
+	// invert worley noise
+	graph.addOutput(graph.invert(worley));
+	graph.evaluate(sink);
+}
+
+void NoiseBaker::bakeWeather(uint32_t width, uint32_t height, float scale, int randomSeed, NoiseSink& sink)
+{
+	NoiseGraph graph(width, height);
+	graph.addOutput(graph.threshold(graph.perlin2D(IVector2(64, 64), 5, scale, randomSeed), 0.2f));
+	graph.evaluate(sink);
+}
+
+/* --------------------------------- 3D Noise Texture --------------------------------- */
+
+void NoiseBaker::bakeCloudShape(uint32_t width, uint32_t height, uint32_t depth, int randomSeed, NoiseSink& sink)
+{
+	NoiseGraph graph(width, height, depth);
+	buildCloudShape(graph, randomSeed);
+	graph.evaluate(sink);
+}
+
+void NoiseBaker::bake3DNoise(uint32_t width, uint32_t height, uint32_t depth, int randomSeed, NoiseSink& sink)
+{
+	NoiseGraph graph(width, height, depth);
+	build3DNoise(graph, randomSeed);
+	graph.evaluate(sink);
+}
+
+void NoiseBaker::buildCloudShape(NoiseGraph& graph, int randomSeed)
+{
+	// octaves 24 and 32 feed both the extrusion and the detail, the graph only evaluates them once
+	NoiseGraph::Node extrusion = graph.weightedSum({
+		{ graph.worley3D(6, randomSeed), 0.5f },
+		{ graph.worley3D(12, randomSeed), 0.25f },
+		{ graph.worley3D(24, randomSeed), 0.175f },
+		{ graph.worley3D(32, randomSeed), 0.075f } });
+	NoiseGraph::Node detail = graph.weightedSum({
+		{ graph.worley3D(24, randomSeed), 0.625f },
+		{ graph.worley3D(32, randomSeed), 0.25f },
+		{ graph.worley3D(64, randomSeed), 0.125f } });
+
+	// remap perlin with worley (ie: keep worley values when high)
+	NoiseGraph::Node worley = graph.invert(graph.worley3D(3, randomSeed));
+	NoiseGraph::Node perlin = graph.perlin3D(64, 3, 1.0f, randomSeed);
+	NoiseGraph::Node shape = graph.remap(perlin, graph.constant(0.0f), graph.constant(1.0f), worley, graph.constant(1.0f));
+
+	graph.addOutput(shape);
+	graph.addOutput(extrusion);
+	graph.addOutput(detail);
+}
+
+void NoiseBaker::build3DNoise(NoiseGraph& graph, int randomSeed)
+{
+	NoiseGraph::Node worley = graph.weightedSum({
+		{ graph.worley3D(3, randomSeed), 0.625f },
+		{ graph.worley3D(6, randomSeed), 0.25f },
+		{ graph.worley3D(12, randomSeed), 0.125f } });
+	// invert worley noise
+	graph.addOutput(graph.invert(worley));
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include "../Noise/NoiseSink.h"
+
+#include <cstdint>
+
+class NoiseGraph;
+
+/// Map a value from from the [l0-h0] to [l1-h1] range
+float remap(float val, float l0, float h0, float l1, float h1);
+
+/// CPU side of the noise textures, usable without a renderer.
+/// Every bake streams its rows to a sink, the grey bakes write one channel and the cloud shape three.
+/// The bakes are NoiseGraph compositions (blue noise aside), evaluated in parallel tiles on the TaskScheduler.
+/// The output doesn't depend on the worker count.
+class NoiseBaker
+{
+public:
+    // -------- 2d
+    static void bakeBlueNoise(uint32_t width, uint32_t height, NoiseSink& sink);
+    static void bakePerlinFBM(uint32_t width, uint32_t height, NoiseSink& sink);
+    static void bakeWorleyFBM(uint32_t width, uint32_t height, NoiseSink& sink);
+    static void bakeWeather(uint32_t width, uint32_t height, float scale, int randomSeed, NoiseSink& sink);
+
+    // -------- 3d
+    /// r: perlin remapped by the base worley, g: extrusion factor, b: detail
+    static void bakeCloudShape(uint32_t width, uint32_t height, uint32_t depth, int randomSeed, NoiseSink& sink);
+    static void bake3DNoise(uint32_t width, uint32_t height, uint32_t depth, int randomSeed, NoiseSink& sink);
+    /// Outputs of the bakes above added to a graph of the size of the volume, to evaluate it slab by slab (see NoiseSlabWriter)
+    static void buildCloudShape(NoiseGraph& graph, int randomSeed);
+    static void build3DNoise(NoiseGraph& graph, int randomSeed);
+};
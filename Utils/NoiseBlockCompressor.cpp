@@ -0,0 +1,267 @@
+#include "NoiseBlockCompressor.h"
+#include "TaskScheduler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define NOISE_BC_SSE2 1
+#endif
+
+// how far the endpoints are moved inside the block range when looking for a better palette
+static const int kEndpointSearchRadius = 3;
+
+/// The 8 palette entries of a BC4 block, e0 > e1 interpolates 6 values, otherwise 4 values plus 0 and 255
+static void buildPalette(uint8_t e0, uint8_t e1, uint8_t palette[8])
+{
+	palette[0] = e0;
+	palette[1] = e1;
+	if (e0 > e1)
+	{
+		for (int i = 1; i < 7; ++i)
+			palette[i + 1] = uint8_t(((7 - i) * e0 + i * e1 + 3) / 7);
+	}
+	else
+	{
+		for (int i = 1; i < 5; ++i)
+			palette[i + 1] = uint8_t(((5 - i) * e0 + i * e1 + 2) / 5);
+		palette[6] = 0;
+		palette[7] = 255;
+	}
+}
+
+/// Sum of the squared distances of the texels to their closest palette entry
+static uint32_t evaluatePalette(const uint8_t texels[16], const uint8_t palette[8])
+{
+#if defined(NOISE_BC_SSE2)
+	// a block is exactly one register of 16 texels
+	__m128i values = _mm_loadu_si128((const __m128i*)texels);
+	__m128i closest = _mm_set1_epi8((char)0xff);
+	for (int i = 0; i < 8; ++i)
+	{
+		__m128i entry = _mm_set1_epi8((char)palette[i]);
+		__m128i distance = _mm_or_si128(_mm_subs_epu8(values, entry), _mm_subs_epu8(entry, values));
+		closest = _mm_min_epu8(closest, distance);
+	}
+	__m128i zero = _mm_setzero_si128();
+	__m128i lo = _mm_unpacklo_epi8(closest, zero);
+	__m128i hi = _mm_unpackhi_epi8(closest, zero);
+	__m128i sum = _mm_add_epi32(_mm_madd_epi16(lo, lo), _mm_madd_epi16(hi, hi));
+	sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+	sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+	return uint32_t(_mm_cvtsi128_si32(sum));
+#else
+	uint32_t error = 0;
+	for (int t = 0; t < 16; ++t)
+	{
+		int closest = 255;
+		for (int i = 0; i < 8; ++i)
+			closest = std::min(closest, std::abs(int(texels[t]) - int(palette[i])));
+		error += uint32_t(closest * closest);
+	}
+	return error;
+#endif
+}
+
+/// Try the endpoint pairs (lo + i, hi - j) and keep the best one of the requested mode
+static void searchEndpoints(const uint8_t texels[16], int lo, int hi, bool interpolateSix, uint32_t& bestError, uint8_t& bestE0, uint8_t& bestE1)
+{
+	int radius = std::min(kEndpointSearchRadius, (hi - lo) / 2);
+	uint8_t palette[8];
+	for (int i = 0; i <= radius; ++i)
+	{
+		for (int j = 0; j <= radius; ++j)
+		{
+			int a = lo + i;
+			int b = hi - j;
+			if (a >= b)
+				continue;
+			// the mode is selected by the endpoint order
+			uint8_t e0 = uint8_t(interpolateSix ? b : a);
+			uint8_t e1 = uint8_t(interpolateSix ? a : b);
+			buildPalette(e0, e1, palette);
+			uint32_t error = evaluatePalette(texels, palette);
+			if (error < bestError)
+			{
+				bestError = error;
+				bestE0 = e0;
+				bestE1 = e1;
+			}
+		}
+	}
+}
+
+/// Encode the 16 texels of a block into 8 bytes
+static void encodeBC4Block(const uint8_t texels[16], uint8_t* pBlock, NoiseCompressionStats& stats)
+{
+	int lo = 255, hi = 0;
+	// range of the texels that aren't exactly 0 or 255, those are free in the 4 values mode
+	int innerLo = 255, innerHi = 0;
+	for (int t = 0; t < 16; ++t)
+	{
+		lo = std::min(lo, int(texels[t]));
+		hi = std::max(hi, int(texels[t]));
+		if (texels[t] != 0 && texels[t] != 255)
+		{
+			innerLo = std::min(innerLo, int(texels[t]));
+			innerHi = std::max(innerHi, int(texels[t]));
+		}
+	}
+
+	uint8_t e0 = uint8_t(lo);
+	uint8_t e1 = uint8_t(lo);
+	uint32_t bestError = lo == hi ? 0 : UINT32_MAX;
+	if (bestError != 0)
+	{
+		searchEndpoints(texels, lo, hi, true, bestError, e0, e1);
+		if (lo == 0 || hi == 255)
+		{
+			if (innerLo > innerHi)
+			{
+				// only 0 and 255, both are in the palette of the 4 values mode
+				bestError = 0;
+				e0 = 0;
+				e1 = 255;
+			}
+			else if (innerLo == innerHi)
+			{
+				uint8_t palette[8];
+				buildPalette(uint8_t(innerLo), uint8_t(innerLo), palette);
+				uint32_t error = evaluatePalette(texels, palette);
+				if (error < bestError)
+				{
+					bestError = error;
+					e0 = e1 = uint8_t(innerLo);
+				}
+			}
+			else
+			{
+				searchEndpoints(texels, innerLo, innerHi, false, bestError, e0, e1);
+			}
+		}
+	}
+
+	uint8_t palette[8];
+	buildPalette(e0, e1, palette);
+	uint64_t indices = 0;
+	for (int t = 0; t < 16; ++t)
+	{
+		uint32_t closest = 0;
+		int closestDistance = 256;
+		for (uint32_t i = 0; i < 8; ++i)
+		{
+			int distance = std::abs(int(texels[t]) - int(palette[i]));
+			if (distance < closestDistance)
+			{
+				closestDistance = distance;
+				closest = i;
+			}
+		}
+		indices |= uint64_t(closest) << (3 * t);
+		stats.squaredError += double(closestDistance * closestDistance);
+		stats.maxError = std::max(stats.maxError, uint32_t(closestDistance));
+	}
+	stats.sampleCount += 16;
+
+	pBlock[0] = e0;
+	pBlock[1] = e1;
+	for (int i = 0; i < 6; ++i)
+		pBlock[2 + i] = uint8_t(indices >> (8 * i));
+}
+
+/* --------------------------------- Stats --------------------------------- */
+
+void NoiseCompressionStats::merge(const NoiseCompressionStats& other)
+{
+	squaredError += other.squaredError;
+	sampleCount += other.sampleCount;
+	maxError = std::max(maxError, other.maxError);
+}
+
+double NoiseCompressionStats::getRmse() const
+{
+	return sampleCount ? std::sqrt(squaredError / double(sampleCount)) : 0.0;
+}
+
+double NoiseCompressionStats::getPsnr() const
+{
+	double rmse = getRmse();
+	return rmse > 0.0 ? 20.0 * std::log10(255.0 / rmse) : INFINITY;
+}
+
+/* --------------------------------- Public methods --------------------------------- */
+
+bool NoiseBlockCompressor::isBlockCompressed(NoiseChannelLayout layout)
+{
+	return layout == NoiseChannelLayout::BC4 || layout == NoiseChannelLayout::BC5;
+}
+
+NoiseChannelLayout NoiseBlockCompressor::getSourceLayout(NoiseChannelLayout layout)
+{
+	switch (layout)
+	{
+	case NoiseChannelLayout::BC4:
+		return NoiseChannelLayout::R8;
+	case NoiseChannelLayout::BC5:
+		return NoiseChannelLayout::RG8;
+	default:
+		return layout;
+	}
+}
+
+uint32_t NoiseBlockCompressor::getBlockBytes(NoiseChannelLayout layout)
+{
+	return layout == NoiseChannelLayout::BC5 ? 16 : 8;
+}
+
+NoiseCompressionStats NoiseBlockCompressor::encode(NoiseChannelLayout layout, const uint8_t* pSrc, size_t srcRowStride, size_t srcSliceStride,
+	uint32_t width, uint32_t height, uint32_t depth, uint8_t* pDst, size_t dstRowStride, size_t dstSliceStride)
+{
+	uint32_t channelCount = layout == NoiseChannelLayout::BC5 ? 2 : 1;
+	uint32_t blocksX = getBlockCount(width);
+	uint32_t blocksY = getBlockCount(height);
+
+	// one entry per block row, merged in order so the totals don't depend on the scheduling
+	std::vector<NoiseCompressionStats> rowStats(size_t(blocksY) * depth);
+	TaskScheduler::parallelFor(blocksY * depth, [&](uint32_t row)
+	{
+		uint32_t z = row / blocksY;
+		uint32_t by = row % blocksY;
+		const uint8_t* pSrcSlice = pSrc + z * srcSliceStride;
+		uint8_t* pDstRow = pDst + z * dstSliceStride + by * dstRowStride;
+
+		uint8_t texels[16];
+		for (uint32_t bx = 0; bx < blocksX; ++bx)
+		{
+			for (uint32_t c = 0; c < channelCount; ++c)
+			{
+				for (uint32_t t = 0; t < 16; ++t)
+				{
+					uint32_t x = std::min(bx * 4 + (t & 3), width - 1);
+					uint32_t y = std::min(by * 4 + (t >> 2), height - 1);
+					texels[t] = pSrcSlice[y * srcRowStride + x * channelCount + c];
+				}
+				encodeBC4Block(texels, pDstRow + (bx * channelCount + c) * 8, rowStats[row]);
+			}
+		}
+	});
+
+	NoiseCompressionStats stats;
+	for (const NoiseCompressionStats& s : rowStats)
+		stats.merge(s);
+	return stats;
+}
+
+void NoiseBlockCompressor::decodeBC4Block(const uint8_t* pBlock, uint8_t texels[16])
+{
+	uint8_t palette[8];
+	buildPalette(pBlock[0], pBlock[1], palette);
+	uint64_t indices = 0;
+	for (int i = 0; i < 6; ++i)
+		indices |= uint64_t(pBlock[2 + i]) << (8 * i);
+	for (int t = 0; t < 16; ++t)
+		texels[t] = palette[(indices >> (3 * t)) & 7];
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "NoiseSinks.h"
+
+#include <cstdint>
+#include <cstddef>
+
+/// Error of an encode against its uncompressed source, in 8 bit steps
+struct NoiseCompressionStats
+{
+    double squaredError = 0.0;
+    uint64_t sampleCount = 0;
+    uint32_t maxError = 0;
+
+    void merge(const NoiseCompressionStats& other);
+    double getRmse() const;
+    /// Peak signal to noise ratio in dB, infinite for a lossless encode
+    double getPsnr() const;
+};
+
+/// CPU encoder of the BC4 (one channel) and BC5 (two channels) block compressed layouts.
+/// Each 4x4 block stores two 8 bit endpoints and a 3 bit palette index per texel and channel, the endpoints
+/// are refined around the block range and the candidates are scored with SSE2 when available.
+/// Volumes are encoded slice by slice, blocks never span slices.
+class NoiseBlockCompressor
+{
+public:
+    static bool isBlockCompressed(NoiseChannelLayout layout);
+    /// Layout the texels are baked in before being encoded: R8 for BC4, RG8 for BC5, layout itself otherwise
+    static NoiseChannelLayout getSourceLayout(NoiseChannelLayout layout);
+    static uint32_t getBlockBytes(NoiseChannelLayout layout);
+    static uint32_t getBlockCount(uint32_t size) { return (size + 3) / 4; }
+
+    /// Encode depth slices of width x height source texels into rows of blocks, block rows are encoded in parallel.
+    /// Partial blocks on the right and bottom edges repeat the last texel of the row / column
+    static NoiseCompressionStats encode(NoiseChannelLayout layout, const uint8_t* pSrc, size_t srcRowStride, size_t srcSliceStride,
+        uint32_t width, uint32_t height, uint32_t depth, uint8_t* pDst, size_t dstRowStride, size_t dstSliceStride);
+
+    /// Reference decode of a BC4 block, or of one channel of a BC5 block
+    static void decodeBC4Block(const uint8_t* pBlock, uint8_t texels[16]);
+};
@@ -0,0 +1,208 @@
+#include "NoiseBrickVolume.h"
+#include "TaskScheduler.h"
+
+#include <cmath>
+#include <cstring>
+
+const uint32_t NoiseBrickVolume::kEmptyBrick;
+
+NoiseBrickVolume::NoiseBrickVolume(NoiseChannelLayout layout, uint32_t width, uint32_t height, uint32_t depth, uint32_t brickSize) :
+	m_layout(layout),
+	m_bytesPerTexel(PackedRowSink::getBytesPerTexel(layout)),
+	m_width(width),
+	m_height(height),
+	m_depth(depth),
+	m_brickSize(brickSize),
+	m_gridWidth(width / brickSize),
+	m_gridHeight(height / brickSize),
+	m_gridDepth(depth / brickSize),
+	m_brickCount(0),
+	m_poolSlots{ 1, 1, 1 },
+	m_index(size_t(m_gridWidth) * m_gridHeight * m_gridDepth, kEmptyBrick)
+{
+}
+
+/* --------------------------------- Public methods --------------------------------- */
+
+void NoiseBrickVolume::build(const uint8_t* pTexels, size_t rowStride, size_t sliceStride,
+	const std::function<bool(uint32_t x0, uint32_t y0, uint32_t z0)>& isEmpty)
+{
+	uint32_t brickTotal = uint32_t(m_index.size());
+	uint32_t footprint = m_brickSize + 1;
+
+	std::vector<uint8_t> occupied(brickTotal, 0);
+	TaskScheduler::parallelFor(brickTotal, [&](uint32_t brick)
+	{
+		uint32_t x0 = (brick % m_gridWidth) * m_brickSize;
+		uint32_t y0 = ((brick / m_gridWidth) % m_gridHeight) * m_brickSize;
+		uint32_t z0 = (brick / (m_gridWidth * m_gridHeight)) * m_brickSize;
+		occupied[brick] = isEmpty(x0, y0, z0) ? 0 : 1;
+	});
+
+	// slots follow the brick order
+	m_brickCount = 0;
+	for (uint32_t brick = 0; brick < brickTotal; ++brick)
+		m_index[brick] = occupied[brick] ? m_brickCount++ : kEmptyBrick;
+
+	// roughly cubic pool, an empty volume still gets one (zero) slot so it can be uploaded
+	uint32_t side = 1;
+	while (side * side * side < m_brickCount)
+		side++;
+	m_poolSlots[0] = side;
+	m_poolSlots[1] = side;
+	m_poolSlots[2] = m_brickCount == 0 ? 1 : (m_brickCount + side * side - 1) / (side * side);
+	m_pool.assign(getPoolSliceStride() * getPoolDepth(), 0);
+
+	size_t brickRowSize = size_t(m_brickSize) * m_bytesPerTexel;
+	TaskScheduler::parallelFor(brickTotal, [&](uint32_t brick)
+	{
+		uint32_t slot = m_index[brick];
+		if (slot == kEmptyBrick)
+			return;
+
+		uint32_t x0 = (brick % m_gridWidth) * m_brickSize;
+		uint32_t y0 = ((brick / m_gridWidth) % m_gridHeight) * m_brickSize;
+		uint32_t z0 = (brick / (m_gridWidth * m_gridHeight)) * m_brickSize;
+		// the apron texel past the last column wraps around the volume
+		size_t apronOffset = size_t((x0 + m_brickSize) % m_width) * m_bytesPerTexel;
+		for (uint32_t z = 0; z < footprint; ++z)
+		{
+			const uint8_t* pSlice = pTexels + sliceStride * ((z0 + z) % m_depth);
+			for (uint32_t y = 0; y < footprint; ++y)
+			{
+				const uint8_t* pRow = pSlice + rowStride * ((y0 + y) % m_height);
+				uint8_t* pDst = m_pool.data() + getPoolOffset(slot, 0, y, z);
+				memcpy(pDst, pRow + size_t(x0) * m_bytesPerTexel, brickRowSize);
+				memcpy(pDst + brickRowSize, pRow + apronOffset, m_bytesPerTexel);
+			}
+		}
+	});
+}
+
+void NoiseBrickVolume::buildCloudShape(const uint8_t* pTexels, size_t rowStride, size_t sliceStride, const uint8_t* pWeather,
+	uint32_t weatherWidth, uint32_t weatherHeight)
+{
+	// sampleDensity extrudes the base with remap(r, 1 - g, 1, 0, 1) then removes the coverage with remap(density, coverage, 1, 0, 1):
+	// nothing is left where density <= coverage, and the detail only erodes further. Both textures scroll together, the
+	// weather being sampled at the xz of the shape uv. An interpolated density never exceeds the densest texel of the
+	// footprint and an interpolated coverage is never below the lowest weather texel the brick reaches. That only holds for
+	// level 0 of the weather, the SPARSE_CLOUD_SHAPE path reads it at level 0 like the bricks
+	auto isEmpty = [&](uint32_t x0, uint32_t y0, uint32_t z0)
+	{
+		float maxDensity = 0.0f;
+		for (uint32_t z = 0; z <= m_brickSize; ++z)
+		{
+			for (uint32_t y = 0; y <= m_brickSize; ++y)
+			{
+				const uint8_t* pRow = pTexels + sliceStride * ((z0 + z) % m_depth) + rowStride * ((y0 + y) % m_height);
+				for (uint32_t x = 0; x <= m_brickSize; ++x)
+				{
+					const uint8_t* pTexel = pRow + ((x0 + x) % m_width) * 2;
+					float r = pTexel[0] / 255.0f;
+					float g = pTexel[1] / 255.0f;
+					float density = g > 0.0f ? (r - (1.0f - g)) / g : (pTexel[0] == 255 ? 1.0f : 0.0f);
+					maxDensity = density > maxDensity ? density : maxDensity;
+				}
+			}
+		}
+
+		// weather texels of the bilinear fetches at u in [(x0 + 0.5) / width, (x0 + brickSize + 0.5) / width), same along z
+		int32_t u0 = int32_t(floorf((x0 + 0.5f) / m_width * weatherWidth - 0.5f));
+		int32_t u1 = int32_t(floorf((x0 + m_brickSize + 0.5f) / m_width * weatherWidth - 0.5f)) + 1;
+		int32_t v0 = int32_t(floorf((z0 + 0.5f) / m_depth * weatherHeight - 0.5f));
+		int32_t v1 = int32_t(floorf((z0 + m_brickSize + 0.5f) / m_depth * weatherHeight - 0.5f)) + 1;
+		int32_t wrapWidth = int32_t(weatherWidth);
+		int32_t wrapHeight = int32_t(weatherHeight);
+		float minCoverage = 1.0f;
+		for (int32_t v = v0; v <= v1; ++v)
+		{
+			const uint8_t* pRow = pWeather + size_t((v % wrapHeight + wrapHeight) % wrapHeight) * weatherWidth;
+			for (int32_t u = u0; u <= u1; ++u)
+			{
+				float coverage = pRow[(u % wrapWidth + wrapWidth) % wrapWidth] / 255.0f;
+				minCoverage = coverage < minCoverage ? coverage : minCoverage;
+			}
+		}
+		return maxDensity <= minCoverage;
+	};
+	build(pTexels, rowStride, sliceStride, isEmpty);
+}
+
+bool NoiseBrickVolume::sample(float u, float v, float w, float* pOut) const
+{
+	// same steps as sampleShapeBricks: first texel of the trilinear footprint, wrapped, then its brick
+	const float uvw[3] = { u, v, w };
+	const uint32_t sizes[3] = { m_width, m_height, m_depth };
+	uint32_t texel[3];
+	float weight[3];
+	for (uint32_t axis = 0; axis < 3; ++axis)
+	{
+		float size = float(sizes[axis]);
+		float start = (uvw[axis] - floorf(uvw[axis])) * size - 0.5f;
+		if (start < 0.0f)
+			start += size;
+		texel[axis] = uint32_t(start);
+		if (texel[axis] >= sizes[axis])
+			texel[axis] = sizes[axis] - 1;
+		weight[axis] = start - float(texel[axis]);
+	}
+
+	uint32_t channelCount = m_bytesPerTexel;
+	uint32_t slot = getSlot(texel[0] / m_brickSize, texel[1] / m_brickSize, texel[2] / m_brickSize);
+	if (slot == kEmptyBrick)
+	{
+		for (uint32_t c = 0; c < channelCount; ++c)
+			pOut[c] = 0.0f;
+		return false;
+	}
+
+	uint32_t x = texel[0] % m_brickSize;
+	uint32_t y = texel[1] % m_brickSize;
+	uint32_t z = texel[2] % m_brickSize;
+	for (uint32_t c = 0; c < channelCount; ++c)
+	{
+		float value = 0.0f;
+		for (uint32_t corner = 0; corner < 8; ++corner)
+		{
+			uint32_t dx = corner & 1, dy = (corner >> 1) & 1, dz = corner >> 2;
+			float cornerWeight = (dx ? weight[0] : 1.0f - weight[0]) * (dy ? weight[1] : 1.0f - weight[1]) *
+				(dz ? weight[2] : 1.0f - weight[2]);
+			value += cornerWeight * float(m_pool[getPoolOffset(slot, x + dx, y + dy, z + dz) + c]);
+		}
+		pOut[c] = value / 255.0f;
+	}
+	return true;
+}
+
+std::vector<uint8_t> NoiseBrickVolume::getIndexTexels() const
+{
+	std::vector<uint8_t> texels(m_index.size() * 4, 0);
+	for (size_t brick = 0; brick < m_index.size(); ++brick)
+	{
+		uint32_t slot = m_index[brick];
+		if (slot == kEmptyBrick)
+			continue;
+		texels[brick * 4 + 0] = uint8_t(slot % m_poolSlots[0]);
+		texels[brick * 4 + 1] = uint8_t((slot / m_poolSlots[0]) % m_poolSlots[1]);
+		texels[brick * 4 + 2] = uint8_t(slot / (m_poolSlots[0] * m_poolSlots[1]));
+		texels[brick * 4 + 3] = 255;
+	}
+	return texels;
+}
+
+size_t NoiseBrickVolume::getSparseSize() const
+{
+	return m_index.size() * 4 + m_pool.size();
+}
+
+/* --------------------------------- Private methods --------------------------------- */
+
+size_t NoiseBrickVolume::getPoolOffset(uint32_t slot, uint32_t x, uint32_t y, uint32_t z) const
+{
+	uint32_t footprint = m_brickSize + 1;
+	uint32_t slotX = slot % m_poolSlots[0];
+	uint32_t slotY = (slot / m_poolSlots[0]) % m_poolSlots[1];
+	uint32_t slotZ = slot / (m_poolSlots[0] * m_poolSlots[1]);
+	return getPoolSliceStride() * (slotZ * footprint + z) + getPoolRowStride() * (slotY * footprint + y) +
+		size_t(slotX * footprint + x) * m_bytesPerTexel;
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include "NoiseSinks.h"
+
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+/// Sparse copy of a baked volume in 8 bit channels (R8, RG8 or RGBA8): the volume is cut in bricks of brickSize^3 texels,
+/// only the bricks the caller doesn't find empty are kept in a compact pool and an index map gives the pool slot of each brick.
+/// A pool slot also holds the next texel on each axis (wrapped around the volume), so a trilinear fetch stays inside one
+/// slot when the brick is picked from the first texel of its 2x2x2 footprint. Empty bricks read 0.
+/// sample() is the CPU reference of the lookup done by sampleDensity when SPARSE_CLOUD_SHAPE is set, level 0 only
+/// (CloudMarchTextures::pShapeBricks).
+class NoiseBrickVolume
+{
+public:
+    static const uint32_t kEmptyBrick = 0xffffffffu;
+
+    /// width, height and depth must be multiples of brickSize
+    NoiseBrickVolume(NoiseChannelLayout layout, uint32_t width, uint32_t height, uint32_t depth, uint32_t brickSize = 8);
+
+public:
+    /// Split the dense texels in bricks. isEmpty gets the first texel of each brick, a brick is dropped when no fetch
+    /// reaching its footprint (brickSize + 1 texels on each axis, wrapped) can return a value that matters.
+    /// Bricks are tested and copied in parallel, the pool order doesn't depend on the worker count
+    void build(const uint8_t* pTexels, size_t rowStride, size_t sliceStride,
+        const std::function<bool(uint32_t x0, uint32_t y0, uint32_t z0)>& isEmpty);
+
+    /// build() for the base and extrusion of the cloud shape (RG8, r and g of NoiseBaker::bakeCloudShape): a brick is
+    /// dropped when the coverage of the R8 weather, read at level 0 over the xz of the brick, leaves none of its density
+    void buildCloudShape(const uint8_t* pTexels, size_t rowStride, size_t sliceStride, const uint8_t* pWeather,
+        uint32_t weatherWidth, uint32_t weatherHeight);
+
+    /// Trilinear fetch at uv with a repeat addressing, channels the layout doesn't hold are left untouched.
+    /// False when the fetch falls in an empty brick, the channels are then 0
+    bool sample(float u, float v, float w, float* pOut) const;
+
+    // -------- brick grid
+    uint32_t getBrickSize() const { return m_brickSize; }
+    uint32_t getGridWidth() const { return m_gridWidth; }
+    uint32_t getGridHeight() const { return m_gridHeight; }
+    uint32_t getGridDepth() const { return m_gridDepth; }
+    /// Pool slot of the brick, kEmptyBrick when empty
+    uint32_t getSlot(uint32_t x, uint32_t y, uint32_t z) const { return m_index[(size_t(z) * m_gridHeight + y) * m_gridWidth + x]; }
+    /// Index map as RGBA8 texels of the brick grid: xyz slot coordinates in the pool, a 0 alpha for empty bricks
+    std::vector<uint8_t> getIndexTexels() const;
+
+    // -------- pool, slots of (brickSize + 1)^3 texels
+    uint32_t getBrickCount() const { return m_brickCount; }
+    uint32_t getPoolWidth() const { return m_poolSlots[0] * (m_brickSize + 1); }
+    uint32_t getPoolHeight() const { return m_poolSlots[1] * (m_brickSize + 1); }
+    uint32_t getPoolDepth() const { return m_poolSlots[2] * (m_brickSize + 1); }
+    size_t getPoolRowStride() const { return size_t(getPoolWidth()) * m_bytesPerTexel; }
+    size_t getPoolSliceStride() const { return getPoolRowStride() * getPoolHeight(); }
+    const uint8_t* getPoolData() const { return m_pool.data(); }
+
+    /// Bytes of the index map and of the pool, against the dense volume
+    size_t getSparseSize() const;
+    size_t getDenseSize() const { return size_t(m_width) * m_height * m_depth * m_bytesPerTexel; }
+
+private:
+    /// Offset in the pool of the texel (x, y, z) of a slot
+    size_t getPoolOffset(uint32_t slot, uint32_t x, uint32_t y, uint32_t z) const;
+
+private:
+    NoiseChannelLayout m_layout;
+    uint32_t m_bytesPerTexel;
+    uint32_t m_width;
+    uint32_t m_height;
+    uint32_t m_depth;
+    uint32_t m_brickSize;
+    uint32_t m_gridWidth;
+    uint32_t m_gridHeight;
+    uint32_t m_gridDepth;
+    uint32_t m_brickCount;
+    uint32_t m_poolSlots[3];
+    std::vector<uint32_t> m_index;
+    std::vector<uint8_t> m_pool;
+};
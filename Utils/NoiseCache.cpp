@@ -0,0 +1,215 @@
+#include "NoiseCache.h"
+
+#include "../../../../../Common_3/Utilities/Interfaces/ILog.h"
+
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <direct.h>
+#include <process.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// 'VNCH'
+static const uint32_t kCacheMagic = 0x48434e56;
+// bump when the layout of the files changes
+static const uint32_t kCacheFileVersion = 1;
+
+std::string NoiseCache::s_directory;
+bool NoiseCache::s_enabled = false;
+
+/* --------------------------------- Key --------------------------------- */
+
+NoiseCache::Key::Key() :
+	m_hash(14695981039346656037ull)
+{
+
+}
+
+NoiseCache::Key& NoiseCache::Key::add(const void* pData, size_t size)
+{
+	const uint8_t* pBytes = (const uint8_t*)pData;
+	for (size_t i = 0; i < size; ++i) {
+		m_hash = (m_hash ^ pBytes[i]) * 1099511628211ull;
+	}
+	return *this;
+}
+
+NoiseCache::Key& NoiseCache::Key::add(const char* pString)
+{
+	// the terminator is hashed too so "ab" + "c" and "a" + "bc" differ
+	return add(pString, strlen(pString) + 1);
+}
+
+/* --------------------------------- Public methods --------------------------------- */
+
+void NoiseCache::init(const char* directory)
+{
+	s_directory = directory;
+#ifdef _WIN32
+	_mkdir(directory);
+#else
+	mkdir(directory, 0755);
+#endif
+	s_enabled = true;
+}
+
+void NoiseCache::exit()
+{
+	s_directory.clear();
+	s_enabled = false;
+}
+
+bool NoiseCache::isEnabled()
+{
+	return s_enabled;
+}
+
+bool NoiseCache::open(uint64_t key, uint32_t width, uint32_t height, uint32_t depth, uint32_t bytesPerTexel, Entry& entry)
+{
+	memset(&entry, 0, sizeof(Entry));
+	if (!s_enabled)
+		return false;
+
+	std::string path = getPath(key);
+#ifdef _WIN32
+	HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+	LARGE_INTEGER fileSize;
+	GetFileSizeEx(file, &fileSize);
+	HANDLE mapping = fileSize.QuadPart > 0 ? CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL) : NULL;
+	CloseHandle(file);
+	if (!mapping)
+		return false;
+	entry.pMapping = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	entry.pHandle = mapping;
+	entry.mappingSize = size_t(fileSize.QuadPart);
+	if (!entry.pMapping) {
+		close(entry);
+		return false;
+	}
+#else
+	int file = ::open(path.c_str(), O_RDONLY);
+	if (file < 0)
+		return false;
+	struct stat fileStat;
+	void* pMapping = MAP_FAILED;
+	if (fstat(file, &fileStat) == 0 && fileStat.st_size > 0)
+		pMapping = mmap(NULL, size_t(fileStat.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+	::close(file);
+	if (pMapping == MAP_FAILED)
+		return false;
+	entry.pMapping = pMapping;
+	entry.mappingSize = size_t(fileStat.st_size);
+#endif
+
+	// anything unexpected is treated as a miss, the entry gets rewritten after the bake
+	uint64_t payloadSize = uint64_t(width) * height * depth * bytesPerTexel;
+	if (entry.mappingSize >= sizeof(NoiseCacheHeader)) {
+		memcpy(&entry.header, entry.pMapping, sizeof(NoiseCacheHeader));
+	}
+	const NoiseCacheHeader& header = entry.header;
+	if (entry.mappingSize < sizeof(NoiseCacheHeader) || header.magic != kCacheMagic || header.fileVersion != kCacheFileVersion ||
+		header.key != key || header.width != width || header.height != height || header.depth != depth ||
+		header.bytesPerTexel != bytesPerTexel || header.payloadSize != payloadSize ||
+		entry.mappingSize - sizeof(NoiseCacheHeader) < payloadSize)
+	{
+		LOGF(LogLevel::eWARNING, "NoiseCache: ignoring invalid entry %s", path.c_str());
+		close(entry);
+		return false;
+	}
+
+	entry.pTexels = (const uint8_t*)entry.pMapping + sizeof(NoiseCacheHeader);
+	return true;
+}
+
+void NoiseCache::close(Entry& entry)
+{
+#ifdef _WIN32
+	if (entry.pMapping)
+		UnmapViewOfFile(entry.pMapping);
+	if (entry.pHandle)
+		CloseHandle((HANDLE)entry.pHandle);
+#else
+	if (entry.pMapping)
+		munmap(entry.pMapping, entry.mappingSize);
+#endif
+	memset(&entry, 0, sizeof(Entry));
+}
+
+bool NoiseCache::store(uint64_t key, uint32_t width, uint32_t height, uint32_t depth, uint32_t bytesPerTexel,
+	const uint8_t* pTexels, size_t rowStride, size_t sliceStride)
+{
+	if (!s_enabled)
+		return false;
+
+	NoiseCacheHeader header = {};
+	header.magic = kCacheMagic;
+	header.fileVersion = kCacheFileVersion;
+	header.key = key;
+	header.width = width;
+	header.height = height;
+	header.depth = depth;
+	header.bytesPerTexel = bytesPerTexel;
+	header.payloadSize = uint64_t(width) * height * depth * bytesPerTexel;
+
+	// write next to the final file and rename it once complete, a crash never leaves a truncated entry behind
+	std::string path = getPath(key);
+	std::string tmpPath = getTempPath(path);
+	FILE* pFile = fopen(tmpPath.c_str(), "wb");
+	if (!pFile) {
+		LOGF(LogLevel::eWARNING, "NoiseCache: can't write %s", tmpPath.c_str());
+		return false;
+	}
+
+	bool success = fwrite(&header, sizeof(NoiseCacheHeader), 1, pFile) == 1;
+	size_t rowSize = size_t(width) * bytesPerTexel;
+	for (uint32_t z = 0; z < depth && success; ++z) {
+		for (uint32_t y = 0; y < height && success; ++y) {
+			success = fwrite(pTexels + z * sliceStride + y * rowStride, rowSize, 1, pFile) == 1;
+		}
+	}
+	success = fclose(pFile) == 0 && success;
+
+#ifdef _WIN32
+	success = success && MoveFileExA(tmpPath.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING);
+#else
+	success = success && rename(tmpPath.c_str(), path.c_str()) == 0;
+#endif
+	if (!success) {
+		LOGF(LogLevel::eWARNING, "NoiseCache: failed to store %s", path.c_str());
+		remove(tmpPath.c_str());
+	}
+	return success;
+}
+
+std::string NoiseCache::getTempPath(const std::string& path)
+{
+	static std::atomic<uint32_t> s_tempCount(0);
+#ifdef _WIN32
+	unsigned processId = unsigned(_getpid());
+#else
+	unsigned processId = unsigned(getpid());
+#endif
+	char suffix[48];
+	snprintf(suffix, sizeof(suffix), ".%u.%u.tmp", processId, s_tempCount.fetch_add(1));
+	return path + suffix;
+}
+
+/* --------------------------------- Private methods --------------------------------- */
+
+std::string NoiseCache::getPath(uint64_t key)
+{
+	char name[32];
+	snprintf(name, sizeof(name), "%016llx.noise", (unsigned long long)key);
+	return s_directory + "/" + name;
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+/// Header of a cache file, followed by the texels: tightly packed rows, then slices
+struct NoiseCacheHeader
+{
+    uint32_t magic;
+    uint32_t fileVersion;
+    uint64_t key;
+    uint32_t width;
+    uint32_t height;
+    uint32_t depth;
+    uint32_t bytesPerTexel;
+    uint64_t payloadSize;
+};
+
+/// Content addressed cache of baked noise textures.
+/// Each file is named after the hash of every parameter of the bake, generator algorithm versions included,
+/// so changing a parameter or an algorithm simply points to another file.
+class NoiseCache
+{
+public:
+    /// Incremental FNV-1a hash of the bake parameters
+    class Key
+    {
+    public:
+        Key();
+        Key& add(const void* pData, size_t size);
+        Key& add(const char* pString);
+        template <typename T>
+        Key& add(T value) { return add(&value, sizeof(T)); }
+        uint64_t get() const { return m_hash; }
+
+    private:
+        uint64_t m_hash;
+    };
+
+    /// Read only mapping of a cache file
+    struct Entry
+    {
+        NoiseCacheHeader header;
+        const uint8_t* pTexels;
+        void* pMapping;
+        size_t mappingSize;
+        void* pHandle;
+    };
+
+    // -------- setup
+    /// Enable the cache, files go to directory (created if needed)
+    static void init(const char* directory);
+    static void exit();
+    static bool isEnabled();
+
+    // -------- entries
+    /// Map the entry of key, false on a miss or when the file doesn't match the expected layout
+    static bool open(uint64_t key, uint32_t width, uint32_t height, uint32_t depth, uint32_t bytesPerTexel, Entry& entry);
+    static void close(Entry& entry);
+    /// Write an entry, the texels are read from rows / slices with the given strides
+    static bool store(uint64_t key, uint32_t width, uint32_t height, uint32_t depth, uint32_t bytesPerTexel,
+        const uint8_t* pTexels, size_t rowStride, size_t sliceStride);
+
+    /// Unique temporary file next to path (process id and counter), concurrent writers of path never share it
+    static std::string getTempPath(const std::string& path);
+
+private:
+    static std::string getPath(uint64_t key);
+
+private:
+    static std::string s_directory;
+    static bool s_enabled;
+};
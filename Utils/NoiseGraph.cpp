@@ -0,0 +1,330 @@
+#include "NoiseGraph.h"
+#include "NoiseBaker.h"
+#include "NoiseCache.h"
+#include "TaskScheduler.h"
+#include "../Noise/2d/PerlinNoise2D.h"
+#include "../Noise/2d/WorleyNoise2D.h"
+#include "../Noise/3d/PerlinNoise3D.h"
+#include "../Noise/3d/WorleyNoise3D.h"
+#include "../Noise/NoiseVersion.h"
+
+#include <algorithm>
+#include <cstring>
+
+// rows of a tile are chosen so a tile holds about this many texels per node
+static const uint32_t kTileTexels = 16384;
+
+NoiseGraph::NoiseGraph(uint32_t width, uint32_t height, uint32_t depth) :
+	m_width(width),
+	m_height(height),
+	m_depth(depth)
+{
+}
+
+NoiseGraph::~NoiseGraph()
+{
+}
+
+/* --------------------------------- Public methods --------------------------------- */
+
+NoiseGraph::Node NoiseGraph::constant(float value)
+{
+	NodeDesc desc;
+	desc.op = Op::Constant;
+	desc.params = { value };
+	return findOrAdd(desc);
+}
+
+NoiseGraph::Node NoiseGraph::perlin2D(const IVector2& kernelSize, uint32_t nbLayers, float scaleFactor, int randomSeed,
+	GradientHash gradientHash)
+{
+	NodeDesc desc;
+	desc.op = Op::Perlin2D;
+	desc.params = { scaleFactor };
+	desc.intParams = { kernelSize.getX(), kernelSize.getY(), int32_t(nbLayers), randomSeed, int32_t(gradientHash) };
+	return findOrAdd(desc);
+}
+
+NoiseGraph::Node NoiseGraph::worley2D(uint32_t nbSubdiv)
+{
+	NodeDesc desc;
+	desc.op = Op::Worley2D;
+	desc.intParams = { int32_t(nbSubdiv) };
+	return findOrAdd(desc);
+}
+
+NoiseGraph::Node NoiseGraph::perlin3D(uint32_t kernelSize, uint32_t nbLayers, float scaleFactor, int randomSeed,
+	GradientHash gradientHash)
+{
+	NodeDesc desc;
+	desc.op = Op::Perlin3D;
+	desc.params = { scaleFactor };
+	desc.intParams = { int32_t(kernelSize), int32_t(nbLayers), randomSeed, int32_t(gradientHash) };
+	return findOrAdd(desc);
+}
+
+NoiseGraph::Node NoiseGraph::worley3D(uint32_t nbSubdiv, int randomSeed)
+{
+	NodeDesc desc;
+	desc.op = Op::Worley3D;
+	desc.intParams = { int32_t(nbSubdiv), randomSeed };
+	return findOrAdd(desc);
+}
+
+NoiseGraph::Node NoiseGraph::remap(Node value, Node l0, Node h0, Node l1, Node h1)
+{
+	NodeDesc desc;
+	desc.op = Op::Remap;
+	desc.inputs = { value, l0, h0, l1, h1 };
+	return findOrAdd(desc);
+}
+
+NoiseGraph::Node NoiseGraph::remap(Node value, float l0, float h0, float l1, float h1)
+{
+	return remap(value, constant(l0), constant(h0), constant(l1), constant(h1));
+}
+
+NoiseGraph::Node NoiseGraph::weightedSum(const std::vector<Term>& terms)
+{
+	NodeDesc desc;
+	desc.op = Op::WeightedSum;
+	for (const Term& term : terms)
+	{
+		desc.inputs.push_back(term.node);
+		desc.params.push_back(term.weight);
+	}
+	return findOrAdd(desc);
+}
+
+NoiseGraph::Node NoiseGraph::threshold(Node value, float threshold)
+{
+	NodeDesc desc;
+	desc.op = Op::Threshold;
+	desc.inputs = { value };
+	desc.params = { threshold };
+	return findOrAdd(desc);
+}
+
+NoiseGraph::Node NoiseGraph::invert(Node value)
+{
+	NodeDesc desc;
+	desc.op = Op::Invert;
+	desc.inputs = { value };
+	return findOrAdd(desc);
+}
+
+NoiseGraph::Node NoiseGraph::saturate(Node value)
+{
+	NodeDesc desc;
+	desc.op = Op::Saturate;
+	desc.inputs = { value };
+	return findOrAdd(desc);
+}
+
+void NoiseGraph::addOutput(Node value)
+{
+	m_outputs.push_back(value);
+}
+
+uint64_t NoiseGraph::getHash() const
+{
+	std::vector<bool> live = findLiveNodes();
+	NoiseCache::Key key;
+	key.add("NoiseGraph").add(NoiseVersion::PerlinNoise2D).add(NoiseVersion::WorleyNoise2D)
+		.add(NoiseVersion::PerlinNoise3D).add(NoiseVersion::WorleyNoise3D);
+	for (size_t i = 0; i < m_nodes.size(); ++i)
+	{
+		if (!live[i])
+			continue;
+		const NodeDesc& desc = m_nodes[i];
+		key.add(uint32_t(i)).add(uint32_t(desc.op)).add(uint32_t(desc.inputs.size()));
+		key.add(desc.inputs.data(), desc.inputs.size() * sizeof(Node));
+		key.add(uint32_t(desc.params.size())).add(desc.params.data(), desc.params.size() * sizeof(float));
+		key.add(uint32_t(desc.intParams.size())).add(desc.intParams.data(), desc.intParams.size() * sizeof(int32_t));
+	}
+	key.add(m_outputs.data(), m_outputs.size() * sizeof(Node));
+	return key.get();
+}
+
+void NoiseGraph::evaluate(NoiseSink& sink) const
+{
+	evaluate(sink, 0, m_depth);
+}
+
+void NoiseGraph::evaluate(NoiseSink& sink, uint32_t z0, uint32_t sliceCount) const
+{
+	std::vector<bool> live = findLiveNodes();
+	uint32_t liveCount = uint32_t(std::count(live.begin(), live.end(), true));
+
+	uint32_t tileRows = std::max(1u, std::min(m_height, kTileTexels / std::max(1u, m_width)));
+	uint32_t tilesPerSlice = (m_height + tileRows - 1) / tileRows;
+
+	TaskScheduler::parallelFor(sliceCount * tilesPerSlice, [&](uint32_t tile)
+	{
+		uint32_t z = z0 + tile / tilesPerSlice;
+		uint32_t y0 = (tile % tilesPerSlice) * tileRows;
+		uint32_t rowCount = std::min(tileRows, m_height - y0);
+		size_t tileSize = size_t(tileRows) * m_width;
+
+		// one buffer per live node, nodes only reference older nodes so creation order is a valid schedule
+		std::vector<float> storage(liveCount * tileSize);
+		std::vector<float*> values(m_nodes.size(), nullptr);
+		float* pNext = storage.data();
+		for (size_t i = 0; i < m_nodes.size(); ++i)
+		{
+			if (!live[i])
+				continue;
+			values[i] = pNext;
+			pNext += tileSize;
+			evaluateNode(m_nodes[i], y0, rowCount, z, values, values[i]);
+		}
+
+		std::vector<const float*> channels(m_outputs.size());
+		for (uint32_t y = 0; y < rowCount; ++y)
+		{
+			for (size_t c = 0; c < m_outputs.size(); ++c)
+				channels[c] = values[m_outputs[c]] + size_t(y) * m_width;
+			sink.writeChannels(y0 + y, z, 0, m_width, channels.data(), uint32_t(channels.size()));
+		}
+	});
+}
+
+/* --------------------------------- Private methods --------------------------------- */
+
+NoiseGraph::Node NoiseGraph::findOrAdd(NodeDesc& desc)
+{
+	for (size_t i = 0; i < m_nodes.size(); ++i)
+	{
+		const NodeDesc& node = m_nodes[i];
+		// parameters are compared bitwise, a node is only shared when it computes exactly the same values
+		if (node.op == desc.op && node.inputs == desc.inputs && node.intParams == desc.intParams &&
+			node.params.size() == desc.params.size() &&
+			(desc.params.empty() || memcmp(node.params.data(), desc.params.data(), desc.params.size() * sizeof(float)) == 0))
+		{
+			return Node(i);
+		}
+	}
+
+	const std::vector<int32_t>& p = desc.intParams;
+	switch (desc.op)
+	{
+	case Op::Perlin2D:
+		desc.pPerlin2D.reset(new PerlinNoise2D(IVector2(m_width, m_height), IVector2(p[0], p[1]), p[2], desc.params[0], p[3],
+			GradientHash(p[4])));
+		break;
+	case Op::Worley2D:
+		desc.pWorley2D.reset(new WorleyNoise2D(IVector2(m_width, m_height), p[0]));
+		break;
+	case Op::Perlin3D:
+		desc.pPerlin3D.reset(new PerlinNoise3D(IVector3(m_width, m_height, m_depth), p[0], p[1], desc.params[0], p[2],
+			GradientHash(p[3])));
+		break;
+	case Op::Worley3D:
+		desc.pWorley3D.reset(new WorleyNoise3D(IVector3(m_width, m_height, m_depth), p[0], p[1]));
+		break;
+	default:
+		break;
+	}
+
+	m_nodes.push_back(std::move(desc));
+	return Node(m_nodes.size() - 1);
+}
+
+std::vector<bool> NoiseGraph::findLiveNodes() const
+{
+	std::vector<bool> live(m_nodes.size(), false);
+	for (Node output : m_outputs)
+		live[output] = true;
+	// inputs are always older than the node using them, one backward pass is enough
+	for (size_t i = m_nodes.size(); i-- > 0;)
+	{
+		if (!live[i])
+			continue;
+		for (Node input : m_nodes[i].inputs)
+			live[input] = true;
+	}
+	return live;
+}
+
+void NoiseGraph::evaluateNode(const NodeDesc& desc, uint32_t y0, uint32_t rowCount, uint32_t z, const std::vector<float*>& values,
+	float* out) const
+{
+	uint32_t count = rowCount * m_width;
+	switch (desc.op)
+	{
+	case Op::Constant:
+		std::fill(out, out + count, desc.params[0]);
+		break;
+	case Op::Perlin2D:
+		for (uint32_t y = 0; y < rowCount; ++y)
+			desc.pPerlin2D->evaluateRow(y0 + y, 0, m_width, out + y * m_width);
+		break;
+	case Op::Worley2D:
+		for (uint32_t y = 0; y < rowCount; ++y)
+			desc.pWorley2D->evaluateSpan(y0 + y, 0, m_width, out + y * m_width);
+		break;
+	case Op::Perlin3D:
+		for (uint32_t y = 0; y < rowCount; ++y)
+			desc.pPerlin3D->evaluateRow(y0 + y, z, 0, m_width, out + y * m_width);
+		break;
+	case Op::Worley3D:
+		// cell-major evaluation of the whole tile
+		desc.pWorley3D->evaluateBlock(IVector3(0, y0, z), IVector3(m_width, rowCount, 1), out);
+		break;
+	case Op::Remap:
+	{
+		const float* value = values[desc.inputs[0]];
+		const float* l0 = values[desc.inputs[1]];
+		const float* h0 = values[desc.inputs[2]];
+		const float* l1 = values[desc.inputs[3]];
+		const float* h1 = values[desc.inputs[4]];
+		for (uint32_t i = 0; i < count; ++i)
+			out[i] = ::remap(value[i], l0[i], h0[i], l1[i], h1[i]);
+		break;
+	}
+	case Op::WeightedSum:
+		if (desc.inputs.empty())
+			std::fill(out, out + count, 0.0f);
+		for (size_t t = 0; t < desc.inputs.size(); ++t)
+		{
+			const float* term = values[desc.inputs[t]];
+			float weight = desc.params[t];
+			if (t == 0)
+			{
+				for (uint32_t i = 0; i < count; ++i)
+					out[i] = weight * term[i];
+			}
+			else
+			{
+				for (uint32_t i = 0; i < count; ++i)
+					out[i] += weight * term[i];
+			}
+		}
+		break;
+	case Op::Threshold:
+	{
+		const float* value = values[desc.inputs[0]];
+		float threshold = desc.params[0];
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			float c = max(value[i] - threshold, 0.0f);
+			out[i] = min(1.0f, ::remap(c, 0.0f, 1.0f - threshold, 0.0f, 1.0f));
+		}
+		break;
+	}
+	case Op::Invert:
+	{
+		const float* value = values[desc.inputs[0]];
+		for (uint32_t i = 0; i < count; ++i)
+			out[i] = 1.0f - value[i];
+		break;
+	}
+	case Op::Saturate:
+	{
+		const float* value = values[desc.inputs[0]];
+		for (uint32_t i = 0; i < count; ++i)
+			out[i] = ::saturate(value[i]);
+		break;
+	}
+	}
+}
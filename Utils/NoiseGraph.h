@@ -0,0 +1,115 @@
+#pragma once
+
+//Math
+#include "../../../../../Common_3/Utilities/Math/MathTypes.h"
+
+#include "../Noise/NoiseHash.h"
+#include "../Noise/NoiseSink.h"
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+class PerlinNoise2D;
+class WorleyNoise2D;
+class PerlinNoise3D;
+class WorleyNoise3D;
+
+/// Declarative composition of the noise generators into the channels of a texture.
+/// Nodes are created bottom up and referenced by handle. Creating a node identical to an existing one (same source and
+/// parameters, or same operator on the same inputs) returns the existing handle, so octaves and subexpressions shared
+/// by several channels are evaluated once per texel.
+/// evaluate() runs tiles of rows on the TaskScheduler, only the nodes an output depends on are evaluated and the
+/// result doesn't depend on the worker count.
+class NoiseGraph
+{
+public:
+    typedef uint32_t Node;
+
+    struct Term
+    {
+        Node node;
+        float weight;
+    };
+
+    NoiseGraph(uint32_t width, uint32_t height, uint32_t depth = 1);
+    ~NoiseGraph();
+
+public:
+    // -------- sources, sized to the graph. 2D sources are repeated on every slice
+    Node constant(float value);
+    Node perlin2D(const IVector2& kernelSize, uint32_t nbLayers, float scaleFactor, int randomSeed,
+        GradientHash gradientHash = GradientHash::Permutation);
+    Node worley2D(uint32_t nbSubdiv);
+    Node perlin3D(uint32_t kernelSize, uint32_t nbLayers, float scaleFactor, int randomSeed,
+        GradientHash gradientHash = GradientHash::Permutation);
+    Node worley3D(uint32_t nbSubdiv, int randomSeed);
+
+    // -------- operators
+    /// Map value from the [l0-h0] to [l1-h1] range, same formula as remap()
+    Node remap(Node value, Node l0, Node h0, Node l1, Node h1);
+    Node remap(Node value, float l0, float h0, float l1, float h1);
+    /// Sum of the weighted terms, accumulated in order
+    Node weightedSum(const std::vector<Term>& terms);
+    /// max(value - threshold, 0) stretched back to [0-1], clamped to 1
+    Node threshold(Node value, float threshold);
+    /// 1 - value
+    Node invert(Node value);
+    Node saturate(Node value);
+
+    // -------- outputs
+    /// value becomes the next channel of the evaluated rows
+    void addOutput(Node value);
+    uint32_t getOutputCount() const { return uint32_t(m_outputs.size()); }
+    uint32_t getWidth() const { return m_width; }
+    uint32_t getHeight() const { return m_height; }
+    uint32_t getDepth() const { return m_depth; }
+    /// Hash of the nodes the outputs depend on and of their generator versions, to key baked textures
+    uint64_t getHash() const;
+
+    /// Stream every row of the outputs to sink, channel c is output c
+    void evaluate(NoiseSink& sink) const;
+    /// Only the rows of the slices [z0, z0 + sliceCount), at their z in the volume
+    void evaluate(NoiseSink& sink, uint32_t z0, uint32_t sliceCount) const;
+
+private:
+    enum class Op : uint32_t
+    {
+        Constant,
+        Perlin2D,
+        Worley2D,
+        Perlin3D,
+        Worley3D,
+        Remap,
+        WeightedSum,
+        Threshold,
+        Invert,
+        Saturate,
+    };
+
+    struct NodeDesc
+    {
+        Op op;
+        std::vector<Node> inputs;
+        std::vector<float> params;
+        std::vector<int32_t> intParams;
+        // generator of a source node
+        std::unique_ptr<PerlinNoise2D> pPerlin2D;
+        std::unique_ptr<WorleyNoise2D> pWorley2D;
+        std::unique_ptr<PerlinNoise3D> pPerlin3D;
+        std::unique_ptr<WorleyNoise3D> pWorley3D;
+    };
+
+    /// Handle of the node matching desc, desc is only kept (and its generator built) when there is no such node yet
+    Node findOrAdd(NodeDesc& desc);
+    std::vector<bool> findLiveNodes() const;
+    void evaluateNode(const NodeDesc& desc, uint32_t y0, uint32_t rowCount, uint32_t z, const std::vector<float*>& values,
+        float* out) const;
+
+private:
+    uint32_t m_width;
+    uint32_t m_height;
+    uint32_t m_depth;
+    std::vector<NodeDesc> m_nodes;
+    std::vector<Node> m_outputs;
+};
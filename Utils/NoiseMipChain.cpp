@@ -0,0 +1,221 @@
+#include "NoiseMipChain.h"
+#include "TaskScheduler.h"
+
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define NOISE_MIP_SSE2 1
+#endif
+
+/// Number of stored components of a texel, the filter also averages the alpha of RGBA8
+static uint32_t getComponentCount(NoiseChannelLayout layout)
+{
+	switch (layout)
+	{
+	case NoiseChannelLayout::RG8:
+	case NoiseChannelLayout::BC5:
+		return 2;
+	case NoiseChannelLayout::RGBA8:
+		return 4;
+	default:
+		return 1;
+	}
+}
+
+/// Unpack a row into one plane of width floats per component, 8 and 16 bit unorms keep their integer range
+static void decodeRow(NoiseChannelLayout layout, const uint8_t* pSrc, uint32_t width, float* planes)
+{
+	uint32_t componentCount = getComponentCount(layout);
+	switch (layout)
+	{
+	case NoiseChannelLayout::R16_UNORM:
+	{
+		const uint16_t* src = (const uint16_t*)pSrc;
+		for (uint32_t x = 0; x < width; ++x)
+			planes[x] = float(src[x]);
+		break;
+	}
+	case NoiseChannelLayout::R16F:
+	{
+		const uint16_t* src = (const uint16_t*)pSrc;
+		for (uint32_t x = 0; x < width; ++x)
+			planes[x] = halfToFloat(src[x]);
+		break;
+	}
+	default:
+		for (uint32_t c = 0; c < componentCount; ++c)
+		{
+			float* plane = planes + c * width;
+			for (uint32_t x = 0; x < width; ++x)
+				plane[x] = float(pSrc[x * componentCount + c]);
+		}
+		break;
+	}
+}
+
+/// Pack the averaged planes back, unorms are rounded to nearest
+static void encodeRow(NoiseChannelLayout layout, const float* planes, uint32_t width, uint8_t* pDst)
+{
+	uint32_t componentCount = getComponentCount(layout);
+	switch (layout)
+	{
+	case NoiseChannelLayout::R16_UNORM:
+	{
+		uint16_t* dst = (uint16_t*)pDst;
+		for (uint32_t x = 0; x < width; ++x)
+			dst[x] = uint16_t(planes[x] + 0.5f);
+		break;
+	}
+	case NoiseChannelLayout::R16F:
+	{
+		uint16_t* dst = (uint16_t*)pDst;
+		for (uint32_t x = 0; x < width; ++x)
+			dst[x] = floatToHalf(planes[x]);
+		break;
+	}
+	default:
+		for (uint32_t c = 0; c < componentCount; ++c)
+		{
+			const float* plane = planes + c * width;
+			for (uint32_t x = 0; x < width; ++x)
+				pDst[x * componentCount + c] = uint8_t(plane[x] + 0.5f);
+		}
+		break;
+	}
+}
+
+/// sum += src
+static void addRow(const float* src, uint32_t count, float* sum)
+{
+	uint32_t i = 0;
+#if defined(NOISE_MIP_SSE2)
+	for (; i + 4 <= count; i += 4)
+	{
+		_mm_storeu_ps(sum + i, _mm_add_ps(_mm_loadu_ps(sum + i), _mm_loadu_ps(src + i)));
+	}
+#endif
+	for (; i < count; ++i)
+	{
+		sum[i] += src[i];
+	}
+}
+
+/// dst[x] = (src[2x] + src[2x + 1]) * scale, a single texel row is only scaled
+static void addPairs(const float* src, uint32_t srcCount, uint32_t dstCount, float scale, float* dst)
+{
+	if (srcCount == 1)
+	{
+		dst[0] = src[0] * scale;
+		return;
+	}
+
+	uint32_t x = 0;
+#if defined(NOISE_MIP_SSE2)
+	const __m128 vScale = _mm_set1_ps(scale);
+	for (; x + 4 <= dstCount; x += 4)
+	{
+		__m128 a = _mm_loadu_ps(src + 2 * x);
+		__m128 b = _mm_loadu_ps(src + 2 * x + 4);
+		__m128 even = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+		__m128 odd = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+		_mm_storeu_ps(dst + x, _mm_mul_ps(_mm_add_ps(even, odd), vScale));
+	}
+#endif
+	for (; x < dstCount; ++x)
+	{
+		dst[x] = (src[2 * x] + src[2 * x + 1]) * scale;
+	}
+}
+
+NoiseMipChain::NoiseMipChain(NoiseChannelLayout layout, uint32_t width, uint32_t height, uint32_t depth, uint32_t levelCount) :
+	m_layout(layout),
+	m_bytesPerTexel(PackedRowSink::getBytesPerTexel(layout))
+{
+	uint32_t fullLevelCount = getFullLevelCount(width, height, depth);
+	levelCount = levelCount == 0 ? fullLevelCount : std::min(levelCount, fullLevelCount);
+
+	m_levels.resize(levelCount);
+	for (uint32_t i = 0; i < levelCount; ++i)
+	{
+		Level& level = m_levels[i];
+		level.width = std::max(1u, width >> i);
+		level.height = std::max(1u, height >> i);
+		level.depth = std::max(1u, depth >> i);
+		level.data.resize(size_t(level.width) * level.height * level.depth * m_bytesPerTexel);
+	}
+}
+
+/* --------------------------------- Public methods --------------------------------- */
+
+uint32_t NoiseMipChain::getFullLevelCount(uint32_t width, uint32_t height, uint32_t depth)
+{
+	uint32_t size = std::max(width, std::max(height, depth));
+	uint32_t levelCount = 1;
+	while (size > 1)
+	{
+		size >>= 1;
+		++levelCount;
+	}
+	return levelCount;
+}
+
+void NoiseMipChain::downsample(NoiseChannelLayout layout, const uint8_t* pSrc, size_t srcRowStride, size_t srcSliceStride,
+	uint32_t srcWidth, uint32_t srcHeight, uint32_t srcDepth, uint8_t* pDst, size_t dstRowStride, size_t dstSliceStride)
+{
+	uint32_t componentCount = getComponentCount(layout);
+	uint32_t dstWidth = std::max(1u, srcWidth >> 1);
+	uint32_t dstHeight = std::max(1u, srcHeight >> 1);
+	uint32_t dstDepth = std::max(1u, srcDepth >> 1);
+	// a dimension already down to 1 isn't filtered, odd dimensions drop their last texel
+	uint32_t footprintY = srcHeight > 1 ? 2 : 1;
+	uint32_t footprintZ = srcDepth > 1 ? 2 : 1;
+	float scale = 1.0f / float((srcWidth > 1 ? 2 : 1) * footprintY * footprintZ);
+
+	TaskScheduler::parallelFor(dstDepth * dstHeight, [&](uint32_t row)
+	{
+		uint32_t z = row / dstHeight;
+		uint32_t y = row % dstHeight;
+
+		// sum the 2 or 4 source rows, then the pairs of texels of each component plane
+		std::vector<float> sum(size_t(componentCount) * srcWidth);
+		std::vector<float> planes(size_t(componentCount) * srcWidth);
+		for (uint32_t dz = 0; dz < footprintZ; ++dz)
+		{
+			for (uint32_t dy = 0; dy < footprintY; ++dy)
+			{
+				const uint8_t* pSrcRow = pSrc + (2 * z + dz) * srcSliceStride + (2 * y + dy) * srcRowStride;
+				if (dz == 0 && dy == 0)
+				{
+					decodeRow(layout, pSrcRow, srcWidth, sum.data());
+				}
+				else
+				{
+					decodeRow(layout, pSrcRow, srcWidth, planes.data());
+					addRow(planes.data(), componentCount * srcWidth, sum.data());
+				}
+			}
+		}
+
+		for (uint32_t c = 0; c < componentCount; ++c)
+		{
+			addPairs(&sum[c * srcWidth], srcWidth, dstWidth, scale, &planes[c * dstWidth]);
+		}
+		encodeRow(layout, planes.data(), dstWidth, pDst + z * dstSliceStride + y * dstRowStride);
+	});
+}
+
+PackedRowSink NoiseMipChain::getSink()
+{
+	return PackedRowSink(m_layout, getData(0), getRowStride(0), getSliceStride(0));
+}
+
+void NoiseMipChain::build()
+{
+	// each level needs the previous one, the rows of a level are filtered in parallel
+	for (uint32_t i = 1; i < getLevelCount(); ++i)
+	{
+		downsample(m_layout, getData(i - 1), getRowStride(i - 1), getSliceStride(i - 1),
+			getWidth(i - 1), getHeight(i - 1), getDepth(i - 1), getData(i), getRowStride(i), getSliceStride(i));
+	}
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "NoiseSinks.h"
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+/// CPU mip pyramid of a baked 2D texture or 3D volume, packed in a channel layout.
+/// Level 0 is filled through getSink(), build() then box filters every level from the previous one:
+/// each dimension is halved (down to 1), a texel averages its 2x2 (2D) or 2x2x2 (3D) footprint.
+/// Levels are tightly packed so they can be uploaded with one copy per row.
+class NoiseMipChain
+{
+public:
+    /// levelCount 0 builds the full chain down to 1x1x1
+    NoiseMipChain(NoiseChannelLayout layout, uint32_t width, uint32_t height, uint32_t depth, uint32_t levelCount = 0);
+
+public:
+    static uint32_t getFullLevelCount(uint32_t width, uint32_t height, uint32_t depth);
+    /// Box filter the src level (srcWidth x srcHeight x srcDepth) into the next one, destination rows are filtered in parallel
+    static void downsample(NoiseChannelLayout layout, const uint8_t* pSrc, size_t srcRowStride, size_t srcSliceStride,
+        uint32_t srcWidth, uint32_t srcHeight, uint32_t srcDepth, uint8_t* pDst, size_t dstRowStride, size_t dstSliceStride);
+
+    /// Sink writing into level 0
+    PackedRowSink getSink();
+    void build();
+
+    NoiseChannelLayout getLayout() const { return m_layout; }
+    uint32_t getLevelCount() const { return uint32_t(m_levels.size()); }
+    uint32_t getWidth(uint32_t level) const { return m_levels[level].width; }
+    uint32_t getHeight(uint32_t level) const { return m_levels[level].height; }
+    uint32_t getDepth(uint32_t level) const { return m_levels[level].depth; }
+    size_t getRowStride(uint32_t level) const { return size_t(m_levels[level].width) * m_bytesPerTexel; }
+    size_t getSliceStride(uint32_t level) const { return getRowStride(level) * m_levels[level].height; }
+    uint8_t* getData(uint32_t level) { return m_levels[level].data.data(); }
+    const uint8_t* getData(uint32_t level) const { return m_levels[level].data.data(); }
+
+private:
+    struct Level
+    {
+        uint32_t width;
+        uint32_t height;
+        uint32_t depth;
+        std::vector<uint8_t> data;
+    };
+
+    NoiseChannelLayout m_layout;
+    uint32_t m_bytesPerTexel;
+    std::vector<Level> m_levels;
+};
@@ -0,0 +1,85 @@
+#include "NoiseSampler.h"
+
+#include <algorithm>
+#include <cmath>
+
+/// Texel index and weight of the next texel along an axis of size texels, repeat addressing
+static void computeFootprint(float coord, uint32_t size, uint32_t& i0, uint32_t& i1, float& weight)
+{
+	// texel centers are at half integers
+	float texel = coord * float(size) - 0.5f;
+	float base = std::floor(texel);
+	weight = texel - base;
+	int64_t index = int64_t(base) % int64_t(size);
+	if (index < 0)
+		index += size;
+	i0 = uint32_t(index);
+	i1 = i0 + 1 == size ? 0 : i0 + 1;
+}
+
+/* --------------------------------- Public methods --------------------------------- */
+
+NoiseSampler::NoiseSampler(const NoiseMipChain& mipChain) :
+	m_mipChain(mipChain),
+	m_layout(mipChain.getLayout()),
+	m_bytesPerTexel(PackedRowSink::getBytesPerTexel(mipChain.getLayout()))
+{
+}
+
+void NoiseSampler::sample(float u, float v, float w, float lod, float* pOut) const
+{
+	// MIPMAP_MODE_NEAREST rounds the level of detail
+	int32_t maxLevel = int32_t(m_mipChain.getLevelCount()) - 1;
+	uint32_t level = uint32_t(std::min(maxLevel, std::max(0, int32_t(std::floor(lod + 0.5f)))));
+	uint32_t width = m_mipChain.getWidth(level);
+	uint32_t height = m_mipChain.getHeight(level);
+	uint32_t depth = m_mipChain.getDepth(level);
+
+	uint32_t x0, x1, y0, y1, z0 = 0, z1 = 0;
+	float fx, fy, fz = 0.0f;
+	computeFootprint(u, width, x0, x1, fx);
+	computeFootprint(v, height, y0, y1, fy);
+	if (depth > 1)
+		computeFootprint(w, depth, z0, z1, fz);
+
+	float corners[8][4];
+	uint32_t cornerCount = depth > 1 ? 8 : 4;
+	for (uint32_t i = 0; i < cornerCount; ++i)
+		fetch(level, i & 1 ? x1 : x0, i & 2 ? y1 : y0, i & 4 ? z1 : z0, corners[i]);
+
+	for (uint32_t c = 0; c < 4; ++c)
+	{
+		float value = 0.0f;
+		for (uint32_t i = 0; i < cornerCount; ++i)
+		{
+			float weight = (i & 1 ? fx : 1.0f - fx) * (i & 2 ? fy : 1.0f - fy);
+			if (depth > 1)
+				weight *= i & 4 ? fz : 1.0f - fz;
+			value += weight * corners[i][c];
+		}
+		pOut[c] = value;
+	}
+}
+
+void NoiseSampler::fetch(uint32_t level, uint32_t x, uint32_t y, uint32_t z, float* pOut) const
+{
+	const uint8_t* pTexel = m_mipChain.getData(level) + m_mipChain.getSliceStride(level) * z + m_mipChain.getRowStride(level) * y +
+		size_t(x) * m_bytesPerTexel;
+	pOut[0] = 0.0f;
+	pOut[1] = 0.0f;
+	pOut[2] = 0.0f;
+	pOut[3] = 1.0f;
+	switch (m_layout)
+	{
+	case NoiseChannelLayout::R16_UNORM:
+		pOut[0] = float(*(const uint16_t*)pTexel) / 65535.0f;
+		break;
+	case NoiseChannelLayout::R16F:
+		pOut[0] = halfToFloat(*(const uint16_t*)pTexel);
+		break;
+	default:
+		for (uint32_t c = 0; c < m_bytesPerTexel; ++c)
+			pOut[c] = float(pTexel[c]) / 255.0f;
+		break;
+	}
+}
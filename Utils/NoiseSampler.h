@@ -0,0 +1,25 @@
+#pragma once
+
+#include "NoiseMipChain.h"
+
+#include <cstdint>
+
+/// CPU reference of a linear filtered texture fetch (SampleLvl) over the levels of a NoiseMipChain, as set up by the cloud
+/// sampler: repeat addressing, bilinear (trilinear for a volume) inside a level, nearest level clamped to the chain.
+/// Unorm channels read as the GPU reads them, missing color channels are 0 and a missing alpha is 1
+class NoiseSampler
+{
+public:
+    /// mipChain must outlive the sampler
+    explicit NoiseSampler(const NoiseMipChain& mipChain);
+
+    /// pOut receives the 4 channels of the texture at (u, v, w), w is ignored by a 2D texture
+    void sample(float u, float v, float w, float lod, float* pOut) const;
+    /// Texel (x, y, z) of a level, coordinates already in range
+    void fetch(uint32_t level, uint32_t x, uint32_t y, uint32_t z, float* pOut) const;
+
+private:
+    const NoiseMipChain& m_mipChain;
+    NoiseChannelLayout m_layout;
+    uint32_t m_bytesPerTexel;
+};
@@ -0,0 +1,424 @@
+#include "NoiseSinks.h"
+
+//Math
+#include "../../../../../Common_3/Utilities/Math/MathTypes.h"
+#include "../../../../../Common_3/Utilities/ThirdParty/OpenSource/Nothings/stb_image_write.h"
+
+#include <cstring>
+
+#ifndef _WIN32
+#include <sys/types.h>
+#endif
+
+/// Seek from the start of the file, the offsets of large volumes don't fit the 32 bit long of Windows
+static bool seekFile(FILE* pFile, uint64_t offset)
+{
+#ifdef _WIN32
+	return _fseeki64(pFile, int64_t(offset), SEEK_SET) == 0;
+#else
+	return fseeko(pFile, off_t(offset), SEEK_SET) == 0;
+#endif
+}
+
+uint16_t floatToHalf(float value)
+{
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+	uint32_t sign = (bits >> 16) & 0x8000u;
+	uint32_t magnitude = bits & 0x7fffffffu;
+
+	// overflow, infinity and nan
+	if (magnitude >= 0x47800000u)
+		return uint16_t(sign | (magnitude > 0x7f800000u ? 0x7e00u : 0x7c00u));
+
+	uint32_t half;
+	uint32_t remainder;
+	uint32_t halfway;
+	if (magnitude < 0x38800000u)
+	{
+		// below the smallest normal half, 2^-25 and less round to zero
+		if (magnitude <= 0x33000000u)
+			return uint16_t(sign);
+		uint32_t shift = 126u - (magnitude >> 23);
+		uint32_t mantissa = (magnitude & 0x7fffffu) | 0x800000u;
+		half = mantissa >> shift;
+		remainder = mantissa & ((1u << shift) - 1u);
+		halfway = 1u << (shift - 1u);
+	}
+	else
+	{
+		// rebias the exponent, a carry out of the mantissa correctly bumps the exponent
+		half = (magnitude - 0x38000000u) >> 13;
+		remainder = magnitude & 0x1fffu;
+		halfway = 0x1000u;
+	}
+	if (remainder > halfway || (remainder == halfway && (half & 1u)))
+		++half;
+	return uint16_t(sign | half);
+}
+
+float halfToFloat(uint16_t value)
+{
+	uint32_t sign = uint32_t(value & 0x8000u) << 16;
+	uint32_t exponent = (value >> 10) & 0x1fu;
+	uint32_t mantissa = value & 0x3ffu;
+
+	uint32_t bits;
+	if (exponent == 0x1fu)
+	{
+		// infinity and nan
+		bits = sign | 0x7f800000u | (mantissa << 13);
+	}
+	else if (exponent != 0)
+	{
+		bits = sign | ((exponent + 112u) << 23) | (mantissa << 13);
+	}
+	else if (mantissa != 0)
+	{
+		// subnormal half, normalise the mantissa
+		exponent = 113u;
+		while (!(mantissa & 0x400u))
+		{
+			mantissa <<= 1;
+			--exponent;
+		}
+		bits = sign | (exponent << 23) | ((mantissa & 0x3ffu) << 13);
+	}
+	else
+	{
+		bits = sign;
+	}
+
+	float result;
+	memcpy(&result, &bits, sizeof(result));
+	return result;
+}
+
+/// Same quantisation as the 8 bit layouts
+static uint8_t quantize(float value)
+{
+	return uint8_t((int32_t)(value * 255.0f));
+}
+
+/* --------------------------------- Packed rows --------------------------------- */
+
+uint32_t PackedRowSink::getBytesPerTexel(NoiseChannelLayout layout)
+{
+	switch (layout)
+	{
+	case NoiseChannelLayout::R8:
+	case NoiseChannelLayout::BC4:
+		return 1;
+	case NoiseChannelLayout::R16_UNORM:
+	case NoiseChannelLayout::R16F:
+	case NoiseChannelLayout::RG8:
+	case NoiseChannelLayout::BC5:
+		return 2;
+	case NoiseChannelLayout::RGBA8:
+	default:
+		return 4;
+	}
+}
+
+void PackedRowSink::packRow(NoiseChannelLayout layout, const float* const* channels, uint32_t channelCount, uint32_t count, uint8_t* pDst)
+{
+	const float* r = channels[0];
+	const float* g = channelCount > 1 ? channels[1] : r;
+	const float* b = channelCount > 2 ? channels[2] : (channelCount > 1 ? nullptr : r);
+
+	switch (layout)
+	{
+	case NoiseChannelLayout::R8:
+	case NoiseChannelLayout::BC4:
+		for (uint32_t x = 0; x < count; ++x)
+		{
+			pDst[x] = uint8_t((int32_t)(r[x] * 255.0f));
+		}
+		break;
+	case NoiseChannelLayout::R16_UNORM:
+	{
+		uint16_t* scanline = (uint16_t*)pDst;
+		for (uint32_t x = 0; x < count; ++x)
+		{
+			scanline[x] = uint16_t(saturate(r[x]) * 65535.0f + 0.5f);
+		}
+		break;
+	}
+	case NoiseChannelLayout::R16F:
+	{
+		uint16_t* scanline = (uint16_t*)pDst;
+		for (uint32_t x = 0; x < count; ++x)
+		{
+			scanline[x] = floatToHalf(r[x]);
+		}
+		break;
+	}
+	case NoiseChannelLayout::RG8:
+	case NoiseChannelLayout::BC5:
+		for (uint32_t x = 0; x < count; ++x)
+		{
+			pDst[2 * x + 0] = uint8_t((int32_t)(r[x] * 255.0f));
+			pDst[2 * x + 1] = uint8_t((int32_t)(g[x] * 255.0f));
+		}
+		break;
+	case NoiseChannelLayout::RGBA8:
+	{
+		uint32_t* scanline = (uint32_t*)pDst;
+		for (uint32_t x = 0; x < count; ++x)
+		{
+			int32_t cr = (int32_t)(r[x] * 255.0f);
+			int32_t cg = (int32_t)(g[x] * 255.0f);
+			int32_t cb = b ? (int32_t)(b[x] * 255.0f) : 0;
+			scanline[x] = (cb) << 16 | (cg) << 8 | (cr) << 0;
+		}
+		break;
+	}
+	}
+}
+
+PackedRowSink::PackedRowSink(NoiseChannelLayout layout, uint8_t* pDst, size_t rowStride, size_t sliceStride) :
+	m_layout(layout),
+	m_bytesPerTexel(getBytesPerTexel(layout)),
+	m_pDst(pDst),
+	m_rowStride(rowStride),
+	m_sliceStride(sliceStride)
+{
+}
+
+void PackedRowSink::writeChannels(uint32_t y, uint32_t z, uint32_t x0, uint32_t count, const float* const* channels, uint32_t channelCount)
+{
+	uint8_t* pRow = m_pDst + m_sliceStride * z + m_rowStride * y + size_t(x0) * m_bytesPerTexel;
+	packRow(m_layout, channels, channelCount, count, pRow);
+}
+
+/* --------------------------------- Buffers --------------------------------- */
+
+QuantizedBufferSink::QuantizedBufferSink(uint32_t width, uint32_t height, uint32_t depth) :
+	m_width(width),
+	m_height(height),
+	m_data(size_t(width) * height * depth)
+{
+}
+
+void QuantizedBufferSink::writeChannels(uint32_t y, uint32_t z, uint32_t x0, uint32_t count, const float* const* channels, uint32_t channelCount)
+{
+	PackedRowSink::packRow(NoiseChannelLayout::R8, channels, channelCount, count, &m_data[(size_t(z) * m_height + y) * m_width + x0]);
+}
+
+FloatBufferSink::FloatBufferSink(uint32_t width, uint32_t height, uint32_t depth, uint32_t channelCount) :
+	m_width(width),
+	m_height(height),
+	m_channelCount(channelCount),
+	m_data(size_t(width) * height * depth * channelCount)
+{
+}
+
+void FloatBufferSink::writeChannels(uint32_t y, uint32_t z, uint32_t x0, uint32_t count, const float* const* channels, uint32_t channelCount)
+{
+	float* pRow = &m_data[((size_t(z) * m_height + y) * m_width + x0) * m_channelCount];
+	for (uint32_t c = 0; c < m_channelCount; ++c)
+	{
+		// a single channel row fills every channel
+		const float* src = channels[c < channelCount ? c : 0];
+		for (uint32_t x = 0; x < count; ++x)
+		{
+			pRow[x * m_channelCount + c] = src[x];
+		}
+	}
+}
+
+/* --------------------------------- File stream --------------------------------- */
+
+FileStreamSink::FileStreamSink(const char* path, uint32_t width, uint32_t height, uint32_t depth, uint32_t channelCount) :
+	m_pFile(nullptr),
+	m_headerSize(0),
+	m_width(width),
+	m_height(height),
+	m_depth(depth),
+	m_channelCount(channelCount == 1 ? 1 : 3),
+	m_writtenTexels(0),
+	m_failed(false)
+{
+	m_pFile = fopen(path, "wb");
+	if (!m_pFile)
+	{
+		m_failed = true;
+		return;
+	}
+
+	int headerSize = fprintf(m_pFile, "%s\n%u %u\n255\n", m_channelCount == 1 ? "P5" : "P6", width, height * depth);
+	m_headerSize = headerSize > 0 ? uint64_t(headerSize) : 0;
+	m_failed = headerSize <= 0;
+}
+
+FileStreamSink::~FileStreamSink()
+{
+	if (m_pFile)
+		fclose(m_pFile);
+}
+
+void FileStreamSink::writeChannels(uint32_t y, uint32_t z, uint32_t x0, uint32_t count, const float* const* channels, uint32_t channelCount)
+{
+	if (!m_pFile)
+		return;
+
+	// quantise outside of the lock, only the write itself is serialised
+	std::vector<uint8_t> row(size_t(count) * m_channelCount);
+	if (m_channelCount == 1)
+	{
+		PackedRowSink::packRow(NoiseChannelLayout::R8, channels, channelCount, count, row.data());
+	}
+	else
+	{
+		for (uint32_t c = 0; c < 3; ++c)
+		{
+			const float* src = channels[c < channelCount ? c : 0];
+			for (uint32_t x = 0; x < count; ++x)
+			{
+				row[x * 3 + c] = quantize(src[x]);
+			}
+		}
+	}
+
+	// rows can come in any order, seek to the row (past the end grows the file)
+	uint64_t offset = m_headerSize + ((uint64_t(z) * m_height + y) * m_width + x0) * m_channelCount;
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (m_failed || !m_pFile)
+		return;
+	m_failed = !seekFile(m_pFile, offset) || fwrite(row.data(), 1, row.size(), m_pFile) != row.size();
+	m_writtenTexels += count;
+}
+
+bool FileStreamSink::isComplete()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (m_pFile)
+	{
+		// a full disk may only show when the buffered rows reach the file
+		m_failed = fclose(m_pFile) != 0 || m_failed;
+		m_pFile = nullptr;
+	}
+	return !m_failed && m_writtenTexels == size_t(m_width) * m_height * m_depth;
+}
+
+/* --------------------------------- Image export --------------------------------- */
+
+ImageExportSink::ImageExportSink(const char* path, NoiseExportFormat format, uint32_t width, uint32_t height, uint32_t depth,
+	uint32_t channelCount) :
+	m_path(path),
+	m_format(format),
+	m_width(width),
+	m_height(height),
+	m_depth(depth),
+	m_channelCount(channelCount < 1 ? 1 : (channelCount > 4 ? 4 : channelCount)),
+	m_bytesPerTexel(m_channelCount * (format == NoiseExportFormat::Raw16 ? 2 : 1)),
+	m_pRawFile(nullptr),
+	m_slices(depth),
+	m_writtenSlices(0),
+	m_failed(false)
+{
+	if (m_format != NoiseExportFormat::Png)
+	{
+		m_pRawFile = fopen(path, "wb");
+		m_failed = m_pRawFile == nullptr;
+	}
+}
+
+ImageExportSink::~ImageExportSink()
+{
+	if (m_pRawFile)
+		fclose(m_pRawFile);
+}
+
+void ImageExportSink::writeChannels(uint32_t y, uint32_t z, uint32_t x0, uint32_t count, const float* const* channels, uint32_t channelCount)
+{
+	Slice* pSlice;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_failed)
+			return;
+		std::unique_ptr<Slice>& slot = m_slices[z];
+		if (!slot)
+		{
+			slot.reset(new Slice());
+			slot->texels.resize(size_t(m_width) * m_height * m_bytesPerTexel);
+		}
+		pSlice = slot.get();
+	}
+
+	// rows of a slice never overlap, they are quantised outside of the lock
+	uint8_t* pRow = &pSlice->texels[(size_t(y) * m_width + x0) * m_bytesPerTexel];
+	for (uint32_t c = 0; c < m_channelCount; ++c)
+	{
+		const float* src = channels[c < channelCount ? c : 0];
+		if (m_format == NoiseExportFormat::Raw16)
+		{
+			uint16_t* scanline = (uint16_t*)pRow;
+			for (uint32_t x = 0; x < count; ++x)
+				scanline[x * m_channelCount + c] = uint16_t(saturate(src[x]) * 65535.0f + 0.5f);
+		}
+		else
+		{
+			for (uint32_t x = 0; x < count; ++x)
+				pRow[x * m_channelCount + c] = quantize(src[x]);
+		}
+	}
+
+	std::unique_ptr<Slice> pComplete;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		pSlice->writtenTexels += count;
+		if (pSlice->writtenTexels == size_t(m_width) * m_height)
+			pComplete = std::move(m_slices[z]);
+	}
+	if (pComplete)
+		writeSlice(z, *pComplete);
+}
+
+bool ImageExportSink::isComplete()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (m_pRawFile)
+	{
+		// a full disk may only show when the buffered slices reach the file
+		m_failed = fclose(m_pRawFile) != 0 || m_failed;
+		m_pRawFile = nullptr;
+	}
+	return !m_failed && m_writtenSlices == m_depth;
+}
+
+std::string ImageExportSink::getSlicePath(uint32_t z) const
+{
+	if (m_format != NoiseExportFormat::Png || m_depth == 1)
+		return m_path;
+
+	char index[16];
+	snprintf(index, sizeof(index), "_%03u", z);
+	size_t extension = m_path.find_last_of('.');
+	size_t directory = m_path.find_last_of("/\\");
+	if (extension == std::string::npos || (directory != std::string::npos && extension < directory))
+		extension = m_path.size();
+	return m_path.substr(0, extension) + index + m_path.substr(extension);
+}
+
+void ImageExportSink::writeSlice(uint32_t z, const Slice& slice)
+{
+	bool written;
+	if (m_format == NoiseExportFormat::Png)
+	{
+		// each slice is its own file, the encodes run concurrently
+		written = stbi_write_png(getSlicePath(z).c_str(), int(m_width), int(m_height), int(m_channelCount), slice.texels.data(),
+			int(m_width * m_bytesPerTexel)) != 0;
+	}
+	else
+	{
+		uint64_t offset = uint64_t(z) * slice.texels.size();
+		std::lock_guard<std::mutex> lock(m_mutex);
+		written = m_pRawFile && seekFile(m_pRawFile, offset) &&
+			fwrite(slice.texels.data(), 1, slice.texels.size(), m_pRawFile) == slice.texels.size();
+	}
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_failed = m_failed || !written;
+	m_writtenSlices++;
+}
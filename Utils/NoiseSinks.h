@@ -0,0 +1,159 @@
+#pragma once
+
+#include "../Noise/NoiseSink.h"
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/// Round to nearest even conversion to a half float, subnormals included
+uint16_t floatToHalf(float value);
+float halfToFloat(uint16_t value);
+
+/// Texel layout of a baked texture.
+/// Single channel noises belong in R8 / R16, the wider layouts are for bakes whose channels really differ
+enum class NoiseChannelLayout
+{
+    R8,
+    R16_UNORM,
+    R16F,
+    /// Two channels, a single channel bake is replicated in both
+    RG8,
+    /// Up to three channels packed in rgb, alpha is 0. A single channel bake is replicated in rgb
+    RGBA8,
+    /// Block compressed, one channel in 4x4 blocks of 8 bytes. Baked as R8 then encoded by NoiseBlockCompressor
+    BC4,
+    /// Block compressed, two channels in 4x4 blocks of 16 bytes. Baked as RG8 then encoded, a third channel is dropped
+    BC5,
+};
+
+/// Packs the rows in a channel layout into strided memory, typically the mapped rows of a texture update.
+/// The block compressed layouts are packed as their R8 / RG8 source
+class PackedRowSink : public NoiseSink
+{
+public:
+    PackedRowSink(NoiseChannelLayout layout, uint8_t* pDst, size_t rowStride, size_t sliceStride = 0);
+
+    void writeChannels(uint32_t y, uint32_t z, uint32_t x0, uint32_t count, const float* const* channels, uint32_t channelCount) override;
+
+    static uint32_t getBytesPerTexel(NoiseChannelLayout layout);
+    /// Pack count texels of channelCount float channels in [0, 1], channels the layout can't hold are dropped
+    static void packRow(NoiseChannelLayout layout, const float* const* channels, uint32_t channelCount, uint32_t count, uint8_t* pDst);
+
+private:
+    NoiseChannelLayout m_layout;
+    uint32_t m_bytesPerTexel;
+    uint8_t* m_pDst;
+    size_t m_rowStride;
+    size_t m_sliceStride;
+};
+
+/// Dense 8 bit buffer of the first channel
+class QuantizedBufferSink : public NoiseSink
+{
+public:
+    QuantizedBufferSink(uint32_t width, uint32_t height, uint32_t depth = 1);
+
+    void writeChannels(uint32_t y, uint32_t z, uint32_t x0, uint32_t count, const float* const* channels, uint32_t channelCount) override;
+    const std::vector<uint8_t>& getData() const { return m_data; }
+
+private:
+    uint32_t m_width;
+    uint32_t m_height;
+    std::vector<uint8_t> m_data;
+};
+
+/// Dense float buffer, channelCount interleaved channels per texel
+class FloatBufferSink : public NoiseSink
+{
+public:
+    FloatBufferSink(uint32_t width, uint32_t height, uint32_t depth = 1, uint32_t channelCount = 1);
+
+    void writeChannels(uint32_t y, uint32_t z, uint32_t x0, uint32_t count, const float* const* channels, uint32_t channelCount) override;
+    const std::vector<float>& getData() const { return m_data; }
+
+private:
+    uint32_t m_width;
+    uint32_t m_height;
+    uint32_t m_channelCount;
+    std::vector<float> m_data;
+};
+
+/// Streams 8 bit rows to a binary PGM (1 channel) or PPM (3 channels) file as they are produced.
+/// Volumes are written as their slices stacked vertically
+class FileStreamSink : public NoiseSink
+{
+public:
+    FileStreamSink(const char* path, uint32_t width, uint32_t height, uint32_t depth = 1, uint32_t channelCount = 1);
+    ~FileStreamSink();
+
+    void writeChannels(uint32_t y, uint32_t z, uint32_t x0, uint32_t count, const float* const* channels, uint32_t channelCount) override;
+    bool isOpen() const { return m_pFile != nullptr; }
+    /// Closes the file, true when every texel has been written and the file closed successfully. Later rows are dropped
+    bool isComplete();
+
+private:
+    FILE* m_pFile;
+    uint64_t m_headerSize;
+    uint32_t m_width;
+    uint32_t m_height;
+    uint32_t m_depth;
+    uint32_t m_channelCount;
+    std::mutex m_mutex;
+    size_t m_writtenTexels;
+    bool m_failed;
+};
+
+enum class NoiseExportFormat
+{
+    /// 8 bits per channel PNG, a volume is written as one file per slice
+    Png,
+    /// Uncompressed 8 bits per channel, a volume is written as its consecutive slices in a single file
+    Raw8,
+    /// Uncompressed 16 bits unorm per channel in native (little endian) order, same file organisation as Raw8
+    Raw16,
+};
+
+/// Exports rows to image files of 1 to 4 interleaved channels, a single channel row fills every channel.
+/// Rows are gathered per slice and only the slices being written are resident. The thread completing a slice encodes
+/// and writes it, so the slices of a volume are compressed in parallel. Every texel must be written once.
+/// The PNG slices of a volume get their index before the extension (cloud.png: cloud_000.png, cloud_001.png...)
+class ImageExportSink : public NoiseSink
+{
+public:
+    ImageExportSink(const char* path, NoiseExportFormat format, uint32_t width, uint32_t height, uint32_t depth = 1,
+        uint32_t channelCount = 1);
+    ~ImageExportSink();
+
+    void writeChannels(uint32_t y, uint32_t z, uint32_t x0, uint32_t count, const float* const* channels, uint32_t channelCount) override;
+    /// Closes the raw file, true when every slice has been written and the file closed successfully. Later slices are dropped
+    bool isComplete();
+    std::string getSlicePath(uint32_t z) const;
+
+private:
+    struct Slice
+    {
+        std::vector<uint8_t> texels;
+        size_t writtenTexels = 0;
+    };
+
+    void writeSlice(uint32_t z, const Slice& slice);
+
+    std::string m_path;
+    NoiseExportFormat m_format;
+    uint32_t m_width;
+    uint32_t m_height;
+    uint32_t m_depth;
+    uint32_t m_channelCount;
+    uint32_t m_bytesPerTexel;
+    FILE* m_pRawFile;
+    // slices being gathered, released once written
+    std::vector<std::unique_ptr<Slice>> m_slices;
+    uint32_t m_writtenSlices;
+    bool m_failed;
+    std::mutex m_mutex;
+};
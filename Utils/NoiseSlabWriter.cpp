@@ -0,0 +1,226 @@
+#include "NoiseSlabWriter.h"
+#include "NoiseGraph.h"
+#include "NoiseBlockCompressor.h"
+#include "NoiseCache.h"
+
+#include "../../../../../Common_3/Utilities/Interfaces/ILog.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+	/// Shifts the slices of a slab back to the start of its buffer
+	class SlabSink : public NoiseSink
+	{
+	public:
+		SlabSink(NoiseChannelLayout layout, uint8_t* pDst, size_t rowStride, size_t sliceStride, uint32_t z0) :
+			m_sink(layout, pDst, rowStride, sliceStride),
+			m_z0(z0)
+		{
+		}
+
+		void writeChannels(uint32_t y, uint32_t z, uint32_t x0, uint32_t count, const float* const* channels, uint32_t channelCount) override
+		{
+			m_sink.writeChannels(y, z - m_z0, x0, count, channels, channelCount);
+		}
+
+	private:
+		PackedRowSink m_sink;
+		uint32_t m_z0;
+	};
+
+	/// Writable file of a fixed size, mapped one range at a time
+	class MappedFile
+	{
+	public:
+		bool create(const char* path, uint64_t size)
+		{
+#ifdef _WIN32
+			m_file = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+			if (m_file == INVALID_HANDLE_VALUE)
+				return false;
+			// sizes the file
+			m_mapping = CreateFileMappingA(m_file, NULL, PAGE_READWRITE, DWORD(size >> 32), DWORD(size), NULL);
+			SYSTEM_INFO systemInfo;
+			GetSystemInfo(&systemInfo);
+			m_alignment = systemInfo.dwAllocationGranularity;
+			return m_mapping != NULL;
+#else
+			m_file = ::open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+			if (m_file < 0)
+				return false;
+			m_alignment = uint64_t(sysconf(_SC_PAGESIZE));
+#ifdef __linux__
+			// reserve the blocks, a full disk fails here instead of raising SIGBUS while a slab is written
+			return posix_fallocate(m_file, 0, off_t(size)) == 0;
+#else
+			return ftruncate(m_file, off_t(size)) == 0;
+#endif
+#endif
+		}
+
+		/// The previous range is unmapped, its pages are written back by the system
+		uint8_t* map(uint64_t offset, size_t size)
+		{
+			unmap();
+			// views start on an aligned offset
+			uint64_t start = offset - offset % m_alignment;
+			m_viewSize = size_t(offset - start) + size;
+#ifdef _WIN32
+			m_pView = MapViewOfFile(m_mapping, FILE_MAP_WRITE, DWORD(start >> 32), DWORD(start), m_viewSize);
+#else
+			m_pView = mmap(NULL, m_viewSize, PROT_READ | PROT_WRITE, MAP_SHARED, m_file, off_t(start));
+			if (m_pView == MAP_FAILED)
+				m_pView = NULL;
+#endif
+			return m_pView ? (uint8_t*)m_pView + (offset - start) : NULL;
+		}
+
+		void unmap()
+		{
+			if (!m_pView)
+				return;
+#ifdef _WIN32
+			UnmapViewOfFile(m_pView);
+#else
+			munmap(m_pView, m_viewSize);
+#endif
+			m_pView = NULL;
+		}
+
+		bool close()
+		{
+			unmap();
+#ifdef _WIN32
+			bool success = true;
+			if (m_mapping)
+				success = CloseHandle(m_mapping) != 0;
+			if (m_file != INVALID_HANDLE_VALUE)
+				success = CloseHandle(m_file) != 0 && success;
+			m_mapping = NULL;
+			m_file = INVALID_HANDLE_VALUE;
+#else
+			bool success = m_file >= 0 && ::close(m_file) == 0;
+			m_file = -1;
+#endif
+			return success;
+		}
+
+		~MappedFile()
+		{
+			close();
+		}
+
+	private:
+#ifdef _WIN32
+		HANDLE m_file = INVALID_HANDLE_VALUE;
+		HANDLE m_mapping = NULL;
+#else
+		int m_file = -1;
+#endif
+		uint64_t m_alignment = 1;
+		void* m_pView = NULL;
+		size_t m_viewSize = 0;
+	};
+}
+
+/* --------------------------------- Public methods --------------------------------- */
+
+size_t NoiseSlabWriter::getSliceSize(uint32_t width, uint32_t height, NoiseChannelLayout layout)
+{
+	if (NoiseBlockCompressor::isBlockCompressed(layout))
+	{
+		return size_t(NoiseBlockCompressor::getBlockCount(width)) * NoiseBlockCompressor::getBlockCount(height) *
+			NoiseBlockCompressor::getBlockBytes(layout);
+	}
+	return size_t(width) * height * PackedRowSink::getBytesPerTexel(layout);
+}
+
+uint32_t NoiseSlabWriter::getSlabDepth(uint32_t width, uint32_t height, uint32_t depth, NoiseChannelLayout layout, size_t memoryBudget)
+{
+	size_t sliceSize = getSliceSize(width, height, layout);
+	if (NoiseBlockCompressor::isBlockCompressed(layout))
+		sliceSize += getSliceSize(width, height, NoiseBlockCompressor::getSourceLayout(layout));
+	return uint32_t(std::max<size_t>(1, std::min<size_t>(depth, memoryBudget / std::max<size_t>(1, sliceSize))));
+}
+
+bool NoiseSlabWriter::write(const NoiseGraph& graph, NoiseChannelLayout layout, size_t memoryBudget, const char* path,
+	const void* pHeader, size_t headerSize, NoiseCompressionStats* pStats)
+{
+	uint32_t width = graph.getWidth();
+	uint32_t height = graph.getHeight();
+	uint32_t depth = graph.getDepth();
+	bool compressed = NoiseBlockCompressor::isBlockCompressed(layout);
+	NoiseChannelLayout sourceLayout = NoiseBlockCompressor::getSourceLayout(layout);
+	size_t sourceRowStride = size_t(width) * PackedRowSink::getBytesPerTexel(sourceLayout);
+	size_t sourceSliceStride = sourceRowStride * height;
+	size_t rowStride = compressed ? size_t(NoiseBlockCompressor::getBlockCount(width)) * NoiseBlockCompressor::getBlockBytes(layout) :
+		sourceRowStride;
+	size_t sliceStride = getSliceSize(width, height, layout);
+	uint32_t slabDepth = getSlabDepth(width, height, depth, layout, memoryBudget);
+
+	// same as the cache entries, the file only gets its name once complete
+	std::string tmpPath = NoiseCache::getTempPath(path);
+	MappedFile file;
+	bool success = file.create(tmpPath.c_str(), headerSize + uint64_t(sliceStride) * depth);
+	if (success && headerSize > 0)
+	{
+		uint8_t* pDst = file.map(0, headerSize);
+		success = pDst != NULL;
+		if (success)
+			memcpy(pDst, pHeader, headerSize);
+	}
+
+	// the block compressed slabs are baked in their source layout first, blocks never span slices
+	std::vector<uint8_t> source(compressed ? sourceSliceStride * slabDepth : 0);
+	for (uint32_t z0 = 0; z0 < depth && success; z0 += slabDepth)
+	{
+		uint32_t sliceCount = std::min(slabDepth, depth - z0);
+		uint8_t* pSlab = file.map(headerSize + uint64_t(sliceStride) * z0, sliceStride * sliceCount);
+		success = pSlab != NULL;
+		if (!success)
+			break;
+
+		if (compressed)
+		{
+			SlabSink sink(sourceLayout, source.data(), sourceRowStride, sourceSliceStride, z0);
+			graph.evaluate(sink, z0, sliceCount);
+			NoiseCompressionStats stats = NoiseBlockCompressor::encode(layout, source.data(), sourceRowStride, sourceSliceStride, width,
+				height, sliceCount, pSlab, rowStride, sliceStride);
+			if (pStats)
+				pStats->merge(stats);
+		}
+		else
+		{
+			SlabSink sink(layout, pSlab, rowStride, sliceStride, z0);
+			graph.evaluate(sink, z0, sliceCount);
+		}
+	}
+	success = file.close() && success;
+
+#ifdef _WIN32
+	success = success && MoveFileExA(tmpPath.c_str(), path, MOVEFILE_REPLACE_EXISTING);
+#else
+	success = success && rename(tmpPath.c_str(), path) == 0;
+#endif
+	if (!success)
+	{
+		LOGF(LogLevel::eWARNING, "NoiseSlabWriter: failed to write %s", path);
+		remove(tmpPath.c_str());
+	}
+	return success;
+}
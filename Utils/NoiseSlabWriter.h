@@ -0,0 +1,28 @@
+#pragma once
+
+#include "NoiseSinks.h"
+
+#include <cstdint>
+#include <cstddef>
+
+class NoiseGraph;
+struct NoiseCompressionStats;
+
+/// Out-of-core bake of the volumes too large to be held in memory.
+/// The graph is evaluated one slab of consecutive slices at a time, straight into a writable mapping of the range of the
+/// file the slab lands in. The mapping is released before the next slab, so the resident memory stays around one slab
+/// (plus the evaluation tiles of the workers) whatever the depth of the volume.
+class NoiseSlabWriter
+{
+public:
+    /// Bytes of one slice once written: tightly packed rows, or rows of blocks for BC4 / BC5
+    static size_t getSliceSize(uint32_t width, uint32_t height, NoiseChannelLayout layout);
+    /// Slices per slab so that a slab (and its uncompressed source for BC4 / BC5) fits in memoryBudget, at least 1
+    static uint32_t getSlabDepth(uint32_t width, uint32_t height, uint32_t depth, NoiseChannelLayout layout, size_t memoryBudget);
+
+    /// Write headerSize bytes of pHeader then every slice of the graph outputs packed in layout to path.
+    /// The file is written next to path and renamed once complete, false on failure (nothing is left behind).
+    /// pStats receives the block compression error of BC4 / BC5. The output doesn't depend on the budget
+    static bool write(const NoiseGraph& graph, NoiseChannelLayout layout, size_t memoryBudget, const char* path,
+        const void* pHeader = NULL, size_t headerSize = 0, NoiseCompressionStats* pStats = NULL);
+};
@@ -0,0 +1,79 @@
+#include "TaskScheduler.h"
+
+#include "../Noise/NoiseParallel.h"
+
+#include "../../../../../Common_3/Utilities/Threading/ThreadSystem.h"
+#include "../../../../../Common_3/Utilities/Interfaces/IThread.h"
+
+#include <atomic>
+#include <thread>
+
+ThreadSystem* TaskScheduler::s_pThreadSystem = nullptr;
+uint32_t TaskScheduler::s_threadCount = 1;
+
+struct ParallelForData
+{
+	const std::function<void(uint32_t)>* pTask;
+	std::atomic<uint32_t> remaining;
+};
+
+static void parallelForTask(void* pUserData, uint64_t index)
+{
+	ParallelForData* pData = (ParallelForData*)pUserData;
+	(*pData->pTask)(uint32_t(index));
+	pData->remaining.fetch_sub(1, std::memory_order_release);
+}
+
+/* --------------------------------- Public methods --------------------------------- */
+
+void TaskScheduler::init(uint32_t threadCount)
+{
+	exit();
+
+	if (threadCount == 0)
+		threadCount = getNumCPUCores();
+
+	s_threadCount = threadCount < 1 ? 1 : threadCount;
+	// the calling thread works as well, so only spawn the extra ones
+	if (s_threadCount > 1)
+		initThreadSystem(&s_pThreadSystem, s_threadCount - 1, 0, true, "TaskScheduler");
+	NoiseParallel::setParallelFor(&TaskScheduler::parallelFor);
+}
+
+void TaskScheduler::exit()
+{
+	if (s_pThreadSystem)
+	{
+		exitThreadSystem(s_pThreadSystem);
+		s_pThreadSystem = nullptr;
+	}
+	s_threadCount = 1;
+	NoiseParallel::setParallelFor(NULL);
+}
+
+uint32_t TaskScheduler::getThreadCount()
+{
+	return s_threadCount;
+}
+
+void TaskScheduler::parallelFor(uint32_t count, const std::function<void(uint32_t)>& task)
+{
+	if (!s_pThreadSystem || count <= 1)
+	{
+		for (uint32_t i = 0; i < count; ++i)
+			task(i);
+		return;
+	}
+
+	ParallelForData data;
+	data.pTask = &task;
+	data.remaining.store(count, std::memory_order_relaxed);
+	addThreadSystemRangeTask(s_pThreadSystem, parallelForTask, &data, count);
+
+	// help the workers instead of blocking, this also makes nested calls safe
+	while (data.remaining.load(std::memory_order_acquire) != 0)
+	{
+		if (!assistThreadSystem(s_pThreadSystem))
+			std::this_thread::yield();
+	}
+}
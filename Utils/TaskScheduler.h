@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+
+struct ThreadSystem;
+
+class TaskScheduler
+{
+public:
+    // -------- setup
+    /// Spawn the worker pool, 0 means one worker per core (the calling thread also takes part)
+    static void init(uint32_t threadCount = 0);
+    static void exit();
+    static uint32_t getThreadCount();
+
+    // -------- tasks
+    /// Run task(0) ... task(count - 1) across the workers and return once all of them are done.
+    /// Can be called from inside a task, the caller keeps assisting the pool while it waits.
+    static void parallelFor(uint32_t count, const std::function<void(uint32_t)>& task);
+
+private:
+    static ThreadSystem* s_pThreadSystem;
+    static uint32_t s_threadCount;
+};